@@ -0,0 +1,146 @@
+"""Benchmarks of the pymusly hot paths.
+
+The operations match the native benchmarks in native/benchmarks, which measure libmusly alone,
+so comparing both shows the overhead of the bindings and Python marshalling. All tracks are
+analyzed from synthetic noise. Collections with a million tracks need several GB of memory and
+only run when the environment variable PYMUSLY_BENCHMARK_LARGE is set.
+"""
+
+import io
+import os
+
+import numpy as np
+import pytest
+
+import pymusly as m
+
+SAMPLE_RATE = 22050
+TRACK_SECONDS = 30
+DISTINCT_TRACKS = 32
+
+COLLECTION_SIZES = [1_000, 100_000]
+if os.environ.get("PYMUSLY_BENCHMARK_LARGE"):
+    COLLECTION_SIZES.append(1_000_000)
+
+
+def _noise(seed, seconds=TRACK_SECONDS):
+    generator = np.random.default_rng(seed)
+    return generator.uniform(-0.5, 0.5, seconds * SAMPLE_RATE).astype(np.float32)
+
+
+@pytest.fixture(scope="session")
+def corpus():
+    jukebox = m.MuslyJukebox()
+    tracks = [jukebox.track_from_audiodata(_noise(i)) for i in range(DISTINCT_TRACKS)]
+    jukebox.set_style(tracks)
+
+    return jukebox, tracks
+
+
+def _tuples(tracks, count):
+    return [(i, tracks[i % len(tracks)]) for i in range(count)]
+
+
+def _styled_jukebox(tracks):
+    jukebox = m.MuslyJukebox()
+    jukebox.set_style(tracks)
+    return jukebox
+
+
+@pytest.fixture(scope="session")
+def populated():
+    jukeboxes = {}
+
+    def get(tracks, count):
+        if count not in jukeboxes:
+            jukebox = _styled_jukebox(tracks)
+            jukebox.add_tracks(_tuples(tracks, count))
+            jukeboxes[count] = jukebox
+        return jukeboxes[count]
+
+    return get
+
+
+@pytest.mark.benchmark(group="track_from_audiodata")
+def test_track_from_audiodata_ndarray(benchmark, corpus):
+    jukebox, _ = corpus
+    samples = _noise(0)
+
+    benchmark(jukebox.track_from_audiodata, samples)
+
+
+@pytest.mark.benchmark(group="track_from_audiodata")
+def test_track_from_audiodata_list(benchmark, corpus):
+    jukebox, _ = corpus
+    samples = _noise(0).tolist()
+
+    benchmark(jukebox.track_from_audiodata, samples)
+
+
+@pytest.mark.parametrize("count", COLLECTION_SIZES)
+def test_add_tracks(benchmark, corpus, count):
+    _, tracks = corpus
+    benchmark.group = f"add_tracks-{count}"
+    tuples = _tuples(tracks, count)
+
+    def setup():
+        return (_styled_jukebox(tracks),), {}
+
+    benchmark.pedantic(lambda jukebox: jukebox.add_tracks(tuples), setup=setup, rounds=3)
+
+
+@pytest.mark.parametrize("count", COLLECTION_SIZES)
+def test_compute_similarity_tuples(benchmark, corpus, populated, count):
+    _, tracks = corpus
+    benchmark.group = f"compute_similarity-{count}"
+    jukebox = populated(tracks, count)
+    tuples = _tuples(tracks, count)
+
+    benchmark(jukebox.compute_similarity, tuples[0], tuples)
+
+
+@pytest.mark.parametrize("count", COLLECTION_SIZES)
+def test_compute_similarity_ids(benchmark, corpus, populated, count):
+    _, tracks = corpus
+    benchmark.group = f"compute_similarity-{count}"
+    jukebox = populated(tracks, count)
+    track_ids = list(range(count))
+
+    benchmark(jukebox.compute_similarity, 0, track_ids)
+
+
+@pytest.mark.parametrize("count", COLLECTION_SIZES)
+def test_compute_similarity_array(benchmark, corpus, populated, count):
+    _, tracks = corpus
+    benchmark.group = f"compute_similarity-{count}"
+    jukebox = populated(tracks, count)
+    tuples = _tuples(tracks, count)
+
+    benchmark(jukebox.compute_similarity_array, tuples[0], tuples)
+
+
+@pytest.mark.parametrize("count", COLLECTION_SIZES)
+def test_serialize_to_stream(benchmark, corpus, populated, count):
+    _, tracks = corpus
+    benchmark.group = f"serialize-{count}"
+    jukebox = populated(tracks, count)
+
+    benchmark(lambda: jukebox.serialize_to_stream(io.BytesIO()))
+
+
+@pytest.mark.parametrize("count", COLLECTION_SIZES)
+def test_create_from_stream(benchmark, corpus, populated, count):
+    _, tracks = corpus
+    benchmark.group = f"serialize-{count}"
+    stream = io.BytesIO()
+    populated(tracks, count).serialize_to_stream(stream)
+
+    def setup():
+        stream.seek(0)
+        return (), {}
+
+    benchmark.pedantic(
+        lambda: m.MuslyJukebox.create_from_stream(stream, ignore_decoder=True),
+        setup=setup,
+        rounds=3,
+    )
@@ -0,0 +1,269 @@
+/*
+ * Benchmarks of the libmusly calls behind the hot paths of the bindings.
+ *
+ * These measure libmusly alone; benchmarks/test_benchmarks.py runs the same operations through
+ * pymusly, so the difference between both is the cost of the bindings and Python marshalling.
+ * All tracks are analyzed from synthetic noise, no audio files or network access are needed.
+ */
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <musly/musly.h>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+const int _SAMPLE_RATE = 22050;
+const int _TRACK_SECONDS = 30;
+const int _DISTINCT_TRACKS = 32;
+
+struct jukebox_deleter {
+    void operator()(musly_jukebox* jukebox) const
+    {
+        musly_jukebox_poweroff(jukebox);
+    }
+};
+
+typedef std::unique_ptr<musly_jukebox, jukebox_deleter> jukebox_ptr;
+
+struct track_deleter {
+    void operator()(musly_track* track) const
+    {
+        musly_track_free(track);
+    }
+};
+
+typedef std::unique_ptr<musly_track, track_deleter> track_ptr;
+
+std::vector<float> noise(unsigned int seed, int seconds)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+
+    std::vector<float> samples(static_cast<std::size_t>(seconds) * _SAMPLE_RATE);
+    for (float& sample : samples) {
+        sample = distribution(generator);
+    }
+
+    return samples;
+}
+
+jukebox_ptr poweron()
+{
+    jukebox_ptr jukebox(musly_jukebox_poweron(nullptr, nullptr));
+    if (!jukebox) {
+        throw std::runtime_error("failed to initialize musly jukebox");
+    }
+
+    return jukebox;
+}
+
+/*
+ * A styled jukebox with a small set of distinct analyzed tracks. Larger collections reuse these
+ * tracks over and over, which keeps memory use flat but also makes the track data cache friendlier
+ * than a real collection of the same size would be.
+ */
+class Corpus {
+public:
+    static Corpus& instance()
+    {
+        static Corpus corpus;
+        return corpus;
+    }
+
+    musly_jukebox* jukebox() const
+    {
+        return m_jukebox.get();
+    }
+
+    musly_track* track(std::size_t index) const
+    {
+        return m_tracks[index % m_tracks.size()].get();
+    }
+
+    std::vector<musly_track*> tracks(std::size_t count) const
+    {
+        std::vector<musly_track*> result(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            result[i] = track(i);
+        }
+
+        return result;
+    }
+
+    static std::vector<musly_trackid> track_ids(std::size_t count)
+    {
+        std::vector<musly_trackid> result(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            result[i] = static_cast<musly_trackid>(i);
+        }
+
+        return result;
+    }
+
+    jukebox_ptr styled_jukebox() const
+    {
+        jukebox_ptr jukebox = poweron();
+        std::vector<musly_track*> style = tracks(m_tracks.size());
+        if (musly_jukebox_setmusicstyle(jukebox.get(), style.data(), static_cast<int>(style.size())) != 0) {
+            throw std::runtime_error("failed to set music style");
+        }
+
+        return jukebox;
+    }
+
+    // a styled jukebox with `count` registered tracks, shared by all benchmarks of that size
+    musly_jukebox* populated_jukebox(std::size_t count)
+    {
+        jukebox_ptr& jukebox = m_populated[count];
+        if (!jukebox) {
+            jukebox = styled_jukebox();
+            std::vector<musly_track*> added = tracks(count);
+            std::vector<musly_trackid> ids = track_ids(count);
+            if (musly_jukebox_addtracks(jukebox.get(), added.data(), ids.data(), static_cast<int>(count), 0) != 0) {
+                throw std::runtime_error("failed to add tracks");
+            }
+        }
+
+        return jukebox.get();
+    }
+
+private:
+    Corpus()
+        : m_jukebox(poweron())
+    {
+        for (int i = 0; i < _DISTINCT_TRACKS; ++i) {
+            std::vector<float> samples = noise(i, _TRACK_SECONDS);
+            track_ptr track(musly_track_alloc(m_jukebox.get()));
+            if (!track || musly_track_analyze_pcm(m_jukebox.get(), samples.data(), static_cast<int>(samples.size()), track.get()) != 0) {
+                throw std::runtime_error("failed to analyze synthetic track");
+            }
+            m_tracks.push_back(std::move(track));
+        }
+    }
+
+    jukebox_ptr m_jukebox;
+    std::vector<track_ptr> m_tracks;
+    std::map<std::size_t, jukebox_ptr> m_populated;
+};
+
+void BM_AnalyzePcm(benchmark::State& state)
+{
+    musly_jukebox* jukebox = Corpus::instance().jukebox();
+    std::vector<float> samples = noise(0, static_cast<int>(state.range(0)));
+    track_ptr track(musly_track_alloc(jukebox));
+
+    for (auto _ : state) {
+        if (musly_track_analyze_pcm(jukebox, samples.data(), static_cast<int>(samples.size()), track.get()) != 0) {
+            state.SkipWithError("failed to analyze pcm");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * samples.size());
+}
+BENCHMARK(BM_AnalyzePcm)->Arg(10)->Arg(30)->Unit(benchmark::kMillisecond);
+
+void BM_AddTracks(benchmark::State& state)
+{
+    const std::size_t count = state.range(0);
+    Corpus& corpus = Corpus::instance();
+    std::vector<musly_track*> tracks = corpus.tracks(count);
+    std::vector<musly_trackid> ids = Corpus::track_ids(count);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        jukebox_ptr jukebox = corpus.styled_jukebox();
+        state.ResumeTiming();
+
+        if (musly_jukebox_addtracks(jukebox.get(), tracks.data(), ids.data(), static_cast<int>(count), 0) != 0) {
+            state.SkipWithError("failed to add tracks");
+            break;
+        }
+
+        state.PauseTiming();
+        jukebox.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_AddTracks)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+void BM_Similarity(benchmark::State& state)
+{
+    const std::size_t count = state.range(0);
+    Corpus& corpus = Corpus::instance();
+    musly_jukebox* jukebox = corpus.populated_jukebox(count);
+    std::vector<musly_track*> tracks = corpus.tracks(count);
+    std::vector<musly_trackid> ids = Corpus::track_ids(count);
+    std::vector<float> similarities(count);
+
+    for (auto _ : state) {
+        if (musly_jukebox_similarity(jukebox, tracks[0], ids[0], tracks.data(), ids.data(), static_cast<int>(count), similarities.data()) < 0) {
+            state.SkipWithError("failed to compute similarity");
+            break;
+        }
+        benchmark::DoNotOptimize(similarities.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_Similarity)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+void BM_SerializeJukebox(benchmark::State& state)
+{
+    const int count = static_cast<int>(state.range(0));
+    musly_jukebox* jukebox = Corpus::instance().populated_jukebox(count);
+    const int header_size = musly_jukebox_binsize(jukebox, 1, 0);
+    const int tracks_size = musly_jukebox_binsize(jukebox, 0, count);
+    std::vector<unsigned char> buffer(header_size + tracks_size);
+
+    for (auto _ : state) {
+        if (musly_jukebox_tobin(jukebox, buffer.data(), 1, 0, 0) < 0
+            || musly_jukebox_tobin(jukebox, buffer.data() + header_size, 0, count, 0) < 0) {
+            state.SkipWithError("failed to serialize jukebox");
+            break;
+        }
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_SerializeJukebox)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+void BM_DeserializeJukebox(benchmark::State& state)
+{
+    const int count = static_cast<int>(state.range(0));
+    musly_jukebox* source = Corpus::instance().populated_jukebox(count);
+    const int header_size = musly_jukebox_binsize(source, 1, 0);
+    const int tracks_size = musly_jukebox_binsize(source, 0, count);
+    std::vector<unsigned char> buffer(header_size + tracks_size);
+    if (musly_jukebox_tobin(source, buffer.data(), 1, 0, 0) < 0
+        || musly_jukebox_tobin(source, buffer.data() + header_size, 0, count, 0) < 0) {
+        state.SkipWithError("failed to serialize jukebox");
+        return;
+    }
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        jukebox_ptr jukebox = poweron();
+        state.ResumeTiming();
+
+        if (musly_jukebox_frombin(jukebox.get(), buffer.data(), 1, 0) < 0
+            || musly_jukebox_frombin(jukebox.get(), buffer.data() + header_size, 0, count) < 0) {
+            state.SkipWithError("failed to deserialize jukebox");
+            break;
+        }
+
+        state.PauseTiming();
+        jukebox.reset();
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_DeserializeJukebox)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
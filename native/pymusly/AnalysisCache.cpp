@@ -0,0 +1,166 @@
+#include "AnalysisCache.h"
+#include "FileIO.h"
+#include "MappedFile.h"
+#include "musly_error.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <musly/musly.h>
+
+namespace {
+
+const std::uint64_t _FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+const std::uint64_t _FNV_PRIME = 0x100000001b3ULL;
+const std::size_t _NAME_LENGTH = 16;
+
+std::uint64_t fnv1a(const void* data, std::size_t size, std::uint64_t hash = _FNV_OFFSET_BASIS)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * _FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * Write `size` bytes into the cache entry at `path`. Writes to a file private to this process
+ * and thread first, so concurrent readers never see partial entries.
+ */
+void write_entry(const std::string& path, const void* data, std::size_t size)
+{
+    const std::string temp_path = pymusly::temporary_path(path);
+    std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (file == nullptr) {
+        return;
+    }
+    const bool written = std::fwrite(data, 1, size, file) == size;
+    const bool closed = std::fclose(file) == 0;
+
+    std::error_code error;
+    if (written && closed) {
+        std::filesystem::rename(temp_path, path, error);
+    }
+    if (!written || !closed || error) {
+        std::filesystem::remove(temp_path, error);
+    }
+}
+
+} // namespace
+
+namespace pymusly {
+
+AnalysisCache::AnalysisCache(const std::string& directory)
+    : m_directory(directory)
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (error || !std::filesystem::is_directory(m_directory)) {
+        throw musly_error("could not create analysis cache directory: " + directory);
+    }
+}
+
+const std::string& AnalysisCache::directory() const
+{
+    return m_directory;
+}
+
+int AnalysisCache::analyze_audiofile(musly_jukebox* jukebox, const char* filename, int length, int start, musly_track* track) const
+{
+    std::string path;
+    if (!entry_path(jukebox, filename, length, start, path)) {
+        return musly_track_analyze_audiofile(jukebox, filename, length, start, track);
+    }
+
+    const int bin_size = musly_track_binsize(jukebox);
+    try {
+        MappedFile entry(path);
+        if (entry.size() == static_cast<std::size_t>(bin_size)
+            && musly_track_frombin(jukebox, const_cast<unsigned char*>(entry.data()), track) >= 0) {
+            return 0;
+        }
+    } catch (const musly_error&) {
+        // not cached yet
+    }
+
+    const int ret = musly_track_analyze_audiofile(jukebox, filename, length, start, track);
+    if (ret != 0) {
+        return ret;
+    }
+
+    std::unique_ptr<unsigned char[]> data(new unsigned char[bin_size]);
+    if (musly_track_tobin(jukebox, track, data.get()) >= 0) {
+        write_entry(path, data.get(), bin_size);
+    }
+
+    return ret;
+}
+
+bool AnalysisCache::entry_path(musly_jukebox* jukebox, const char* filename, int length, int start, std::string& path) const
+{
+    // the entry depends on everything that influences the analysis result
+    const char* method = musly_jukebox_methodname(jukebox);
+    const char* decoder = musly_jukebox_decodername(jukebox);
+    const int bin_size = musly_track_binsize(jukebox);
+    std::uint64_t parameters = fnv1a(method, std::strlen(method) + 1);
+    if (decoder != nullptr) {
+        parameters = fnv1a(decoder, std::strlen(decoder), parameters);
+    }
+    parameters = fnv1a(&bin_size, sizeof(bin_size), parameters);
+    parameters = fnv1a(&length, sizeof(length), parameters);
+    parameters = fnv1a(&start, sizeof(start), parameters);
+
+    // a reference keyed by the path, size and modification time of the file names the entry
+    // of its content, so files seen before are not read again
+    std::error_code error;
+    const std::string absolute = std::filesystem::absolute(filename, error).string();
+    const std::uintmax_t file_size = std::filesystem::file_size(filename, error);
+    const auto modified = std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+    std::string reference_path;
+    if (!error) {
+        std::uint64_t hash = fnv1a(absolute.c_str(), absolute.size() + 1, parameters);
+        hash = fnv1a(&file_size, sizeof(file_size), hash);
+        hash = fnv1a(&modified, sizeof(modified), hash);
+        reference_path = entry_file(hash, ".ref");
+        try {
+            MappedFile reference(reference_path);
+            if (reference.size() == _NAME_LENGTH) {
+                path = (std::filesystem::path(m_directory) / (std::string(reinterpret_cast<const char*>(reference.data()), _NAME_LENGTH) + ".track")).string();
+                return true;
+            }
+        } catch (const musly_error&) {
+            // not seen yet
+        }
+    }
+
+    std::uint64_t hash;
+    std::uint64_t size;
+    try {
+        MappedFile audio(filename);
+        size = audio.size();
+        hash = fnv1a(audio.data(), audio.size());
+    } catch (const musly_error&) {
+        return false;
+    }
+    hash = fnv1a(&size, sizeof(size), hash);
+    hash = fnv1a(&parameters, sizeof(parameters), hash);
+    path = entry_file(hash, ".track");
+
+    if (!reference_path.empty()) {
+        write_entry(reference_path, std::filesystem::path(path).stem().string().c_str(), _NAME_LENGTH);
+    }
+
+    return true;
+}
+
+std::string AnalysisCache::entry_file(std::uint64_t hash, const char* extension) const
+{
+    char name[_NAME_LENGTH + 1];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+
+    return (std::filesystem::path(m_directory) / (std::string(name) + extension)).string();
+}
+
+} // namespace pymusly
@@ -0,0 +1,49 @@
+#ifndef PYMUSLY_ANALYSIS_CACHE_H_
+#define PYMUSLY_ANALYSIS_CACHE_H_
+
+#include "common.h"
+
+#include <cstdint>
+#include <musly/musly_types.h>
+#include <string>
+
+namespace pymusly {
+
+/**
+ * On-disk cache of audio file analysis results.
+ *
+ * Entries are keyed by the content of the audio file, the analysis method, the audio decoder
+ * and the excerpt parameters, and contain the serialized track, which is read back through a memory mapping.
+ * A second kind of entry maps the path, size and modification time of an audio file to the
+ * entry of its content, so the content of a file is only hashed the first time it is seen.
+ * The cache is an optimization only: any failure to read or write an entry falls back to
+ * analyzing the file.
+ *
+ * musly only decodes audio files as part of their analysis, so results of other methods or
+ * excerpts of the same file cannot share the decoded audio and are cached separately.
+ */
+class PYMUSLY_EXPORT AnalysisCache {
+public:
+    explicit AnalysisCache(const std::string& directory);
+
+    const std::string& directory() const;
+
+    /**
+     * Analyze an excerpt of an audio file like musly_track_analyze_audiofile(), but reuse the
+     * result of a previous analysis of the same content, method, decoder and excerpt.
+     *
+     * Does not touch any Python object.
+     */
+    int analyze_audiofile(musly_jukebox* jukebox, const char* filename, int length, int start, musly_track* track) const;
+
+private:
+    bool entry_path(musly_jukebox* jukebox, const char* filename, int length, int start, std::string& path) const;
+
+    std::string entry_file(std::uint64_t hash, const char* extension) const;
+
+    std::string m_directory;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_ANALYSIS_CACHE_H_
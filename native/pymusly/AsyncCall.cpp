@@ -0,0 +1,122 @@
+#include "AsyncCall.h"
+#include "ThreadPool.h"
+#include "musly_error.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace py = pybind11;
+
+namespace {
+
+std::mutex _pending_mutex;
+std::condition_variable _pending_condition;
+std::size_t _pending_calls = 0;
+
+pymusly::ThreadPool& worker_pool()
+{
+    // never destroyed, its threads must not outlive the interpreter while joining in a static destructor
+    static pymusly::ThreadPool* pool = new pymusly::ThreadPool();
+    return *pool;
+}
+
+void wait_for_pending_calls()
+{
+    py::gil_scoped_release release;
+    std::unique_lock<std::mutex> lock(_pending_mutex);
+    _pending_condition.wait(lock, [] { return _pending_calls == 0; });
+}
+
+} // namespace
+
+namespace pymusly {
+
+void AsyncCall::register_with_module(py::module_& module)
+{
+    py::module_::import("atexit").attr("register")(py::cpp_function(&wait_for_pending_calls));
+}
+
+py::object AsyncCall::start(py::object owner, work_t work)
+{
+    py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+    py::object future = loop.attr("create_future")();
+
+    {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        ++_pending_calls;
+    }
+
+    AsyncCall* call = new AsyncCall(loop, future, std::move(owner));
+    worker_pool().submit([call, work = std::move(work)] { call->run(work); });
+
+    return future;
+}
+
+AsyncCall::AsyncCall(py::object loop, py::object future, py::object owner)
+    : m_loop(std::move(loop))
+    , m_future(std::move(future))
+    , m_owner(std::move(owner))
+{
+}
+
+void AsyncCall::run(const work_t& work)
+{
+    finisher_t finish;
+    std::exception_ptr error;
+    try {
+        finish = work();
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    {
+        py::gil_scoped_acquire acquire;
+        complete(finish, error);
+
+        // drops the references to the loop, the future and the owner while holding the GIL
+        delete this;
+    }
+
+    std::lock_guard<std::mutex> lock(_pending_mutex);
+    if (--_pending_calls == 0) {
+        _pending_condition.notify_all();
+    }
+}
+
+void AsyncCall::complete(const finisher_t& finish, std::exception_ptr error)
+{
+    py::object setter;
+    py::object value;
+    try {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        value = finish();
+        setter = m_future.attr("set_result");
+    } catch (py::error_already_set& e) {
+        value = e.value();
+        setter = m_future.attr("set_exception");
+    } catch (const musly_error& e) {
+        value = py::module_::import("pymusly._pymusly").attr("MuslyError")(e.what());
+        setter = m_future.attr("set_exception");
+    } catch (const std::exception& e) {
+        value = py::reinterpret_borrow<py::object>(PyExc_RuntimeError)(e.what());
+        setter = m_future.attr("set_exception");
+    }
+
+    // the future may have been cancelled meanwhile, which is only known inside the loop
+    py::cpp_function settle([](py::object future, py::object setter, py::object value) {
+        if (!future.attr("done")().cast<bool>()) {
+            setter(value);
+        }
+    });
+
+    try {
+        m_loop.attr("call_soon_threadsafe")(settle, m_future, setter, value);
+    } catch (py::error_already_set&) {
+        // the loop is closed, nobody is waiting for the result anymore
+    }
+}
+
+} // namespace pymusly
@@ -0,0 +1,56 @@
+#ifndef PYMUSLY_ASYNC_CALL_H_
+#define PYMUSLY_ASYNC_CALL_H_
+
+#include "common.h"
+
+#include <exception>
+#include <functional>
+#include <pybind11/pybind11.h>
+
+namespace pymusly {
+
+/**
+ * A call running on the shared native worker pool that completes an asyncio future.
+ *
+ * The work runs without the GIL and returns a finisher, which converts its result into a Python
+ * object with the GIL held. The result is handed to the future through the event loop's
+ * call_soon_threadsafe, since futures must only be completed by the thread running their loop.
+ */
+class PYMUSLY_EXPORT AsyncCall {
+public:
+    typedef std::function<pybind11::object()> finisher_t;
+    typedef std::function<finisher_t()> work_t;
+
+    /**
+     * Make sure no call is running anymore when the interpreter shuts down.
+     */
+    static void register_with_module(pybind11::module_& module);
+
+    /**
+     * Run `work` on the worker pool and return a future of the running event loop for its result.
+     *
+     * `owner` is kept alive until the call completed. `work` and its finisher are destroyed without
+     * the GIL, so they must not capture Python objects. Must be called with the GIL held from a
+     * coroutine or callback of the event loop.
+     */
+    static pybind11::object start(pybind11::object owner, work_t work);
+
+private:
+    AsyncCall(pybind11::object loop, pybind11::object future, pybind11::object owner);
+
+    AsyncCall(const AsyncCall&) = delete;
+
+    AsyncCall& operator=(const AsyncCall&) = delete;
+
+    void run(const work_t& work);
+
+    void complete(const finisher_t& finish, std::exception_ptr error);
+
+    pybind11::object m_loop;
+    pybind11::object m_future;
+    pybind11::object m_owner;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_ASYNC_CALL_H_
@@ -0,0 +1,110 @@
+#ifndef PYMUSLY_BOUNDED_QUEUE_H_
+#define PYMUSLY_BOUNDED_QUEUE_H_
+
+#include "common.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace pymusly {
+
+/**
+ * A blocking queue of limited capacity connecting producer and consumer threads.
+ *
+ * push() blocks while the queue is full, so slow consumers throttle their producers. Both
+ * push() and pop() add the time they spent waiting to the given counter in nanoseconds.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1)
+        , m_closed(false)
+    {
+        // empty
+    }
+
+    std::size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+    /**
+     * Append an item, returns false without appending if the queue was closed.
+     */
+    template <typename Counter>
+    bool push(T item, Counter& waited_ns)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        wait(lock, m_not_full, [this] { return m_closed || m_items.size() < m_capacity; }, waited_ns);
+        if (m_closed) {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Take the oldest item, returns false once the queue is closed and drained.
+     */
+    template <typename Counter>
+    bool pop(T& item, Counter& waited_ns)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        wait(lock, m_not_empty, [this] { return m_closed || !m_items.empty(); }, waited_ns);
+        if (m_items.empty()) {
+            return false;
+        }
+
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    /**
+     * Stop accepting items and wake up all waiting threads. Queued items can still be popped.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+private:
+    template <typename Predicate, typename Counter>
+    static void wait(std::unique_lock<std::mutex>& lock, std::condition_variable& condition, Predicate ready, Counter& waited_ns)
+    {
+        if (ready()) {
+            return;
+        }
+
+        const auto begin = std::chrono::steady_clock::now();
+        condition.wait(lock, ready);
+        waited_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    const std::size_t m_capacity;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+    std::deque<T> m_items;
+    bool m_closed;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_BOUNDED_QUEUE_H_
@@ -3,53 +3,158 @@
 
 #include "common.h"
 
+#include <algorithm>
+#include <cstring>
 #include <pybind11/pybind11.h>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace pymusly {
 
+/**
+ * Buffered adapter around a Python binary stream.
+ *
+ * Reads are served from a native buffer that is refilled with `readinto` (or `read` as
+ * fallback). For objects providing `getbuffer`, like io.BytesIO, the stream contents are
+ * read in place without any copies. Writes are collected in a native buffer and passed
+ * to `write` in large chunks, which reach the stream on `flush` or `sync`.
+ *
+ * Read-ahead data is given back to seekable streams on `sync`. Streams that cannot seek, like
+ * pipes and sockets, are read without read-ahead, so they are never advanced past the data
+ * consumed through this adapter. peek() uses the stream's own `peek` on those, objects without
+ * it lose the peeked bytes unless they are read afterwards.
+ */
 class PYMUSLY_EXPORT BytesIO {
+public:
+    static const Py_ssize_t BUFFER_SIZE = 64 * 1024;
+
 public:
     static void register_class(pybind11::module_& module);
 
     BytesIO(pybind11::object& python_obj)
         : m_pyRead(getattr(python_obj, "read", pybind11::none()))
+        , m_pyReadinto(getattr(python_obj, "readinto", pybind11::none()))
+        , m_pyGetbuffer(getattr(python_obj, "getbuffer", pybind11::none()))
         , m_pyWrite(getattr(python_obj, "write", pybind11::none()))
         , m_pySeek(getattr(python_obj, "seek", pybind11::none()))
         , m_pyTell(getattr(python_obj, "tell", pybind11::none()))
         , m_pyFlush(getattr(python_obj, "flush", pybind11::none()))
+        , m_pyPeek(getattr(python_obj, "peek", pybind11::none()))
+        , m_seekable(is_seekable(python_obj))
+        , m_view(pybind11::none())
+        , m_readData(nullptr)
+        , m_readPos(0)
+        , m_readEnd(0)
+        , m_reading(false)
     {
     }
 
-    ~BytesIO() { }
+    /**
+     * Gives back read-ahead data. Writes still buffered are discarded, writers must call flush()
+     * or sync() so failures are reported.
+     */
+    ~BytesIO()
+    {
+        try {
+            end_read();
+        } catch (...) {
+            // destructors must not throw, readers that care about the position call sync()
+        }
+    }
 
     Py_ssize_t read(void* dst, Py_ssize_t len)
     {
-        if (m_pyRead.is_none()) {
-            throw std::invalid_argument("the python object has no 'read' method");
+        begin_read();
+
+        char* out = static_cast<char*>(dst);
+        Py_ssize_t total = 0;
+        while (total < len) {
+            if (m_readPos == m_readEnd) {
+                // large reads and all reads from streams that cannot seek go straight into the destination
+                if (m_view.is_none() && (!m_seekable || len - total >= BUFFER_SIZE)) {
+                    const Py_ssize_t bytes_read = read_raw(out + total, len - total);
+                    if (bytes_read <= 0) {
+                        break;
+                    }
+                    total += bytes_read;
+                    continue;
+                }
+                if (fill() <= 0) {
+                    break;
+                }
+            }
+
+            const Py_ssize_t count = std::min(len - total, m_readEnd - m_readPos);
+            std::memcpy(out + total, m_readData + m_readPos, count);
+            m_readPos += count;
+            total += count;
         }
 
-        pybind11::bytes buffer(m_pyRead(len));
-        Py_ssize_t bytes_read = PyBytes_Size(buffer.ptr());
-        if (bytes_read < 0) {
-            return -1;
+        return total;
+    }
+
+    /**
+     * Copy up to `len` bytes, at most BUFFER_SIZE, into `dst` without consuming them.
+     */
+    Py_ssize_t peek(void* dst, Py_ssize_t len)
+    {
+        begin_read();
+
+        if (m_readPos == m_readEnd && !m_seekable && !m_pyPeek.is_none()) {
+            pybind11::bytes peeked(m_pyPeek(len));
+            const Py_ssize_t count = std::min(len, PyBytes_Size(peeked.ptr()));
+            if (count == len) {
+                std::memcpy(dst, PyBytes_AsString(peeked.ptr()), count);
+                return count;
+            }
         }
 
-        std::memcpy(dst, PyBytes_AsString(buffer.ptr()), bytes_read);
+        if (m_readEnd - m_readPos < len && m_view.is_none()) {
+            // move the remaining read-ahead data to the front and fill up the buffer behind it
+            const Py_ssize_t remaining = m_readEnd - m_readPos;
+            if (m_readBuffer.empty()) {
+                m_readBuffer.resize(BUFFER_SIZE);
+            }
+            if (remaining > 0) {
+                std::memmove(m_readBuffer.data(), m_readData + m_readPos, remaining);
+            }
+            m_readData = m_readBuffer.data();
+            m_readPos = 0;
+            m_readEnd = remaining;
+            const Py_ssize_t limit = m_seekable ? BUFFER_SIZE : std::min(len, BUFFER_SIZE);
+            while (m_readEnd < len) {
+                const Py_ssize_t bytes_read = read_raw(m_readBuffer.data() + m_readEnd, limit - m_readEnd);
+                if (bytes_read <= 0) {
+                    break;
+                }
+                m_readEnd += bytes_read;
+            }
+        }
 
-        return bytes_read;
+        const Py_ssize_t count = std::min(len, m_readEnd - m_readPos);
+        if (count > 0) {
+            std::memcpy(dst, m_readData + m_readPos, count);
+        }
+
+        return count;
     }
 
     Py_ssize_t write(const void* src, Py_ssize_t len)
     {
-        if (m_pyWrite.is_none()) {
-            throw std::invalid_argument("the python object has no 'write' method");
+        end_read();
+
+        if (static_cast<Py_ssize_t>(m_writeBuffer.size()) + len > BUFFER_SIZE) {
+            flush_write_buffer();
+        }
+        if (len >= BUFFER_SIZE) {
+            return write_raw(src, len);
         }
 
-        pybind11::bytes buffer(reinterpret_cast<const char*>(src), len);
-        pybind11::object ret = m_pyWrite(buffer);
+        const char* data = static_cast<const char*>(src);
+        m_writeBuffer.insert(m_writeBuffer.end(), data, data + len);
 
-        return ret.cast<Py_ssize_t>();
+        return len;
     }
 
     void seek(Py_ssize_t p, int whence)
@@ -58,6 +163,7 @@ public:
             throw std::invalid_argument("the python object has no 'seek' method");
         }
 
+        sync();
         m_pySeek(p, whence);
     }
 
@@ -67,19 +173,26 @@ public:
             throw std::invalid_argument("the python object has no 'tell' method");
         }
 
+        sync();
         return m_pyTell().cast<Py_ssize_t>();
     }
 
     std::string read_line(const char& terminator = '\n')
     {
-        std::string result = "";
+        begin_read();
 
-        char c;
-        while (read(&c, 1) == 1) {
-            if (c == terminator) {
+        std::string result = "";
+        while (m_readPos < m_readEnd || fill() > 0) {
+            const char* begin = m_readData + m_readPos;
+            const char* found = static_cast<const char*>(std::memchr(begin, terminator, m_readEnd - m_readPos));
+            if (found != nullptr) {
+                result.append(begin, found);
+                m_readPos += found - begin + 1;
                 break;
             }
-            result += c;
+
+            result.append(begin, m_readEnd - m_readPos);
+            m_readPos = m_readEnd;
         }
 
         return result;
@@ -87,7 +200,7 @@ public:
 
     bool write_line(const std::string& str, const char& terminator = '\n')
     {
-        if (write(str.c_str(), str.size()) < str.size()) {
+        if (write(str.c_str(), str.size()) < static_cast<Py_ssize_t>(str.size())) {
             return false;
         }
         if (write(&terminator, 1) < 1) {
@@ -98,6 +211,8 @@ public:
 
     void flush()
     {
+        flush_write_buffer();
+
         if (m_pyFlush.is_none()) {
             return;
         }
@@ -105,12 +220,164 @@ public:
         m_pyFlush();
     }
 
+    /**
+     * Pass buffered writes to the Python object and give back read-ahead data, so the
+     * position of the Python stream matches the data consumed through this adapter.
+     */
+    void sync()
+    {
+        end_read();
+        flush_write_buffer();
+    }
+
 private:
+    static bool is_seekable(pybind11::object& python_obj)
+    {
+        if (getattr(python_obj, "seek", pybind11::none()).is_none()) {
+            return false;
+        }
+
+        pybind11::object seekable = getattr(python_obj, "seekable", pybind11::none());
+        try {
+            return seekable.is_none() || seekable().cast<bool>();
+        } catch (pybind11::error_already_set&) {
+            return false;
+        }
+    }
+
+    void begin_read()
+    {
+        if (m_reading) {
+            return;
+        }
+
+        flush_write_buffer();
+        m_reading = true;
+
+        if (m_pyGetbuffer.is_none() || m_pyTell.is_none() || m_pySeek.is_none()) {
+            return;
+        }
+
+        try {
+            pybind11::object view = m_pyGetbuffer();
+            pybind11::buffer_info info = pybind11::buffer(view).request();
+            m_view = view;
+            m_readData = static_cast<const char*>(info.ptr);
+            m_readEnd = info.size * info.itemsize;
+            m_readPos = std::min(m_pyTell().cast<Py_ssize_t>(), m_readEnd);
+        } catch (pybind11::error_already_set&) {
+            // not an io.BytesIO compatible object, fall back to buffered reads
+            m_view = pybind11::none();
+            m_readData = nullptr;
+            m_readPos = m_readEnd = 0;
+        }
+    }
+
+    void end_read()
+    {
+        if (!m_reading) {
+            return;
+        }
+
+        const Py_ssize_t position = m_readPos;
+        const Py_ssize_t unread = m_readEnd - m_readPos;
+        m_reading = false;
+        m_readData = nullptr;
+        m_readPos = m_readEnd = 0;
+
+        if (!m_view.is_none()) {
+            m_view.attr("release")();
+            m_view = pybind11::none();
+            m_pySeek(position, 0);
+        } else if (unread > 0 && m_seekable) {
+            m_pySeek(-unread, 1);
+        }
+    }
+
+    Py_ssize_t fill()
+    {
+        if (!m_view.is_none()) {
+            return 0;
+        }
+
+        if (m_readBuffer.empty()) {
+            m_readBuffer.resize(BUFFER_SIZE);
+        }
+
+        // a single byte at a time from streams that cannot seek, so read_line() stops at the terminator
+        const Py_ssize_t bytes_read = read_raw(m_readBuffer.data(), m_seekable ? BUFFER_SIZE : 1);
+        m_readData = m_readBuffer.data();
+        m_readPos = 0;
+        m_readEnd = std::max<Py_ssize_t>(bytes_read, 0);
+
+        return bytes_read;
+    }
+
+    Py_ssize_t read_raw(char* dst, Py_ssize_t len)
+    {
+        if (!m_pyReadinto.is_none()) {
+            pybind11::object ret = m_pyReadinto(pybind11::memoryview::from_memory(dst, len));
+            return ret.is_none() ? 0 : ret.cast<Py_ssize_t>();
+        }
+        if (m_pyRead.is_none()) {
+            throw std::invalid_argument("the python object has no 'read' method");
+        }
+
+        pybind11::bytes buffer(m_pyRead(len));
+        Py_ssize_t bytes_read = PyBytes_Size(buffer.ptr());
+        if (bytes_read < 0) {
+            return -1;
+        }
+
+        std::memcpy(dst, PyBytes_AsString(buffer.ptr()), bytes_read);
+
+        return bytes_read;
+    }
+
+    Py_ssize_t write_raw(const void* src, Py_ssize_t len)
+    {
+        if (m_pyWrite.is_none()) {
+            throw std::invalid_argument("the python object has no 'write' method");
+        }
+
+        pybind11::bytes buffer(reinterpret_cast<const char*>(src), len);
+        pybind11::object ret = m_pyWrite(buffer);
+
+        return ret.is_none() ? len : ret.cast<Py_ssize_t>();
+    }
+
+    void flush_write_buffer()
+    {
+        if (m_writeBuffer.empty()) {
+            return;
+        }
+
+        // swap the buffer out first, so a failing write is not repeated by the next flush
+        std::vector<char> pending;
+        pending.swap(m_writeBuffer);
+        write_raw(pending.data(), pending.size());
+
+        pending.clear();
+        m_writeBuffer.swap(pending);
+    }
+
     pybind11::object m_pyRead;
+    pybind11::object m_pyReadinto;
+    pybind11::object m_pyGetbuffer;
     pybind11::object m_pyWrite;
     pybind11::object m_pySeek;
     pybind11::object m_pyTell;
     pybind11::object m_pyFlush;
+    pybind11::object m_pyPeek;
+    bool m_seekable;
+
+    pybind11::object m_view;
+    std::vector<char> m_readBuffer;
+    std::vector<char> m_writeBuffer;
+    const char* m_readData;
+    Py_ssize_t m_readPos;
+    Py_ssize_t m_readEnd;
+    bool m_reading;
 };
 
 } // namespace pymusly
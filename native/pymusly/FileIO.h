@@ -0,0 +1,152 @@
+#ifndef PYMUSLY_FILE_IO_H_
+#define PYMUSLY_FILE_IO_H_
+
+#include "common.h"
+#include "musly_error.h"
+
+#include <cstdio>
+#include <functional>
+#include <pybind11/pybind11.h>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace pymusly {
+
+/**
+ * A path next to `path` to write a file to before it is renamed to `path`. It is private to the
+ * calling process and thread, whose ids repeat across forked processes sharing a directory.
+ */
+inline std::string temporary_path(const std::string& path)
+{
+#if defined(_WIN32)
+    const unsigned long long process_id = static_cast<unsigned long long>(_getpid());
+#else
+    const unsigned long long process_id = static_cast<unsigned long long>(getpid());
+#endif
+
+    return path + "." + std::to_string(process_id) + "."
+        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+}
+
+/**
+ * Buffered native file stream with the same interface as BytesIO.
+ *
+ * It does not touch any Python object, so it can be used while the GIL is released.
+ */
+class PYMUSLY_EXPORT FileIO {
+public:
+    static const std::size_t BUFFER_SIZE = 1 << 20;
+
+public:
+    FileIO(const std::string& path, const char* mode)
+        : m_path(path)
+        , m_file(std::fopen(path.c_str(), mode))
+    {
+        if (m_file == nullptr) {
+            throw musly_error("could not open file: " + path);
+        }
+
+        std::setvbuf(m_file, nullptr, _IOFBF, BUFFER_SIZE);
+    }
+
+    ~FileIO()
+    {
+        if (m_file != nullptr) {
+            std::fclose(m_file);
+        }
+    }
+
+    Py_ssize_t read(void* dst, Py_ssize_t len)
+    {
+        return std::fread(dst, 1, len, m_file);
+    }
+
+    Py_ssize_t write(const void* src, Py_ssize_t len)
+    {
+        return std::fwrite(src, 1, len, m_file);
+    }
+
+    void seek(Py_ssize_t p, int whence)
+    {
+#ifdef _WIN32
+        const int ret = _fseeki64(m_file, p, whence);
+#else
+        const int ret = fseeko(m_file, p, whence);
+#endif
+        if (ret != 0) {
+            throw musly_error("could not seek in file: " + m_path);
+        }
+    }
+
+    Py_ssize_t tell()
+    {
+#ifdef _WIN32
+        return _ftelli64(m_file);
+#else
+        return ftello(m_file);
+#endif
+    }
+
+    std::string read_line(const char& terminator = '\n')
+    {
+        std::string result = "";
+
+        int c;
+        while ((c = std::getc(m_file)) != EOF) {
+            if (c == static_cast<unsigned char>(terminator)) {
+                break;
+            }
+            result += static_cast<char>(c);
+        }
+
+        return result;
+    }
+
+    bool write_line(const std::string& str, const char& terminator = '\n')
+    {
+        if (write(str.c_str(), str.size()) < static_cast<Py_ssize_t>(str.size())) {
+            return false;
+        }
+        if (write(&terminator, 1) < 1) {
+            return false;
+        }
+        return true;
+    }
+
+    void flush()
+    {
+        if (std::fflush(m_file) != 0 || std::ferror(m_file)) {
+            throw musly_error("failed writing to file: " + m_path);
+        }
+    }
+
+    /**
+     * Flush and close the file, the stream must not be used afterwards.
+     */
+    void close()
+    {
+        std::FILE* file = m_file;
+        m_file = nullptr;
+        if (file != nullptr && (std::ferror(file) || std::fclose(file) != 0)) {
+            throw musly_error("failed writing to file: " + m_path);
+        }
+    }
+
+private:
+    FileIO(const FileIO&) = delete;
+
+    FileIO& operator=(const FileIO&) = delete;
+
+    std::string m_path;
+    std::FILE* m_file;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_FILE_IO_H_
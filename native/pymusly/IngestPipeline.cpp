@@ -0,0 +1,254 @@
+#include "IngestPipeline.h"
+#include "AnalysisCache.h"
+#include "BoundedQueue.h"
+#include "FileIO.h"
+#include "ThreadPool.h"
+#include "musly_error.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <musly/musly.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+namespace {
+
+typedef std::unique_ptr<musly_jukebox, void (*)(musly_jukebox*)> analyzer_ptr;
+
+std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+} // namespace
+
+namespace pymusly {
+
+void IngestPipeline::stage_counters_t::reset()
+{
+    files = 0;
+    bytes = 0;
+    busy_ns = 0;
+    blocked_ns = 0;
+}
+
+py::dict IngestPipeline::stage_counters_t::to_dict() const
+{
+    py::dict result;
+    result["files"] = files.load();
+    result["bytes"] = bytes.load();
+    result["busy_seconds"] = busy_ns.load() * 1e-9;
+    result["blocked_seconds"] = blocked_ns.load() * 1e-9;
+
+    return result;
+}
+
+IngestPipeline::IngestPipeline(MuslyJukebox& jukebox, int length, int start, unsigned int read_threads, unsigned int analysis_threads, std::size_t readahead)
+    : m_jukebox(jukebox)
+    , m_length(length)
+    , m_start(start)
+    , m_read_threads(read_threads)
+    , m_analysis_threads(analysis_threads > 0 ? analysis_threads : ThreadPool::hardware_threads())
+    , m_readahead(readahead)
+    , m_queued(0)
+{
+    if (read_threads == 0 || readahead == 0) {
+        throw musly_error("read_threads and readahead must be positive");
+    }
+
+    m_read.reset();
+    m_analysis.reset();
+}
+
+std::vector<MuslyJukebox::analysis_result_t> IngestPipeline::run(const std::vector<std::string>& filenames)
+{
+    std::vector<musly_track*> tracks(filenames.size(), nullptr);
+    std::vector<std::string> errors(filenames.size());
+
+    {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> run_lock(m_run_mutex);
+
+        m_read.reset();
+        m_analysis.reset();
+        m_queued = 0;
+
+        const std::size_t count = std::max<std::size_t>(filenames.size(), 1);
+        const unsigned int readers = static_cast<unsigned int>(std::min<std::size_t>(m_read_threads, count));
+        const unsigned int analyzer_count = static_cast<unsigned int>(std::min<std::size_t>(m_analysis_threads, count));
+        const std::shared_ptr<const AnalysisCache> cache = m_jukebox.shared_analysis_cache();
+
+        // libmusly keeps analysis state inside the jukebox, so every analysis thread gets its own instance
+        std::vector<analyzer_ptr> analyzers;
+        for (unsigned int i = 0; i < analyzer_count; ++i) {
+            analyzers.emplace_back(musly_jukebox_poweron(m_jukebox.method(), m_jukebox.decoder()), musly_jukebox_poweroff);
+            if (!analyzers.back()) {
+                throw musly_error("failed to initialize musly jukebox for analysis");
+            }
+        }
+
+        BoundedQueue<std::size_t> queue(m_readahead);
+        std::atomic<std::size_t> next_file(0);
+        std::atomic<unsigned int> running_readers(readers);
+
+        // every stage thread needs a worker of its own, as they wait for each other
+        ThreadPool pool(readers + analyzer_count);
+        pool.parallel_for(readers + analyzer_count, [&](unsigned int, std::size_t worker) {
+            if (worker < readers) {
+                std::vector<char> buffer(READ_CHUNK_SIZE);
+                try {
+                    for (std::size_t i = next_file++; i < filenames.size(); i = next_file++) {
+                        read_file(filenames[i], buffer);
+                        // counted before the push, so an analyzer never takes a file off the count before it is on it
+                        ++m_queued;
+                        if (!queue.push(i, m_read.blocked_ns)) {
+                            --m_queued;
+                            break;
+                        }
+                    }
+                } catch (...) {
+                    queue.close();
+                    throw;
+                }
+                if (--running_readers == 0) {
+                    queue.close();
+                }
+                return;
+            }
+
+            musly_jukebox* analyzer = analyzers[worker - readers].get();
+            std::size_t i;
+            try {
+                while (queue.pop(i, m_analysis.blocked_ns)) {
+                    --m_queued;
+                    const auto begin = std::chrono::steady_clock::now();
+
+                    musly_track* track = musly_track_alloc(analyzer);
+                    if (track == nullptr) {
+                        errors[i] = "could not allocate track";
+                        continue;
+                    }
+                    const int ret = cache ? cache->analyze_audiofile(analyzer, filenames[i].c_str(), m_length, m_start, track)
+                                          : musly_track_analyze_audiofile(analyzer, filenames[i].c_str(), m_length, m_start, track);
+                    if (ret != 0) {
+                        musly_track_free(track);
+                        errors[i] = "could not load track from audio file: " + filenames[i];
+                    } else {
+                        tracks[i] = track;
+                    }
+
+                    ++m_analysis.files;
+                    m_analysis.busy_ns += elapsed_ns(begin);
+                }
+            } catch (...) {
+                // unblock the readers, the error is rethrown once all stages stopped
+                queue.close();
+                throw;
+            }
+        });
+    }
+
+    std::vector<MuslyJukebox::analysis_result_t> results;
+    results.reserve(filenames.size());
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        if (tracks[i] != nullptr) {
+            results.emplace_back(new MuslyTrack(tracks[i]), std::nullopt);
+        } else {
+            results.emplace_back(nullptr, errors[i].empty() ? "analysis was aborted" : errors[i]);
+        }
+    }
+
+    return results;
+}
+
+void IngestPipeline::read_file(const std::string& filename, std::vector<char>& buffer)
+{
+    const auto begin = std::chrono::steady_clock::now();
+
+    // unreadable files are left to the analysis stage, which reports them
+    try {
+        FileIO file(filename, "rb");
+        Py_ssize_t size;
+        while ((size = file.read(buffer.data(), buffer.size())) > 0) {
+            m_read.bytes += size;
+        }
+    } catch (const musly_error&) {
+        // nothing to prefetch
+    }
+
+    ++m_read.files;
+    m_read.busy_ns += elapsed_ns(begin);
+}
+
+py::dict IngestPipeline::stats() const
+{
+    py::dict result;
+    result["read"] = m_read.to_dict();
+    result["analysis"] = m_analysis.to_dict();
+    result["queued"] = m_queued.load();
+    result["readahead"] = m_readahead;
+
+    return result;
+}
+
+void IngestPipeline::register_class(py::module_& module)
+{
+    py::class_<IngestPipeline>(module, "IngestPipeline", "Pipelined batch analysis of audio files")
+        .def(py::init<MuslyJukebox&, int, int, unsigned int, unsigned int, std::size_t>(), py::arg("jukebox"), py::arg("length"),
+            py::arg("start"), py::arg("read_threads") = 2, py::arg("analysis_threads") = 0, py::arg("readahead") = 16,
+            py::keep_alive<1, 2>(), R"pbdoc(
+            __init__(jukebox: MuslyJukebox, length: int, start: int, read_threads: int = 2, analysis_threads: int = 0, readahead: int = 16) -> None
+
+
+            Create a pipeline analyzing excerpts of audio files with the method and decoder of the given jukebox.
+
+            Reader threads read the files ahead of their analysis, so reading from slow storage overlaps with
+            decoding and analysis. At most `readahead` files are read but not yet analyzed; readers wait once
+            this limit is reached. The analysis cache of the jukebox is used, see :attr:`MuslyJukebox.analysis_cache`.
+
+            :param jukebox:
+                the jukebox providing method, decoder and analysis cache.
+            :param length:
+                the length of the excerpt to analyze in seconds.
+            :param start:
+                the start of the excerpt in seconds, see :func:`MuslyJukebox.track_from_audiofile`.
+            :param read_threads:
+                the number of threads reading files ahead.
+            :param analysis_threads:
+                the number of threads decoding and analyzing files. If `0`, one thread per CPU core is used.
+            :param readahead:
+                the maximum number of files read ahead of their analysis.
+            :raises MuslyError:
+                if `read_threads` or `readahead` is `0`.
+        )pbdoc")
+
+        .def("run", &IngestPipeline::run, py::arg("filenames"), py::return_value_policy::take_ownership, R"pbdoc(
+            run(filenames: list[str]) -> list[tuple[MuslyTrack | None, str | None]]
+
+
+            Analyze the given files, releasing the GIL until all of them are done.
+
+            :param filenames:
+                a list of paths to the audio files to analyze.
+            :return:
+                a list with one `(track, error)` tuple per input file in input order, like :func:`MuslyJukebox.analyze_files`.
+            :raises MuslyError:
+                if the analysis threads cannot be initialized.
+        )pbdoc")
+
+        .def("stats", &IngestPipeline::stats, R"pbdoc(
+            stats() -> dict
+
+
+            Return the counters of the current or last run.
+
+            A dict with the entries `read` and `analysis` describing the stages, each a dict of processed `files`
+            and `bytes`, `busy_seconds` summed over all threads of the stage and `blocked_seconds` spent waiting
+            for the other stage; readers are blocked by a full queue, analyzers by an empty one. `queued` is the
+            number of files currently read ahead and `readahead` the limit for it.
+        )pbdoc");
+}
+
+} // namespace pymusly
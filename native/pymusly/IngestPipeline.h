@@ -0,0 +1,67 @@
+#ifndef PYMUSLY_INGEST_PIPELINE_H_
+#define PYMUSLY_INGEST_PIPELINE_H_
+
+#include "MuslyJukebox.h"
+#include "common.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <pybind11/pybind11.h>
+#include <string>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * Batch analysis of audio files in two pipelined stages.
+ *
+ * Reader threads read each file once ahead of its analysis, so it is served from the page cache
+ * when musly decodes it, and pass it on through a bounded queue to the analysis threads. Slow
+ * network storage thereby overlaps with decoding and analysis, while the queue capacity limits
+ * how far reading gets ahead.
+ */
+class PYMUSLY_EXPORT IngestPipeline {
+public:
+    static const std::size_t READ_CHUNK_SIZE = 1 << 20;
+
+    static void register_class(pybind11::module_& module);
+
+public:
+    IngestPipeline(MuslyJukebox& jukebox, int length, int start, unsigned int read_threads = 2, unsigned int analysis_threads = 0, std::size_t readahead = 16);
+
+    std::vector<MuslyJukebox::analysis_result_t> run(const std::vector<std::string>& filenames);
+
+    pybind11::dict stats() const;
+
+private:
+    struct stage_counters_t {
+        std::atomic<std::uint64_t> files;
+        std::atomic<std::uint64_t> bytes;
+        std::atomic<std::uint64_t> busy_ns;
+        std::atomic<std::uint64_t> blocked_ns;
+
+        void reset();
+
+        pybind11::dict to_dict() const;
+    };
+
+    void read_file(const std::string& filename, std::vector<char>& buffer);
+
+    MuslyJukebox& m_jukebox;
+    const int m_length;
+    const int m_start;
+    const unsigned int m_read_threads;
+    const unsigned int m_analysis_threads;
+    const std::size_t m_readahead;
+
+    std::mutex m_run_mutex;
+    stage_counters_t m_read;
+    stage_counters_t m_analysis;
+    std::atomic<std::size_t> m_queued;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_INGEST_PIPELINE_H_
@@ -0,0 +1,164 @@
+#include "JukeboxSnapshot.h"
+
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+namespace pymusly {
+
+JukeboxSnapshot::JukeboxSnapshot(std::shared_ptr<MuslyJukebox> jukebox)
+    : m_jukebox(std::move(jukebox))
+{
+    // empty
+}
+
+const char* JukeboxSnapshot::method() const
+{
+    return m_jukebox->method();
+}
+
+const char* JukeboxSnapshot::decoder() const
+{
+    return m_jukebox->decoder();
+}
+
+int JukeboxSnapshot::track_count() const
+{
+    return m_jukebox->track_count();
+}
+
+std::vector<musly_trackid> JukeboxSnapshot::track_ids() const
+{
+    return m_jukebox->track_ids();
+}
+
+py::array_t<musly_trackid> JukeboxSnapshot::track_ids_array() const
+{
+    return m_jukebox->track_ids_array();
+}
+
+bool JukeboxSnapshot::vectorized_prefilter() const
+{
+    return m_jukebox->vectorized_prefilter();
+}
+
+std::vector<float> JukeboxSnapshot::compute_similarity(musly_trackid seed_id, const std::vector<musly_trackid>& track_ids)
+{
+    return m_jukebox->compute_similarity(seed_id, track_ids);
+}
+
+std::vector<MuslyJukebox::neighbor_t> JukeboxSnapshot::nearest(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids)
+{
+    return m_jukebox->nearest(seed_id, k, candidate_ids);
+}
+
+std::pair<py::array_t<musly_trackid>, py::array_t<float>> JukeboxSnapshot::nearest_array(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids)
+{
+    return m_jukebox->nearest_array(seed_id, k, candidate_ids);
+}
+
+py::object JukeboxSnapshot::similarity_matrix(const std::optional<std::vector<musly_trackid>>& track_ids, unsigned int threads, const py::object& dtype, int top_k)
+{
+    return m_jukebox->similarity_matrix(track_ids, threads, dtype, top_k);
+}
+
+void JukeboxSnapshot::save(const std::string& path)
+{
+    m_jukebox->save(path);
+}
+
+void JukeboxSnapshot::save_mapped(const std::string& path)
+{
+    m_jukebox->save_mapped(path);
+}
+
+void JukeboxSnapshot::register_class(py::module_& module)
+{
+    py::class_<JukeboxSnapshot>(module, "JukeboxSnapshot", R"pbdoc(
+            Immutable read view of a MuslyJukebox, created by :func:`MuslyJukebox.snapshot`.
+
+            All queries behave like the ones of the jukebox at the time the snapshot was taken. They never wait
+            for modifications of the original jukebox and can be run from several threads at once.
+        )pbdoc")
+        .def_property_readonly("method", &JukeboxSnapshot::method, R"pbdoc(
+            The method for audio data analysis used by the jukebox.
+        )pbdoc")
+
+        .def_property_readonly("decoder", &JukeboxSnapshot::decoder, R"pbdoc(
+            The decoder for reading audio files used by the jukebox.
+        )pbdoc")
+
+        .def_property_readonly("track_count", &JukeboxSnapshot::track_count, R"pbdoc(
+            The number of tracks in the snapshot.
+        )pbdoc")
+
+        .def_property_readonly("track_ids", &JukeboxSnapshot::track_ids, R"pbdoc(
+            A list of all track ids in the snapshot.
+        )pbdoc")
+
+        .def_property_readonly("track_ids_array", &JukeboxSnapshot::track_ids_array, R"pbdoc(
+            All track ids in the snapshot as `numpy.ndarray`.
+        )pbdoc")
+
+        .def_property_readonly("vectorized_prefilter", &JukeboxSnapshot::vectorized_prefilter, R"pbdoc(
+            Whether :func:`nearest` preselects candidates with the vectorized prefilter, as set on the jukebox
+            when the snapshot was taken.
+        )pbdoc")
+
+        .def("compute_similarity", &JukeboxSnapshot::compute_similarity, py::arg("seed_id"), py::arg("track_ids"), R"pbdoc(
+            compute_similarity(seed_id: int, track_ids: list[int]) -> list[float]
+
+
+            Compute the similarity between a seed track and a list of other tracks of the snapshot.
+
+            See :func:`MuslyJukebox.compute_similarity`.
+        )pbdoc")
+
+        .def("nearest", &JukeboxSnapshot::nearest, py::arg("seed_id"), py::arg("k"), py::arg("candidate_ids") = py::none(), R"pbdoc(
+            nearest(seed_id: int, k: int, candidate_ids: list[int] = None) -> list[tuple[int,float]]
+
+
+            Find the `k` tracks of the snapshot most similar to the seed track.
+
+            See :func:`MuslyJukebox.nearest`.
+        )pbdoc")
+
+        .def("nearest_array", &JukeboxSnapshot::nearest_array, py::arg("seed_id"), py::arg("k"), py::arg("candidate_ids") = py::none(), R"pbdoc(
+            nearest_array(seed_id: int, k: int, candidate_ids: list[int] = None) -> tuple[numpy.ndarray, numpy.ndarray]
+
+
+            Like :func:`nearest`, but return the neighbor ids and similarities as two `numpy.ndarray`.
+        )pbdoc")
+
+        .def("similarity_matrix", &JukeboxSnapshot::similarity_matrix, py::arg("track_ids") = py::none(), py::arg("threads") = 0,
+            py::arg("dtype") = py::none(), py::arg("top_k") = 0, R"pbdoc(
+            similarity_matrix(track_ids: list[int] = None, threads: int = 0, dtype = None, top_k: int = 0) -> numpy.ndarray | tuple[numpy.ndarray, numpy.ndarray]
+
+
+            Compute the similarities between all pairs of the given tracks of the snapshot.
+
+            See :func:`MuslyJukebox.similarity_matrix`.
+        )pbdoc")
+
+        .def("save", &JukeboxSnapshot::save, py::arg("path"), R"pbdoc(
+            save(path: str) -> None
+
+
+            Write the snapshot into a file readable by :func:`MuslyJukebox.load`.
+
+            :raises MuslyError:
+                if the snapshot cannot be written into the given file.
+        )pbdoc")
+
+        .def("save_mapped", &JukeboxSnapshot::save_mapped, py::arg("path"), R"pbdoc(
+            save_mapped(path: str) -> None
+
+
+            Write the snapshot into a file for :func:`MuslyJukebox.open_mapped`.
+
+            :raises MuslyError:
+                if the snapshot cannot be written into the given file.
+        )pbdoc");
+}
+
+} // namespace pymusly
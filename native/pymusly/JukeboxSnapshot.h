@@ -0,0 +1,60 @@
+#ifndef PYMUSLY_JUKEBOX_SNAPSHOT_H_
+#define PYMUSLY_JUKEBOX_SNAPSHOT_H_
+
+#include "MuslyJukebox.h"
+#include "common.h"
+
+#include <memory>
+#include <musly/musly_types.h>
+#include <optional>
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <string>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * Immutable read view of a MuslyJukebox, created by MuslyJukebox::snapshot().
+ *
+ * The snapshot owns a private jukebox that is never modified, so its queries never wait
+ * for writers of the jukebox it was taken from.
+ */
+class PYMUSLY_EXPORT JukeboxSnapshot {
+public:
+    static void register_class(pybind11::module_& module);
+
+public:
+    explicit JukeboxSnapshot(std::shared_ptr<MuslyJukebox> jukebox);
+
+    const char* method() const;
+
+    const char* decoder() const;
+
+    int track_count() const;
+
+    std::vector<musly_trackid> track_ids() const;
+
+    pybind11::array_t<musly_trackid> track_ids_array() const;
+
+    bool vectorized_prefilter() const;
+
+    std::vector<float> compute_similarity(musly_trackid seed_id, const std::vector<musly_trackid>& track_ids);
+
+    std::vector<MuslyJukebox::neighbor_t> nearest(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids = std::nullopt);
+
+    std::pair<pybind11::array_t<musly_trackid>, pybind11::array_t<float>> nearest_array(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids = std::nullopt);
+
+    pybind11::object similarity_matrix(const std::optional<std::vector<musly_trackid>>& track_ids, unsigned int threads, const pybind11::object& dtype, int top_k);
+
+    void save(const std::string& path);
+
+    void save_mapped(const std::string& path);
+
+private:
+    std::shared_ptr<MuslyJukebox> m_jukebox;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_JUKEBOX_SNAPSHOT_H_
@@ -0,0 +1,137 @@
+#include "JukeboxStats.h"
+
+namespace py = pybind11;
+
+namespace {
+
+#ifdef PYMUSLY_ENABLE_STATS
+const char* const _OPERATION_NAMES[] = {
+    "track_from_audiofile",
+    "track_from_audiodata",
+    "analyze_files",
+    "set_style",
+    "add_tracks",
+    "remove_tracks",
+    "compute_similarity",
+    "nearest",
+    "similarity_matrix",
+    "generate_playlist",
+    "serialize",
+    "deserialize",
+    "musly_analysis",
+    "musly_similarity_batch",
+};
+
+const char* const _STREAM_NAMES[] = {
+    "read",
+    "write",
+};
+
+void update_max(std::atomic<std::uint64_t>& target, std::uint64_t value)
+{
+    std::uint64_t current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+#endif
+
+} // namespace
+
+namespace pymusly {
+
+JukeboxStats::JukeboxStats()
+{
+    reset();
+}
+
+#ifdef PYMUSLY_ENABLE_STATS
+void JukeboxStats::record_call(operation_t operation, std::uint64_t ns)
+{
+    operation_counters_t& counters = m_operations[operation];
+
+    int bucket = 0;
+    for (std::uint64_t us = ns / 1000; us > 0 && bucket < LATENCY_BUCKETS - 1; us >>= 1) {
+        ++bucket;
+    }
+
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+    counters.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    counters.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    update_max(counters.max_ns, ns);
+}
+
+void JukeboxStats::add_stream(stream_t stream, std::uint64_t calls, std::uint64_t bytes, std::uint64_t ns)
+{
+    m_streams[stream].calls.fetch_add(calls, std::memory_order_relaxed);
+    m_streams[stream].bytes.fetch_add(bytes, std::memory_order_relaxed);
+    m_streams[stream].ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void JukeboxStats::record_buffer(std::size_t bytes)
+{
+    update_max(m_peak_buffer_bytes, bytes);
+}
+#endif
+
+void JukeboxStats::reset()
+{
+#ifdef PYMUSLY_ENABLE_STATS
+    for (operation_counters_t& counters : m_operations) {
+        counters.calls = 0;
+        counters.total_ns = 0;
+        counters.max_ns = 0;
+        for (std::atomic<std::uint64_t>& bucket : counters.histogram) {
+            bucket = 0;
+        }
+    }
+    for (stream_counters_t& counters : m_streams) {
+        counters.calls = 0;
+        counters.bytes = 0;
+        counters.ns = 0;
+    }
+    m_tracks_analyzed = 0;
+    m_peak_buffer_bytes = 0;
+#endif
+}
+
+py::dict JukeboxStats::to_dict() const
+{
+    py::dict result;
+    result["enabled"] = enabled;
+
+#ifdef PYMUSLY_ENABLE_STATS
+    py::dict operations;
+    for (int i = 0; i < OPERATION_COUNT; ++i) {
+        const operation_counters_t& counters = m_operations[i];
+        py::list histogram;
+        for (const std::atomic<std::uint64_t>& bucket : counters.histogram) {
+            histogram.append(bucket.load());
+        }
+
+        py::dict operation;
+        operation["calls"] = counters.calls.load();
+        operation["total_seconds"] = counters.total_ns.load() * 1e-9;
+        operation["max_seconds"] = counters.max_ns.load() * 1e-9;
+        operation["histogram"] = histogram;
+        operations[_OPERATION_NAMES[i]] = operation;
+    }
+
+    py::dict streams;
+    for (int i = 0; i < STREAM_COUNT; ++i) {
+        py::dict stream;
+        stream["calls"] = m_streams[i].calls.load();
+        stream["bytes"] = m_streams[i].bytes.load();
+        stream["seconds"] = m_streams[i].ns.load() * 1e-9;
+        streams[_STREAM_NAMES[i]] = stream;
+    }
+
+    result["operations"] = operations;
+    result["streams"] = streams;
+    result["tracks_analyzed"] = m_tracks_analyzed.load();
+    result["peak_buffer_bytes"] = m_peak_buffer_bytes.load();
+#endif
+
+    return result;
+}
+
+} // namespace pymusly
@@ -0,0 +1,280 @@
+#ifndef PYMUSLY_JUKEBOX_STATS_H_
+#define PYMUSLY_JUKEBOX_STATS_H_
+
+#include "common.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <pybind11/pybind11.h>
+#include <string>
+
+namespace pymusly {
+
+/**
+ * Call counts, latencies and I/O volume of a jukebox.
+ *
+ * Only collected when built with the CMake option PYMUSLY_ENABLE_STATS. Otherwise all
+ * recording functions are empty inline stubs, so instrumented code compiles to nothing.
+ * All counters are atomics and may be updated with or without the GIL held.
+ */
+class PYMUSLY_EXPORT JukeboxStats {
+public:
+    enum operation_t {
+        OP_TRACK_FROM_AUDIOFILE,
+        OP_TRACK_FROM_AUDIODATA,
+        OP_ANALYZE_FILES,
+        OP_SET_STYLE,
+        OP_ADD_TRACKS,
+        OP_REMOVE_TRACKS,
+        OP_COMPUTE_SIMILARITY,
+        OP_NEAREST,
+        OP_SIMILARITY_MATRIX,
+        OP_GENERATE_PLAYLIST,
+        OP_SERIALIZE,
+        OP_DESERIALIZE,
+        // time spent inside libmusly, included in the times of the operations above. Similarity
+        // batches count every call into libmusly's similarity functions, of which a single
+        // operation above may make many.
+        OP_MUSLY_ANALYSIS,
+        OP_MUSLY_SIMILARITY_BATCH,
+        OPERATION_COUNT
+    };
+
+    enum stream_t {
+        STREAM_READ,
+        STREAM_WRITE,
+        STREAM_COUNT
+    };
+
+    // bucket 0 counts calls below 1us, bucket i calls below 2^i us, the last one all others
+    static const int LATENCY_BUCKETS = 24;
+
+#ifdef PYMUSLY_ENABLE_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    /**
+     * Measures the time since its construction, without touching the clock if stats are disabled.
+     */
+    class Stopwatch {
+    public:
+#ifdef PYMUSLY_ENABLE_STATS
+        Stopwatch()
+            : m_begin(std::chrono::steady_clock::now())
+        {
+        }
+
+        std::uint64_t elapsed_ns() const
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_begin).count();
+        }
+
+    private:
+        const std::chrono::steady_clock::time_point m_begin;
+#else
+        std::uint64_t elapsed_ns() const
+        {
+            return 0;
+        }
+#endif
+    };
+
+    /**
+     * Adds the duration of its own lifetime to an operation.
+     */
+    class Timer {
+    public:
+        Timer(JukeboxStats& stats, operation_t operation)
+            : m_stats(stats)
+            , m_operation(operation)
+        {
+        }
+
+        ~Timer()
+        {
+            m_stats.record_call(m_operation, m_stopwatch.elapsed_ns());
+        }
+
+    private:
+        Timer(const Timer&) = delete;
+
+        Timer& operator=(const Timer&) = delete;
+
+        JukeboxStats& m_stats;
+        const operation_t m_operation;
+        Stopwatch m_stopwatch;
+    };
+
+    /**
+     * Stream adapter counting calls, bytes and time of reads and writes of another stream.
+     *
+     * The totals are kept in the adapter, so it can be used before the jukebox they belong to
+     * exists; pass them on with `add_to`.
+     */
+    template <typename Stream>
+    class CountingStream {
+    public:
+        explicit CountingStream(Stream& stream)
+            : m_stream(stream)
+        {
+        }
+
+        Py_ssize_t read(void* dst, Py_ssize_t len)
+        {
+            Scope scope(*this, STREAM_READ);
+            return scope.count(m_stream.read(dst, len));
+        }
+
+        Py_ssize_t write(const void* src, Py_ssize_t len)
+        {
+            Scope scope(*this, STREAM_WRITE);
+            return scope.count(m_stream.write(src, len));
+        }
+
+        std::string read_line(const char& terminator = '\n')
+        {
+            Scope scope(*this, STREAM_READ);
+            std::string line = m_stream.read_line(terminator);
+            scope.count(line.size() + 1);
+            return line;
+        }
+
+        bool write_line(const std::string& str, const char& terminator = '\n')
+        {
+            Scope scope(*this, STREAM_WRITE);
+            const bool written = m_stream.write_line(str, terminator);
+            scope.count(written ? str.size() + 1 : 0);
+            return written;
+        }
+
+        void flush()
+        {
+            Scope scope(*this, STREAM_WRITE);
+            m_stream.flush();
+        }
+
+        void add_to(JukeboxStats& stats) const
+        {
+#ifdef PYMUSLY_ENABLE_STATS
+            for (int i = 0; i < STREAM_COUNT; ++i) {
+                stats.add_stream(static_cast<stream_t>(i), m_calls[i], m_bytes[i], m_ns[i]);
+            }
+#endif
+        }
+
+    private:
+        class Scope {
+        public:
+            Scope(CountingStream& owner, stream_t stream)
+                : m_owner(owner)
+                , m_stream(stream)
+            {
+            }
+
+            ~Scope()
+            {
+                m_owner.add(m_stream, 1, 0, m_stopwatch.elapsed_ns());
+            }
+
+            Py_ssize_t count(Py_ssize_t bytes)
+            {
+                m_owner.add(m_stream, 0, bytes > 0 ? bytes : 0, 0);
+                return bytes;
+            }
+
+        private:
+            CountingStream& m_owner;
+            const stream_t m_stream;
+            Stopwatch m_stopwatch;
+        };
+
+#ifdef PYMUSLY_ENABLE_STATS
+        void add(stream_t stream, std::uint64_t calls, std::uint64_t bytes, std::uint64_t ns)
+        {
+            m_calls[stream] += calls;
+            m_bytes[stream] += bytes;
+            m_ns[stream] += ns;
+        }
+#else
+        void add(stream_t, std::uint64_t, std::uint64_t, std::uint64_t)
+        {
+        }
+#endif
+
+        Stream& m_stream;
+#ifdef PYMUSLY_ENABLE_STATS
+        std::uint64_t m_calls[STREAM_COUNT] = {};
+        std::uint64_t m_bytes[STREAM_COUNT] = {};
+        std::uint64_t m_ns[STREAM_COUNT] = {};
+#endif
+    };
+
+public:
+    JukeboxStats();
+
+#ifdef PYMUSLY_ENABLE_STATS
+    void record_call(operation_t operation, std::uint64_t ns);
+
+    void add_stream(stream_t stream, std::uint64_t calls, std::uint64_t bytes, std::uint64_t ns);
+
+    void add_tracks_analyzed(std::uint64_t count)
+    {
+        m_tracks_analyzed += count;
+    }
+
+    void record_buffer(std::size_t bytes);
+#else
+    void record_call(operation_t, std::uint64_t)
+    {
+    }
+
+    void add_stream(stream_t, std::uint64_t, std::uint64_t, std::uint64_t)
+    {
+    }
+
+    void add_tracks_analyzed(std::uint64_t)
+    {
+    }
+
+    void record_buffer(std::size_t)
+    {
+    }
+#endif
+
+    void reset();
+
+    pybind11::dict to_dict() const;
+
+private:
+    JukeboxStats(const JukeboxStats&) = delete;
+
+    JukeboxStats& operator=(const JukeboxStats&) = delete;
+
+#ifdef PYMUSLY_ENABLE_STATS
+    struct operation_counters_t {
+        std::atomic<std::uint64_t> calls;
+        std::atomic<std::uint64_t> total_ns;
+        std::atomic<std::uint64_t> max_ns;
+        std::atomic<std::uint64_t> histogram[LATENCY_BUCKETS];
+    };
+
+    struct stream_counters_t {
+        std::atomic<std::uint64_t> calls;
+        std::atomic<std::uint64_t> bytes;
+        std::atomic<std::uint64_t> ns;
+    };
+
+    operation_counters_t m_operations[OPERATION_COUNT];
+    stream_counters_t m_streams[STREAM_COUNT];
+    std::atomic<std::uint64_t> m_tracks_analyzed;
+    std::atomic<std::uint64_t> m_peak_buffer_bytes;
+#endif
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_JUKEBOX_STATS_H_
@@ -0,0 +1,37 @@
+#ifndef PYMUSLY_MAPPED_FILE_H_
+#define PYMUSLY_MAPPED_FILE_H_
+
+#include "common.h"
+
+#include <cstddef>
+#include <string>
+
+namespace pymusly {
+
+/**
+ * A read-only memory mapping of a whole file.
+ *
+ * Pages are loaded on first access and shared with all other processes mapping the same file.
+ */
+class PYMUSLY_EXPORT MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    ~MappedFile();
+
+    const unsigned char* data() const;
+
+    std::size_t size() const;
+
+private:
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* m_data;
+    std::size_t m_size;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_MAPPED_FILE_H_
@@ -1,10 +1,33 @@
 #include "MuslyJukebox.h"
+#include "AnalysisCache.h"
+#include "AsyncCall.h"
+#include "FileIO.h"
+#include "JukeboxSnapshot.h"
+#include "MappedFile.h"
+#include "NeighborGraph.h"
+#include "PlaylistGenerator.h"
+#include "SharedMemory.h"
+#include "ThreadPool.h"
+#include "TimbreIndex.h"
+#include "TrackCodec.h"
+#include "gil.h"
 #include "musly_error.h"
+#include "ndarray.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
 #include <musly/musly.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <shared_mutex>
 #include <string>
 
 #include <iostream>
@@ -16,20 +39,350 @@ namespace {
 
 const int _ENDIAN_MAGIC_NUMBER = 0x01020304;
 
+// nearest() asks musly for this many neighbor candidates per requested neighbor,
+// but never for less than _MIN_NEIGHBOR_GUESSES
+const int _NEIGHBOR_GUESS_FACTOR = 10;
+const int _MIN_NEIGHBOR_GUESSES = 1000;
+
+// nearest() keeps this many candidates while searching the neighbor graph, unless changed
+const int _DEFAULT_GRAPH_SEARCH_EF = 64;
+
+struct jukebox_deleter {
+    void operator()(musly_jukebox* jukebox) const
+    {
+        musly_jukebox_poweroff(jukebox);
+    }
+};
+
+typedef std::unique_ptr<musly_jukebox, jukebox_deleter> jukebox_ptr;
+
+// header of the memory mappable jukebox format written by save_mapped(). All sections are
+// stored in native byte order and referenced by their offset from the start of the file.
+const char _MAPPED_MAGIC[8] = { 'P', 'Y', 'M', 'U', 'S', 'L', 'Y', 'M' };
+const std::uint32_t _MAPPED_FORMAT_VERSION = 3;
+const std::uint64_t _MAPPED_RECORD_ALIGNMENT = 64;
+
+struct mapped_header_t {
+    char magic[8];
+    std::uint32_t format_version;
+    std::uint32_t int_size;
+    std::int32_t byte_order;
+    char musly_version[32];
+    char method[64];
+    char decoder[64];
+    std::int32_t jukebox_track_count;
+    std::uint64_t jukebox_header_offset;
+    std::uint64_t jukebox_header_size;
+    std::uint64_t jukebox_tracks_offset;
+    std::uint64_t jukebox_tracks_size;
+    std::uint64_t track_size;
+    std::uint64_t record_stride;
+    std::uint64_t record_count;
+    std::uint64_t index_count;
+    std::uint64_t index_offset;
+    std::uint64_t records_offset;
+    std::uint32_t record_encoding;
+    std::uint32_t codec_parameter_count;
+    std::uint64_t codec_parameters_offset;
+};
+
+std::uint64_t align_to(std::uint64_t offset, std::uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// whether `count` items of `size` bytes starting at `offset` lie within the first `limit` bytes,
+// without overflowing on the values of corrupt headers
+bool region_fits(std::uint64_t offset, std::uint64_t count, std::uint64_t size, std::uint64_t limit)
+{
+    return offset <= limit && (size == 0 || count <= (limit - offset) / size);
+}
+
+std::string read_fixed_string(const char* field, std::size_t size)
+{
+    return std::string(field, std::find(field, field + size, '\0'));
+}
+
+void write_fixed_string(char* field, std::size_t size, const char* value)
+{
+    std::strncpy(field, value != nullptr ? value : "", size - 1);
+}
+
+// destinations of the mapped jukebox format. reserve() is called with the total size before the
+// first write(), finish() writes the magic at the start of the image once everything else is done.
+//
+// Files are written next to the target and renamed over it when finished, so processes which
+// have the old file mapped, including the jukebox being saved, keep reading intact data.
+class mapped_file_writer {
+public:
+    explicit mapped_file_writer(const std::string& path)
+        : m_path(path)
+        , m_temp_path(temporary_path(path))
+        , m_out(m_temp_path, std::ios::binary | std::ios::trunc)
+        , m_position(0)
+        , m_finished(false)
+    {
+        if (!m_out) {
+            throw musly_error("could not open file for writing: " + m_temp_path);
+        }
+    }
+
+    ~mapped_file_writer()
+    {
+        if (!m_finished) {
+            m_out.close();
+            std::error_code error;
+            std::filesystem::remove(m_temp_path, error);
+        }
+    }
+
+    void reserve(std::uint64_t)
+    {
+        // empty
+    }
+
+    void write(const char* data, std::size_t size)
+    {
+        m_out.write(data, size);
+        m_position += size;
+    }
+
+    std::uint64_t position() const
+    {
+        return m_position;
+    }
+
+    void finish(const char* magic, std::size_t size)
+    {
+        m_out.seekp(0);
+        m_out.write(magic, size);
+        m_out.close();
+        if (!m_out) {
+            throw musly_error("failed writing jukebox to file: " + m_path);
+        }
+
+        std::error_code error;
+        std::filesystem::rename(m_temp_path, m_path, error);
+        if (error) {
+            throw musly_error("could not replace jukebox file: " + m_path);
+        }
+        m_finished = true;
+    }
+
+private:
+    std::string m_path;
+    std::string m_temp_path;
+    std::ofstream m_out;
+    std::uint64_t m_position;
+    bool m_finished;
+};
+
+// Where objects can be renamed the jukebox is written under a temporary name and renamed once it
+// is complete, elsewhere the old object is removed before the new one is written.
+class mapped_memory_writer {
+public:
+    explicit mapped_memory_writer(const std::string& name)
+        : m_name(name)
+        , m_temp_name(SharedMemory::renamable() ? name + ".tmp" : name)
+        , m_position(0)
+        , m_finished(false)
+    {
+        // empty
+    }
+
+    ~mapped_memory_writer()
+    {
+        if (m_memory && !m_finished) {
+            SharedMemory::remove(m_temp_name);
+        }
+    }
+
+    void reserve(std::uint64_t size)
+    {
+        m_memory = SharedMemory::create(m_temp_name, size);
+    }
+
+    void write(const char* data, std::size_t size)
+    {
+        if (m_position + size > m_memory->size()) {
+            throw musly_error("failed writing jukebox to shared memory: " + m_name);
+        }
+        std::memcpy(m_memory->writable_data() + m_position, data, size);
+        m_position += size;
+    }
+
+    std::uint64_t position() const
+    {
+        return m_position;
+    }
+
+    void finish(const char* magic, std::size_t size)
+    {
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(m_memory->writable_data(), magic, size);
+        if (m_temp_name != m_name) {
+            SharedMemory::rename(m_temp_name, m_name);
+        }
+        m_finished = true;
+    }
+
+private:
+    std::string m_name;
+    std::string m_temp_name;
+    std::unique_ptr<SharedMemory> m_memory;
+    std::uint64_t m_position;
+    bool m_finished;
+};
+
+// save() with `append` set writes the changes since the last save as segments behind the
+// jukebox, which load() replays. A segment starts with the magic, its kind, an int count and
+// the uint64 size of the rest of the segment, followed by `count` track ids for removals or
+// `count` pairs of track id and track data for additions. Directly behind the jukebox, a storage
+// segment holds the encoding of compact track storage followed by its `count` float parameters,
+// a track data segment holds the stored data of tracks the jukebox already registers, in the same
+// layout as additions, and a graph segment holds its neighbor graph index, whose count is the
+// number of tracks in the graph. Track data is in musly's format, or encoded like the records of
+// the track store if the storage is compact.
+//
+// load() ignores a last segment that ends behind the end of the file, which is what an
+// interrupted append leaves behind.
+const char _SEGMENT_MAGIC[4] = { 'P', 'M', 'S', 'G' };
+const std::uint8_t _SEGMENT_REMOVE = 1;
+const std::uint8_t _SEGMENT_ADD = 2;
+const std::uint8_t _SEGMENT_GRAPH = 3;
+const std::uint8_t _SEGMENT_TRACK_DATA = 4;
+const std::uint8_t _SEGMENT_STORAGE = 5;
+const int _SEGMENT_TRACKS_PER_CHUNK = 100;
+const std::uint64_t _SEGMENT_HEADER_SIZE = sizeof(_SEGMENT_MAGIC) + 1 + sizeof(int) + sizeof(std::uint64_t);
+
+template <typename OutputStream>
+void write_segment_header(OutputStream& out_stream, std::uint8_t kind, int count, std::uint64_t size)
+{
+    out_stream.write(_SEGMENT_MAGIC, sizeof(_SEGMENT_MAGIC));
+    out_stream.write(&kind, 1);
+    out_stream.write(&count, sizeof(int));
+    out_stream.write(&size, sizeof(size));
+}
+
+// similarity_matrix() processes blocks of this many seeds against this many candidates at once
+const std::size_t _MATRIX_ROW_TILE = 16;
+const std::size_t _MATRIX_COLUMN_TILE = 1024;
+
+// similarities to stored tracks are computed in tiles of this many tracks, so compact tracks
+// never need to be decoded all at once
+const std::size_t _STORED_TRACK_TILE = 1024;
+
+/**
+ * Create a new jukebox with the same method, style and registered tracks as `source`.
+ *
+ * libmusly gives no guarantee that a single jukebox can be queried from several threads at
+ * once, so parallel queries are run against copies of the jukebox state instead.
+ */
+jukebox_ptr clone_jukebox(musly_jukebox* source)
+{
+    jukebox_ptr clone(musly_jukebox_poweron(musly_jukebox_methodname(source), musly_jukebox_decodername(source)));
+    if (!clone) {
+        throw musly_error("failed to initialize musly jukebox");
+    }
+
+    const int track_count = musly_jukebox_trackcount(source);
+    const int header_size = musly_jukebox_binsize(source, 1, 0);
+    const int tracks_size = musly_jukebox_binsize(source, 0, track_count);
+    if (track_count < 0 || header_size < 0 || tracks_size < 0) {
+        throw musly_error("could not get jukebox size");
+    }
+
+    std::vector<unsigned char> buffer(std::max(header_size, tracks_size));
+    if (musly_jukebox_tobin(source, buffer.data(), 1, 0, 0) < 0
+        || musly_jukebox_frombin(clone.get(), buffer.data(), 1, 0) < 0) {
+        throw musly_error("failed to copy jukebox header");
+    }
+    if (track_count > 0
+        && (musly_jukebox_tobin(source, buffer.data(), 0, track_count, 0) < 0
+            || musly_jukebox_frombin(clone.get(), buffer.data(), 0, track_count) < 0)) {
+        throw musly_error("failed to copy jukebox tracks");
+    }
+
+    return clone;
+}
+
+/**
+ * A codec for the tracks of `store`. `INT8` levels cover the value ranges of the stored tracks.
+ */
+std::shared_ptr<const TrackCodec> create_codec(const TrackStore& store, TrackCodec::encoding_t encoding)
+{
+    const std::size_t floats = store.track_floats();
+    std::vector<float> minimum(floats, 0.0F);
+    std::vector<float> maximum(floats, 0.0F);
+    if (encoding == TrackCodec::INT8) {
+        std::vector<musly_track> track(floats);
+        bool first = true;
+        for (musly_trackid track_id : store.track_ids()) {
+            store.read(track_id, track.data());
+            for (std::size_t f = 0; f < floats; ++f) {
+                if (std::isfinite(track[f])) {
+                    minimum[f] = first ? track[f] : std::min(minimum[f], track[f]);
+                    maximum[f] = first ? track[f] : std::max(maximum[f], track[f]);
+                }
+            }
+            first = false;
+        }
+    }
+
+    return std::make_shared<const TrackCodec>(TrackCodec::create(encoding, floats, minimum, maximum));
+}
+
+/**
+ * Copy all tracks of `source` into a new store using `codec`.
+ */
+std::unique_ptr<TrackStore> encode_tracks(const TrackStore& source, std::shared_ptr<const TrackCodec> codec)
+{
+    std::unique_ptr<TrackStore> store(new TrackStore(source.track_size(), std::move(codec)));
+    std::vector<musly_track> track(source.track_floats());
+    for (musly_trackid track_id : source.track_ids()) {
+        source.read(track_id, track.data());
+        store->put(track_id, track.data());
+    }
+
+    return store;
+}
+
 } // namespace
 
 namespace pymusly {
 
 MuslyJukebox::MuslyJukebox(const char* method, const char* decoder)
+    : m_analyzer(nullptr)
+    , m_vectorized_prefilter(false)
+    , m_graph_search_ef(_DEFAULT_GRAPH_SEARCH_EF)
+    , m_journal_size(0)
 {
     m_jukebox = musly_jukebox_poweron(method, decoder);
     if (m_jukebox == nullptr) {
         throw musly_error("failed to initialize musly jukebox");
     }
+
+    m_track_store.reset(new TrackStore(musly_track_size(m_jukebox)));
+}
+
+MuslyJukebox::MuslyJukebox(musly_jukebox* jukebox, std::unique_ptr<TrackStore> track_store)
+    : m_jukebox(jukebox)
+    , m_track_store(std::move(track_store))
+    , m_analyzer(nullptr)
+    , m_vectorized_prefilter(false)
+    , m_graph_search_ef(_DEFAULT_GRAPH_SEARCH_EF)
+    , m_journal_size(0)
+{
+    // empty
 }
 
 MuslyJukebox::~MuslyJukebox()
 {
+    clear_replicas();
+    if (m_analyzer != nullptr) {
+        musly_jukebox_poweroff(m_analyzer);
+        m_analyzer = nullptr;
+    }
     if (m_jukebox != nullptr) {
         musly_jukebox_poweroff(m_jukebox);
         m_jukebox = nullptr;
@@ -63,6 +416,9 @@ int MuslyJukebox::track_size() const
 
 int MuslyJukebox::track_count() const
 {
+    std::shared_lock<std::shared_mutex> lock(m_mutex, std::defer_lock);
+    lock_without_gil(lock);
+
     const int ret = musly_jukebox_trackcount(m_jukebox);
     if (ret < 0) {
         throw musly_error("could not get jukebox track count");
@@ -72,6 +428,9 @@ int MuslyJukebox::track_count() const
 
 musly_trackid MuslyJukebox::highest_track_id() const
 {
+    std::shared_lock<std::shared_mutex> lock(m_mutex, std::defer_lock);
+    lock_without_gil(lock);
+
     const int ret = musly_jukebox_maxtrackid(m_jukebox);
     if (ret < 0) {
         throw musly_error("could not get last track id from jukebox");
@@ -81,7 +440,20 @@ musly_trackid MuslyJukebox::highest_track_id() const
 
 std::vector<musly_trackid> MuslyJukebox::track_ids() const
 {
-    std::vector<musly_trackid> track_ids(track_count());
+    std::shared_lock<std::shared_mutex> lock(m_mutex, std::defer_lock);
+    lock_without_gil(lock);
+
+    return registered_track_ids();
+}
+
+std::vector<musly_trackid> MuslyJukebox::registered_track_ids() const
+{
+    const int track_count = musly_jukebox_trackcount(m_jukebox);
+    if (track_count < 0) {
+        throw musly_error("could not get jukebox track count");
+    }
+
+    std::vector<musly_trackid> track_ids(track_count);
     const int ret = musly_jukebox_gettrackids(m_jukebox, track_ids.data());
     if (ret < 0) {
         throw musly_error("could not get track ids from jukebox");
@@ -90,55 +462,220 @@ std::vector<musly_trackid> MuslyJukebox::track_ids() const
     return track_ids;
 }
 
+py::array_t<musly_trackid> MuslyJukebox::track_ids_array() const
+{
+    return to_ndarray(track_ids());
+}
+
 MuslyTrack* MuslyJukebox::track_from_audiofile(const char* filename, int length, int start)
 {
-    musly_track* track = musly_track_alloc(m_jukebox);
-    if (track == nullptr) {
-        throw musly_error("could not allocate track");
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_TRACK_FROM_AUDIOFILE);
+
+    musly_track* track;
+    int ret;
+    {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(m_analysis_mutex);
+        musly_jukebox* jukebox = analyzer();
+        track = musly_track_alloc(jukebox);
+        if (track == nullptr) {
+            throw musly_error("could not allocate track");
+        }
+
+        JukeboxStats::Timer analysis_timer(m_stats, JukeboxStats::OP_MUSLY_ANALYSIS);
+        ret = m_analysis_cache ? m_analysis_cache->analyze_audiofile(jukebox, filename, length, start, track)
+                               : musly_track_analyze_audiofile(jukebox, filename, length, start, track);
     }
+    if (ret != 0) {
+        musly_track_free(track);
 
-    if (musly_track_analyze_audiofile(m_jukebox, filename, length, start, track) != 0) {
         std::string message("could not load track from audio file: ");
         message += filename;
 
         throw musly_error(message);
     }
+    m_stats.add_tracks_analyzed(1);
 
     return new MuslyTrack(track);
 }
 
-MuslyTrack* MuslyJukebox::track_from_audiodata(const std::vector<float>& pcm_data)
+py::object MuslyJukebox::analyze_file_async(const std::string& filename, int length, int start)
 {
-    musly_track* track = musly_track_alloc(m_jukebox);
+    return AsyncCall::start(py::cast(this), [this, filename, length, start]() -> AsyncCall::finisher_t {
+        JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_TRACK_FROM_AUDIOFILE);
+
+        // an analyzer of its own lets the call run concurrently with all other analyses
+        jukebox_ptr analyzer(musly_jukebox_poweron(method(), decoder()));
+        if (!analyzer) {
+            throw musly_error("failed to initialize musly jukebox for analysis");
+        }
+        musly_track* track = musly_track_alloc(analyzer.get());
+        if (track == nullptr) {
+            throw musly_error("could not allocate track");
+        }
+
+        const std::shared_ptr<const AnalysisCache> cache = shared_analysis_cache();
+        int ret;
+        {
+            JukeboxStats::Timer analysis_timer(m_stats, JukeboxStats::OP_MUSLY_ANALYSIS);
+            ret = cache ? cache->analyze_audiofile(analyzer.get(), filename.c_str(), length, start, track)
+                        : musly_track_analyze_audiofile(analyzer.get(), filename.c_str(), length, start, track);
+        }
+        if (ret != 0) {
+            musly_track_free(track);
+            throw musly_error("could not load track from audio file: " + filename);
+        }
+        m_stats.add_tracks_analyzed(1);
+
+        return [track] { return py::cast(new MuslyTrack(track), py::return_value_policy::take_ownership); };
+    });
+}
+
+std::optional<std::string> MuslyJukebox::analysis_cache()
+{
+    std::unique_lock<std::mutex> lock(m_analysis_mutex, std::defer_lock);
+    lock_without_gil(lock);
+
+    return m_analysis_cache ? std::optional<std::string>(m_analysis_cache->directory()) : std::nullopt;
+}
+
+void MuslyJukebox::set_analysis_cache(const std::optional<std::string>& directory)
+{
+    std::shared_ptr<const AnalysisCache> cache;
+    if (directory) {
+        cache.reset(new AnalysisCache(*directory));
+    }
+
+    std::unique_lock<std::mutex> lock(m_analysis_mutex, std::defer_lock);
+    lock_without_gil(lock);
+    m_analysis_cache = std::move(cache);
+}
+
+std::shared_ptr<const AnalysisCache> MuslyJukebox::shared_analysis_cache()
+{
+    std::lock_guard<std::mutex> lock(m_analysis_mutex);
+    return m_analysis_cache;
+}
+
+MuslyTrack* MuslyJukebox::track_from_audiodata(pcm_array_t pcm_data)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_TRACK_FROM_AUDIODATA);
+
+    // contiguous float32 buffers are passed through without copying, everything else is converted once
+    const float* samples = pcm_data.data();
+    const std::size_t sample_count = pcm_data.size();
+
+    py::gil_scoped_release release;
+    return new MuslyTrack(analyze_pcm(samples, sample_count));
+}
+
+musly_track* MuslyJukebox::analyze_pcm(const float* samples, std::size_t sample_count)
+{
+    std::lock_guard<std::mutex> lock(m_analysis_mutex);
+    musly_jukebox* jukebox = analyzer();
+
+    musly_track* track = musly_track_alloc(jukebox);
     if (track == nullptr) {
         throw musly_error("could not allocate track");
     }
 
-    if (musly_track_analyze_pcm(m_jukebox, const_cast<float*>(pcm_data.data()), pcm_data.size(), track) != 0) {
+    // musly_track_analyze_pcm does not modify the samples, it just lacks the const qualifier
+    JukeboxStats::Timer analysis_timer(m_stats, JukeboxStats::OP_MUSLY_ANALYSIS);
+    if (musly_track_analyze_pcm(jukebox, const_cast<float*>(samples), sample_count, track) != 0) {
+        musly_track_free(track);
         throw musly_error("could not load track from pcm");
     }
+    m_stats.add_tracks_analyzed(1);
 
-    return new MuslyTrack(track);
+    return track;
+}
+
+musly_jukebox* MuslyJukebox::analyzer()
+{
+    if (m_analyzer == nullptr) {
+        m_analyzer = musly_jukebox_poweron(method(), decoder());
+        if (m_analyzer == nullptr) {
+            throw musly_error("failed to initialize musly jukebox for analysis");
+        }
+    }
+
+    return m_analyzer;
+}
+
+std::vector<MuslyJukebox::analysis_result_t> MuslyJukebox::analyze_files(const std::vector<std::string>& filenames, int length, int start, unsigned int threads)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_ANALYZE_FILES);
+    std::vector<musly_track*> tracks(filenames.size(), nullptr);
+    std::vector<std::string> errors(filenames.size());
+
+    {
+        py::gil_scoped_release release;
+
+        const std::shared_ptr<const AnalysisCache> cache = shared_analysis_cache();
+
+        // libmusly keeps analysis state inside the jukebox, so every worker gets its own instance
+        ThreadPool pool(std::min<std::size_t>(threads > 0 ? threads : ThreadPool::hardware_threads(), std::max<std::size_t>(filenames.size(), 1)));
+        std::vector<jukebox_ptr> analyzers(pool.size());
+        for (jukebox_ptr& analyzer : analyzers) {
+            analyzer.reset(musly_jukebox_poweron(method(), decoder()));
+            if (!analyzer) {
+                throw musly_error("failed to initialize musly jukebox for analysis");
+            }
+        }
+
+        pool.parallel_for(filenames.size(), [&](unsigned int slot, std::size_t i) {
+            musly_jukebox* analyzer = analyzers[slot].get();
+            musly_track* track = musly_track_alloc(analyzer);
+            if (track == nullptr) {
+                errors[i] = "could not allocate track";
+                return;
+            }
+
+            int ret;
+            {
+                JukeboxStats::Timer analysis_timer(m_stats, JukeboxStats::OP_MUSLY_ANALYSIS);
+                ret = cache ? cache->analyze_audiofile(analyzer, filenames[i].c_str(), length, start, track)
+                            : musly_track_analyze_audiofile(analyzer, filenames[i].c_str(), length, start, track);
+            }
+            if (ret != 0) {
+                musly_track_free(track);
+                errors[i] = "could not load track from audio file: " + filenames[i];
+                return;
+            }
+
+            tracks[i] = track;
+            m_stats.add_tracks_analyzed(1);
+        });
+    }
+
+    std::vector<analysis_result_t> results;
+    results.reserve(filenames.size());
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        if (tracks[i] != nullptr) {
+            results.emplace_back(new MuslyTrack(tracks[i]), std::nullopt);
+        } else {
+            results.emplace_back(nullptr, errors[i]);
+        }
+    }
+
+    return results;
 }
 
 std::vector<musly_trackid> MuslyJukebox::add_tracks(const std::vector<MuslyTrack*>& tracks)
 {
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_ADD_TRACKS);
+
     std::vector<musly_track*> musly_tracks(tracks.size());
     std::transform(tracks.begin(), tracks.end(), musly_tracks.begin(), [](MuslyTrack* track) { return track->data(); });
 
-    std::vector<musly_trackid> track_ids(tracks.size());
-    int ret = musly_jukebox_addtracks(m_jukebox, const_cast<musly_track**>(musly_tracks.data()),
-        const_cast<musly_trackid*>(track_ids.data()), tracks.size(), 1);
-    if (ret < 0) {
-        throw musly_error("failure while adding tracks to jukebox. "
-                          "maybe set_style has not been called?");
-    }
-
-    return track_ids;
+    py::gil_scoped_release release;
+    return insert_tracks(musly_tracks, std::vector<musly_trackid>(tracks.size()), true);
 }
 
 std::vector<musly_trackid> MuslyJukebox::add_tracks(const std::vector<std::pair<musly_trackid, MuslyTrack*>>& track_tuples)
 {
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_ADD_TRACKS);
+
     std::vector<musly_trackid> track_ids(track_tuples.size());
     std::transform(
         track_tuples.begin(),
@@ -153,115 +690,1192 @@ std::vector<musly_trackid> MuslyJukebox::add_tracks(const std::vector<std::pair<
         musly_tracks.begin(),
         [](auto pair) { return pair.second->data(); });
 
-    int ret = musly_jukebox_addtracks(m_jukebox, const_cast<musly_track**>(musly_tracks.data()),
-        const_cast<musly_trackid*>(track_ids.data()), track_tuples.size(), 0);
+    py::gil_scoped_release release;
+    return insert_tracks(musly_tracks, std::move(track_ids), false);
+}
+
+std::vector<musly_trackid> MuslyJukebox::insert_tracks(const std::vector<musly_track*>& tracks, std::vector<musly_trackid> track_ids,
+    bool generate_ids, const std::function<bool(musly_trackid)>& keep_data)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    int ret = musly_jukebox_addtracks(m_jukebox, const_cast<musly_track**>(tracks.data()),
+        track_ids.data(), tracks.size(), generate_ids ? 1 : 0);
     if (ret < 0) {
         throw musly_error("failure while adding tracks to jukebox. "
                           "maybe set_style has not been called?");
     }
+    update_replicas([&](musly_jukebox* replica) {
+        return musly_jukebox_addtracks(replica, const_cast<musly_track**>(tracks.data()), track_ids.data(), tracks.size(), 0) >= 0;
+    });
+
+    for (std::size_t i = 0; i < tracks.size(); ++i) {
+        if (!keep_data || keep_data(track_ids[i])) {
+            m_track_store->put(track_ids[i], tracks[i]);
+        }
+        m_journal_added.insert(track_ids[i]);
+    }
+
+    // no query runs while the lock is held exclusively, so the graph can use the jukebox itself
+    if (m_graph_index) {
+        for (std::size_t i = 0; i < tracks.size(); ++i) {
+            if (m_track_store->contains(track_ids[i])) {
+                m_graph_index->insert(track_ids[i], graph_distances(m_jukebox, tracks[i], track_ids[i]));
+            }
+        }
+    }
 
     return track_ids;
 }
 
 void MuslyJukebox::remove_tracks(const std::vector<musly_trackid>& track_ids)
 {
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_REMOVE_TRACKS);
+
+    py::gil_scoped_release release;
+    erase_tracks(track_ids);
+}
+
+void MuslyJukebox::erase_tracks(const std::vector<musly_trackid>& track_ids)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
     if (musly_jukebox_removetracks(m_jukebox, const_cast<musly_trackid*>(track_ids.data()), track_ids.size()) < 0) {
         throw musly_error("failure while removing tracks from jukebox");
     }
+    update_replicas([&](musly_jukebox* replica) {
+        return musly_jukebox_removetracks(replica, const_cast<musly_trackid*>(track_ids.data()), track_ids.size()) >= 0;
+    });
+
+    for (musly_trackid track_id : track_ids) {
+        m_track_store->remove(track_id);
+        if (m_graph_index) {
+            m_graph_index->remove(track_id);
+        }
+
+        // tracks added since the last save leave no trace, all others need a tombstone
+        if (m_journal_added.erase(track_id) == 0) {
+            m_journal_removed.insert(track_id);
+        }
+    }
 }
 
-void MuslyJukebox::set_style(const std::vector<MuslyTrack*>& tracks)
+bool MuslyJukebox::copy_track(musly_trackid track_id, std::vector<musly_track>& track) const
 {
-    std::vector<musly_track*> musly_tracks(tracks.size());
-    std::transform(tracks.begin(), tracks.end(), musly_tracks.begin(), [](MuslyTrack* track) { return track->data(); });
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
 
-    int ret = musly_jukebox_setmusicstyle(m_jukebox, const_cast<musly_track**>(musly_tracks.data()), tracks.size());
-    if (ret < 0) {
-        throw musly_error("failure while setting style of jukebox");
-    }
+    track.resize(m_track_store->track_floats());
+    return m_track_store->read(track_id, track.data());
 }
 
-std::vector<float> MuslyJukebox::compute_similarity(track_tuple_t seed, const std::vector<track_tuple_t>& track_tuples)
-{
-    std::vector<musly_trackid> track_ids(track_tuples.size());
-    std::transform(track_tuples.begin(), track_tuples.end(), track_ids.begin(), [](auto pair) { return pair.first; });
+/**
+ * Exclusive use of a copy of the jukebox state for the lifetime of the lease.
+ *
+ * Must only be created while holding the jukebox lock.
+ */
+class MuslyJukebox::ReplicaLease {
+public:
+    explicit ReplicaLease(MuslyJukebox& owner)
+        : m_owner(owner)
+        , m_replica(owner.acquire_replica())
+    {
+        // empty
+    }
 
-    std::vector<musly_track*> musly_tracks(track_tuples.size());
-    std::transform(track_tuples.begin(), track_tuples.end(), musly_tracks.begin(), [](auto pair) { return pair.second->data(); });
+    ~ReplicaLease()
+    {
+        m_owner.release_replica(m_replica);
+    }
 
-    std::vector<float> similarities(track_tuples.size(), 0.0F);
-    int ret = musly_jukebox_similarity(
-        m_jukebox, seed.second->data(), seed.first, const_cast<musly_track**>(musly_tracks.data()),
-        const_cast<musly_trackid*>(track_ids.data()), track_tuples.size(), similarities.data());
-    if (ret < 0) {
-        throw musly_error("failure while computing track similarity");
+    musly_jukebox* get() const
+    {
+        return m_replica;
     }
 
-    return similarities;
+private:
+    ReplicaLease(const ReplicaLease&) = delete;
+
+    ReplicaLease& operator=(const ReplicaLease&) = delete;
+
+    MuslyJukebox& m_owner;
+    musly_jukebox* m_replica;
+};
+
+musly_jukebox* MuslyJukebox::acquire_replica()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_replica_mutex);
+        if (!m_replicas.empty()) {
+            musly_jukebox* replica = m_replicas.back();
+            m_replicas.pop_back();
+            return replica;
+        }
+    }
+
+    // only reads the jukebox state, which cannot change while the caller holds the jukebox lock
+    return clone_jukebox(m_jukebox).release();
 }
 
-py::bytes MuslyJukebox::serialize_track(MuslyTrack* track)
+void MuslyJukebox::release_replica(musly_jukebox* replica)
 {
-    if (track == nullptr) {
-        throw musly_error("track must not be none");
+    std::lock_guard<std::mutex> lock(m_replica_mutex);
+    m_replicas.push_back(replica);
+}
+
+void MuslyJukebox::clear_replicas()
+{
+    std::lock_guard<std::mutex> lock(m_replica_mutex);
+    for (musly_jukebox* replica : m_replicas) {
+        musly_jukebox_poweroff(replica);
     }
+    m_replicas.clear();
 
-    char* bytes = new char[track_size()];
-    int err = musly_track_tobin(m_jukebox, track->data(), reinterpret_cast<unsigned char*>(bytes));
-    if (err < 0) {
-        delete[] bytes;
-        throw musly_error("failed to convert track to bytearray");
+    drop_timbre_index();
+}
+
+void MuslyJukebox::update_replicas(const std::function<bool(musly_jukebox*)>& update)
+{
+    // copies are only in use while the lock is held, so writers see all of them in the pool
+    std::lock_guard<std::mutex> lock(m_replica_mutex);
+    auto failed = std::remove_if(m_replicas.begin(), m_replicas.end(), [&](musly_jukebox* replica) {
+        if (update(replica)) {
+            return false;
+        }
+        musly_jukebox_poweroff(replica);
+        return true;
+    });
+    m_replicas.erase(failed, m_replicas.end());
+
+    drop_timbre_index();
+}
+
+void MuslyJukebox::drop_timbre_index()
+{
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    m_timbre_index.reset();
+}
+
+bool MuslyJukebox::vectorized_prefilter() const
+{
+    return m_vectorized_prefilter;
+}
+
+void MuslyJukebox::set_vectorized_prefilter(bool enabled)
+{
+    if (enabled && TimbreIndex::dimension_for(method(), m_track_store->track_size()) == 0) {
+        throw musly_error(std::string("the vectorized prefilter does not support the method '") + method() + "'");
     }
 
-    return py::bytes(bytes, track_size());
+    m_vectorized_prefilter = enabled;
 }
 
-MuslyTrack* MuslyJukebox::deserialize_track(py::bytes bytes)
+std::shared_ptr<const TimbreIndex> MuslyJukebox::timbre_index()
 {
-    musly_track* track = musly_track_alloc(m_jukebox);
-    if (track == nullptr) {
-        throw musly_error("could not allocate track");
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    if (!m_timbre_index) {
+        m_timbre_index.reset(new TimbreIndex(TimbreIndex::dimension_for(method(), m_track_store->track_size()), *m_track_store));
     }
 
-    int ret = musly_track_frombin(m_jukebox, reinterpret_cast<unsigned char*>(PyBytes_AsString(bytes.ptr())), track);
-    if (ret < 0) {
-        throw musly_error("failed to convert bytearray to track");
+    return m_timbre_index;
+}
+
+int MuslyJukebox::graph_search_ef() const
+{
+    return m_graph_search_ef;
+}
+
+void MuslyJukebox::set_graph_search_ef(int ef)
+{
+    if (ef <= 0) {
+        throw musly_error("graph_search_ef must be positive");
     }
 
-    return new MuslyTrack(track);
+    m_graph_search_ef = ef;
 }
 
-void MuslyJukebox::serialize(BytesIO& out_stream)
+bool MuslyJukebox::has_graph_index() const
 {
-    const int tracks_per_chunk = 100;
-    const uint8_t int_size = sizeof(int);
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_graph_index != nullptr;
+}
 
-    // write current musly_version, sizeof(int) and known int value for
-    // compatibility checks when deserializing the file at a later point in time
-    out_stream.write_line(musly_version(), '\0');
-    out_stream.write(&int_size, 1);
-    out_stream.write(&_ENDIAN_MAGIC_NUMBER, int_size);
-    out_stream.write_line(method(), '\0');
-    out_stream.write_line(decoder(), '\0');
+void MuslyJukebox::build_graph_index(int max_neighbors, int ef_construction, unsigned int threads)
+{
+    if (max_neighbors < 2 || ef_construction <= 0) {
+        throw musly_error("max_neighbors must be at least 2 and ef_construction must be positive");
+    }
 
-    const int header_size = musly_jukebox_binsize(m_jukebox, 1, 0);
-    if (header_size < 0) {
-        throw musly_error("could not get jukebox header size");
+    py::gil_scoped_release release;
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    std::vector<musly_trackid> track_ids = m_track_store->track_ids();
+    std::sort(track_ids.begin(), track_ids.end());
+
+    ThreadPool pool(std::min<std::size_t>(threads > 0 ? threads : ThreadPool::hardware_threads(), std::max<std::size_t>(track_ids.size(), 1)));
+    std::vector<std::unique_ptr<ReplicaLease>> replicas(pool.size());
+    std::vector<std::vector<musly_track>> seeds(pool.size(), std::vector<musly_track>(m_track_store->track_floats()));
+    for (std::size_t slot = 0; slot < replicas.size(); ++slot) {
+        replicas[slot].reset(new ReplicaLease(*this));
     }
-    out_stream.write(&header_size, int_size);
 
-    const int buffer_length = std::max(header_size, tracks_per_chunk * track_size());
-    std::unique_ptr<unsigned char> buffer(new unsigned char[buffer_length]);
+    std::unique_ptr<NeighborGraph> graph(new NeighborGraph(max_neighbors, ef_construction));
+    graph->build(track_ids, pool, [&](unsigned int slot, musly_trackid track_id) {
+        return graph_distances(replicas[slot]->get(), m_track_store->get(track_id, seeds[slot].data()), track_id);
+    });
+    m_graph_index = std::move(graph);
 
-    if (musly_jukebox_tobin(m_jukebox, buffer.get(), 1, 0, 0) < 0) {
-        throw musly_error("could not serialize jukebox header");
+    // the graph is saved along with the jukebox, so the next save has to rewrite the file
+    std::lock_guard<std::mutex> journal_lock(m_journal_mutex);
+    reset_journal("", 0);
+}
+
+void MuslyJukebox::drop_graph_index()
+{
+    py::gil_scoped_release release;
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (!m_graph_index) {
+        return;
     }
-    out_stream.write(buffer.get(), header_size);
+    m_graph_index.reset();
 
-    // write jukebox header together with its size in bytes
-    const int total_tracks_to_write = track_count();
+    std::lock_guard<std::mutex> journal_lock(m_journal_mutex);
+    reset_journal("", 0);
+}
+
+NeighborGraph::distances_t MuslyJukebox::graph_distances(musly_jukebox* jukebox, musly_track* seed, musly_trackid seed_id)
+{
+    return [this, jukebox, seed, seed_id](const musly_trackid* track_ids, std::size_t count, float* out) {
+        std::vector<musly_trackid> stored;
+        stored.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (m_track_store->contains(track_ids[i])) {
+                stored.push_back(track_ids[i]);
+            }
+        }
+
+        std::vector<float> similarities(stored.size());
+        stored_similarity(jukebox, *m_track_store, seed, seed_id, stored.data(), stored.size(), similarities.data());
+
+        for (std::size_t i = 0, j = 0; i < count; ++i) {
+            if (j < stored.size() && stored[j] == track_ids[i]) {
+                out[i] = std::isfinite(similarities[j]) ? similarities[j] : std::numeric_limits<float>::infinity();
+                ++j;
+            } else {
+                out[i] = std::numeric_limits<float>::infinity();
+            }
+        }
+    };
+}
+
+std::string MuslyJukebox::track_storage() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return TrackCodec::encoding_name(m_track_store->codec()->encoding());
+}
+
+void MuslyJukebox::set_track_storage(const std::string& encoding)
+{
+    const TrackCodec::encoding_t target = TrackCodec::parse_encoding(encoding);
+
+    py::gil_scoped_release release;
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (m_track_store->codec()->encoding() == target) {
+        return;
+    }
+
+    std::unique_ptr<TrackStore> store = encode_tracks(*m_track_store, create_codec(*m_track_store, target));
+    drop_timbre_index();
+    m_track_store = std::move(store);
+
+    // the file stores tracks in the previous encoding, so the next save has to rewrite it
+    std::lock_guard<std::mutex> journal_lock(m_journal_mutex);
+    reset_journal("", 0);
+}
+
+py::dict MuslyJukebox::evaluate_track_storage(const std::string& encoding, int k, int samples)
+{
+    const TrackCodec::encoding_t target = TrackCodec::parse_encoding(encoding);
+    if (k <= 0 || samples <= 0) {
+        throw musly_error("k and samples must be positive");
+    }
+
+    double recall = 0.0;
+    double absolute_error = 0.0;
+    std::size_t bytes_per_track;
+    {
+        py::gil_scoped_release release;
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (m_track_store->compact()) {
+            throw musly_error("track storage can only be evaluated while tracks are stored as float32");
+        }
+
+        std::unique_ptr<TrackStore> encoded = encode_tracks(*m_track_store, create_codec(*m_track_store, target));
+        bytes_per_track = encoded->record_size();
+
+        std::vector<musly_trackid> track_ids = m_track_store->track_ids();
+        std::sort(track_ids.begin(), track_ids.end());
+        const std::size_t n = track_ids.size();
+        const std::size_t seeds = std::min<std::size_t>(samples, n);
+        const std::size_t count = std::min<std::size_t>(k, n > 0 ? n - 1 : 0);
+
+        // positions of the `count` tracks most similar to the seed at position `seed`
+        const auto nearest = [&](const std::vector<float>& similarities, std::size_t seed) {
+            std::vector<std::size_t> order;
+            order.reserve(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                if (i != seed) {
+                    order.push_back(i);
+                }
+            }
+            std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](std::size_t a, std::size_t b) {
+                return similarities[a] < similarities[b] || (similarities[a] == similarities[b] && a < b);
+            });
+            order.resize(count);
+            std::sort(order.begin(), order.end());
+            return order;
+        };
+
+        ReplicaLease replica(*this);
+        std::vector<float> exact(n);
+        std::vector<float> approximate(n);
+        std::vector<musly_track> seed_buffer(m_track_store->track_floats());
+        std::size_t compared = 0;
+        for (std::size_t s = 0; s < seeds && count > 0; ++s) {
+            const std::size_t seed = s * n / seeds;
+            const musly_trackid seed_id = track_ids[seed];
+            stored_similarity(replica.get(), *m_track_store, m_track_store->get(seed_id, nullptr), seed_id, track_ids.data(), n, exact.data());
+            stored_similarity(replica.get(), *encoded, encoded->get(seed_id, seed_buffer.data()), seed_id, track_ids.data(), n, approximate.data());
+
+            const std::vector<std::size_t> expected = nearest(exact, seed);
+            const std::vector<std::size_t> found = nearest(approximate, seed);
+            std::vector<std::size_t> common;
+            std::set_intersection(expected.begin(), expected.end(), found.begin(), found.end(), std::back_inserter(common));
+            recall += static_cast<double>(common.size()) / count;
+
+            for (std::size_t i = 0; i < n; ++i) {
+                if (i != seed && std::isfinite(exact[i]) && std::isfinite(approximate[i])) {
+                    absolute_error += std::fabs(static_cast<double>(exact[i]) - approximate[i]);
+                    ++compared;
+                }
+            }
+        }
+
+        recall = count > 0 && seeds > 0 ? recall / seeds : 1.0;
+        absolute_error = compared > 0 ? absolute_error / compared : 0.0;
+    }
+
+    py::dict result;
+    result["recall"] = recall;
+    result["mean_absolute_error"] = absolute_error;
+    result["bytes_per_track"] = bytes_per_track;
+    return result;
+}
+
+void MuslyJukebox::stored_similarity(musly_jukebox* replica, const TrackStore& store, musly_track* seed, musly_trackid seed_id,
+    const musly_trackid* track_ids, std::size_t count, float* out)
+{
+    const std::size_t floats = store.track_floats();
+    const std::size_t tile_size = std::min(count, _STORED_TRACK_TILE);
+    std::vector<musly_track*> tracks(tile_size);
+    std::vector<musly_track> decoded(store.compact() ? tile_size * floats : 0);
+
+    for (std::size_t begin = 0; begin < count; begin += tile_size) {
+        const std::size_t tile = std::min(tile_size, count - begin);
+        for (std::size_t i = 0; i < tile; ++i) {
+            tracks[i] = store.get(track_ids[begin + i], decoded.empty() ? nullptr : decoded.data() + i * floats);
+            if (tracks[i] == nullptr) {
+                throw musly_error("no track data registered for track " + std::to_string(track_ids[begin + i]));
+            }
+        }
+
+        JukeboxStats::Timer similarity_timer(m_stats, JukeboxStats::OP_MUSLY_SIMILARITY_BATCH);
+        if (musly_jukebox_similarity(replica, seed, seed_id, tracks.data(), const_cast<musly_trackid*>(track_ids + begin), tile, out + begin) < 0) {
+            throw musly_error("failure while computing track similarity");
+        }
+    }
+}
+
+void MuslyJukebox::set_style(const std::vector<MuslyTrack*>& tracks)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_SET_STYLE);
+
+    std::vector<musly_track*> musly_tracks(tracks.size());
+    std::transform(tracks.begin(), tracks.end(), musly_tracks.begin(), [](MuslyTrack* track) { return track->data(); });
+
+    py::gil_scoped_release release;
+    apply_style(musly_tracks);
+}
+
+void MuslyJukebox::apply_style(const std::vector<musly_track*>& tracks)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    clear_replicas();
+    int ret = musly_jukebox_setmusicstyle(m_jukebox, const_cast<musly_track**>(tracks.data()), tracks.size());
+    if (ret < 0) {
+        throw musly_error("failure while setting style of jukebox");
+    }
+
+    // a new style changes every similarity the graph was built from
+    m_graph_index.reset();
+
+    // a new style changes every track, so the next save has to rewrite the file
+    std::lock_guard<std::mutex> journal_lock(m_journal_mutex);
+    reset_journal("", 0);
+}
+
+std::vector<float> MuslyJukebox::compute_similarity(track_tuple_t seed, const std::vector<track_tuple_t>& track_tuples)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_COMPUTE_SIMILARITY);
+
+    std::vector<musly_trackid> track_ids(track_tuples.size());
+    std::transform(track_tuples.begin(), track_tuples.end(), track_ids.begin(), [](auto pair) { return pair.first; });
+
+    std::vector<musly_track*> musly_tracks(track_tuples.size());
+    std::transform(track_tuples.begin(), track_tuples.end(), musly_tracks.begin(), [](auto pair) { return pair.second->data(); });
+
+    std::vector<float> similarities(track_tuples.size(), 0.0F);
+    m_stats.record_buffer(track_tuples.size() * (sizeof(float) + sizeof(musly_trackid) + sizeof(musly_track*)));
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    ReplicaLease replica(*this);
+    JukeboxStats::Timer similarity_timer(m_stats, JukeboxStats::OP_MUSLY_SIMILARITY_BATCH);
+    int ret = musly_jukebox_similarity(
+        replica.get(), seed.second->data(), seed.first, const_cast<musly_track**>(musly_tracks.data()),
+        const_cast<musly_trackid*>(track_ids.data()), track_tuples.size(), similarities.data());
+    if (ret < 0) {
+        throw musly_error("failure while computing track similarity");
+    }
+
+    return similarities;
+}
+
+std::vector<float> MuslyJukebox::compute_similarity(musly_trackid seed_id, const std::vector<musly_trackid>& track_ids)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_COMPUTE_SIMILARITY);
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    std::vector<musly_track> seed_buffer(m_track_store->track_floats());
+    musly_track* seed = m_track_store->get(seed_id, seed_buffer.data());
+    if (seed == nullptr) {
+        throw musly_error("no track data registered for seed track " + std::to_string(seed_id));
+    }
+
+    for (musly_trackid track_id : track_ids) {
+        if (!m_track_store->contains(track_id)) {
+            throw musly_error("no track data registered for track " + std::to_string(track_id));
+        }
+    }
+
+    std::vector<float> similarities(track_ids.size(), 0.0F);
+    m_stats.record_buffer(track_ids.size() * sizeof(float));
+    ReplicaLease replica(*this);
+    stored_similarity(replica.get(), *m_track_store, seed, seed_id, track_ids.data(), track_ids.size(), similarities.data());
+
+    return similarities;
+}
+
+py::array_t<float> MuslyJukebox::compute_similarity_array(track_tuple_t seed, const std::vector<track_tuple_t>& track_tuples)
+{
+    return to_ndarray(compute_similarity(seed, track_tuples));
+}
+
+std::vector<MuslyJukebox::neighbor_t> MuslyJukebox::nearest(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_NEAREST);
+    py::gil_scoped_release release;
+    return find_nearest(seed_id, nullptr, k, candidate_ids ? &*candidate_ids : nullptr);
+}
+
+py::object MuslyJukebox::nearest_async(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids)
+{
+    return AsyncCall::start(py::cast(this), [this, seed_id, k, candidate_ids]() -> AsyncCall::finisher_t {
+        JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_NEAREST);
+        std::vector<neighbor_t> neighbors = find_nearest(seed_id, nullptr, k, candidate_ids ? &*candidate_ids : nullptr);
+
+        return [neighbors = std::move(neighbors)] { return py::cast(neighbors); };
+    });
+}
+
+std::vector<MuslyJukebox::neighbor_t> MuslyJukebox::find_nearest(musly_trackid seed_id, const musly_track* seed_track, int k, const std::vector<musly_trackid>* candidate_ids)
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return search_nearest(seed_id, seed_track, k, candidate_ids);
+}
+
+std::vector<MuslyJukebox::neighbor_t> MuslyJukebox::search_nearest(musly_trackid seed_id, const musly_track* seed_track, int k, const std::vector<musly_trackid>* candidate_ids)
+{
+    std::vector<musly_track> seed_buffer(seed_track != nullptr ? 0 : m_track_store->track_floats());
+    musly_track* seed = const_cast<musly_track*>(seed_track != nullptr ? seed_track : m_track_store->get(seed_id, seed_buffer.data()));
+    if (seed == nullptr) {
+        throw musly_error("no track data registered for seed track " + std::to_string(seed_id));
+    }
+    if (k <= 0) {
+        return {};
+    }
+
+    ReplicaLease replica(*this);
+
+    // the graph covers all stored tracks, queries restricted to candidates scan them instead
+    if (m_graph_index && candidate_ids == nullptr) {
+        const std::size_t ef = m_graph_search_ef;
+        std::vector<neighbor_t> neighbors = m_graph_index->search(graph_distances(replica.get(), seed, seed_id), k + 1, ef);
+        neighbors.erase(std::remove_if(neighbors.begin(), neighbors.end(), [seed_id](const neighbor_t& neighbor) { return neighbor.first == seed_id; }),
+            neighbors.end());
+        std::sort(neighbors.begin(), neighbors.end(), [](const neighbor_t& a, const neighbor_t& b) {
+            return a.second < b.second || (a.second == b.second && a.first < b.first);
+        });
+        neighbors.resize(std::min<std::size_t>(k, neighbors.size()));
+
+        return neighbors;
+    }
+
+    std::vector<musly_trackid> candidates = candidate_ids ? *candidate_ids : m_track_store->track_ids();
+
+    // use musly's neighbor guessing as prefilter for large candidate sets, but fall back
+    // to an exhaustive scan in case the method cannot provide enough neighbors. Guesses are
+    // restricted to the candidates, unless all registered tracks are candidates anyway.
+    const int guess_count = std::max(k * _NEIGHBOR_GUESS_FACTOR, _MIN_NEIGHBOR_GUESSES);
+    if (candidates.size() > static_cast<std::size_t>(guess_count) && m_vectorized_prefilter) {
+        const std::shared_ptr<const TimbreIndex> index = timbre_index();
+        std::vector<TimbreIndex::candidate_t> closest;
+        if (candidate_ids != nullptr) {
+            const std::unordered_set<musly_trackid> accepted(candidates.begin(), candidates.end());
+            closest = index->closest(seed, guess_count, [&](musly_trackid track_id) { return accepted.count(track_id) > 0; });
+        } else {
+            closest = index->closest(seed, guess_count, [](musly_trackid) { return true; });
+        }
+
+        candidates.resize(closest.size());
+        std::transform(closest.begin(), closest.end(), candidates.begin(), [](const TimbreIndex::candidate_t& candidate) { return candidate.second; });
+    } else if (candidates.size() > static_cast<std::size_t>(guess_count)) {
+        const bool filtered = candidate_ids != nullptr || candidates.size() != static_cast<std::size_t>(musly_jukebox_trackcount(replica.get()));
+        std::vector<musly_trackid> guesses(guess_count);
+        JukeboxStats::Timer guess_timer(m_stats, JukeboxStats::OP_MUSLY_SIMILARITY_BATCH);
+        const int found = filtered
+            ? musly_jukebox_guessneighbors_filtered(replica.get(), seed_id, guesses.data(), guess_count, candidates.data(), candidates.size())
+            : musly_jukebox_guessneighbors(replica.get(), seed_id, guesses.data(), guess_count);
+        if (found > k) {
+            guesses.resize(found);
+            candidates.swap(guesses);
+        }
+    }
+
+    std::vector<musly_trackid> track_ids;
+    track_ids.reserve(candidates.size());
+    for (musly_trackid track_id : candidates) {
+        if (track_id != seed_id && m_track_store->contains(track_id)) {
+            track_ids.push_back(track_id);
+        }
+    }
+
+    std::vector<float> similarities(track_ids.size(), 0.0F);
+    m_stats.record_buffer(track_ids.size() * (sizeof(float) + sizeof(musly_trackid)));
+    stored_similarity(replica.get(), *m_track_store, seed, seed_id, track_ids.data(), track_ids.size(), similarities.data());
+
+    std::vector<neighbor_t> neighbors(track_ids.size());
+    for (std::size_t i = 0; i < neighbors.size(); ++i) {
+        neighbors[i] = neighbor_t(track_ids[i], similarities[i]);
+    }
+
+    const std::size_t count = std::min<std::size_t>(k, neighbors.size());
+    std::partial_sort(neighbors.begin(), neighbors.begin() + count, neighbors.end(), [](const neighbor_t& a, const neighbor_t& b) {
+        return a.second < b.second || (a.second == b.second && a.first < b.first);
+    });
+    neighbors.resize(count);
+
+    return neighbors;
+}
+
+std::pair<py::array_t<musly_trackid>, py::array_t<float>> MuslyJukebox::nearest_array(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids)
+{
+    const std::vector<neighbor_t> neighbors = nearest(seed_id, k, candidate_ids);
+
+    std::vector<musly_trackid> track_ids(neighbors.size());
+    std::vector<float> similarities(neighbors.size());
+    for (std::size_t i = 0; i < neighbors.size(); ++i) {
+        track_ids[i] = neighbors[i].first;
+        similarities[i] = neighbors[i].second;
+    }
+
+    return std::make_pair(to_ndarray(std::move(track_ids)), to_ndarray(std::move(similarities)));
+}
+
+py::object MuslyJukebox::similarity_matrix(const std::optional<std::vector<musly_trackid>>& track_ids, unsigned int threads, const py::object& dtype, int top_k)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_SIMILARITY_MATRIX);
+
+    const py::dtype result_type = dtype.is_none() ? py::dtype::of<float>() : py::dtype::from_args(dtype);
+    if (result_type.kind() != 'f' || (result_type.itemsize() != sizeof(float) && result_type.itemsize() != sizeof(double))) {
+        throw musly_error("similarity matrix dtype must be float32 or float64");
+    }
+
+    std::vector<musly_trackid> ids;
+    std::vector<float> similarities;
+    std::vector<musly_trackid> neighbor_ids;
+    std::size_t columns;
+    {
+        py::gil_scoped_release release;
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+        ids = track_ids ? *track_ids : registered_track_ids();
+        const std::size_t n = ids.size();
+
+        // compact tracks are compared over and over again, so they are decoded only once
+        const std::size_t floats = m_track_store->track_floats();
+        std::vector<musly_track> decoded(m_track_store->compact() ? n * floats : 0);
+        std::vector<musly_track*> tracks(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            tracks[i] = m_track_store->get(ids[i], decoded.empty() ? nullptr : decoded.data() + i * floats);
+            if (tracks[i] == nullptr) {
+                throw musly_error("no track data registered for track " + std::to_string(ids[i]));
+            }
+        }
+
+        columns = top_k > 0 ? std::min<std::size_t>(top_k, n > 0 ? n - 1 : 0) : n;
+        similarities.resize(n * columns);
+        if (top_k > 0) {
+            neighbor_ids.resize(n * columns);
+        }
+        m_stats.record_buffer(similarities.size() * sizeof(float) + neighbor_ids.size() * sizeof(musly_trackid) + decoded.size() * sizeof(musly_track));
+
+        const std::size_t row_tiles = (n + _MATRIX_ROW_TILE - 1) / _MATRIX_ROW_TILE;
+        ThreadPool pool(std::min<std::size_t>(threads > 0 ? threads : ThreadPool::hardware_threads(), std::max<std::size_t>(row_tiles, 1)));
+        std::vector<std::unique_ptr<ReplicaLease>> replicas(pool.size());
+        std::vector<std::vector<float>> rows(pool.size());
+        for (std::size_t slot = 0; slot < replicas.size() && row_tiles > 0; ++slot) {
+            replicas[slot].reset(new ReplicaLease(*this));
+            if (top_k > 0) {
+                rows[slot].resize(_MATRIX_ROW_TILE * n);
+            }
+        }
+
+        pool.parallel_for(row_tiles, [&](unsigned int slot, std::size_t tile) {
+            const std::size_t row_begin = tile * _MATRIX_ROW_TILE;
+            const std::size_t row_end = std::min(row_begin + _MATRIX_ROW_TILE, n);
+
+            // in top-k mode, complete rows are collected before selecting the best columns
+            float* out = top_k > 0 ? rows[slot].data() : similarities.data() + row_begin * n;
+            for (std::size_t column = 0; column < n; column += _MATRIX_COLUMN_TILE) {
+                const std::size_t column_count = std::min(_MATRIX_COLUMN_TILE, n - column);
+                for (std::size_t row = row_begin; row < row_end; ++row) {
+                    JukeboxStats::Timer similarity_timer(m_stats, JukeboxStats::OP_MUSLY_SIMILARITY_BATCH);
+                    const int ret = musly_jukebox_similarity(replicas[slot]->get(), tracks[row], ids[row],
+                        tracks.data() + column, ids.data() + column, column_count, out + (row - row_begin) * n + column);
+                    if (ret < 0) {
+                        throw musly_error("failure while computing track similarity");
+                    }
+                }
+            }
+
+            if (top_k <= 0) {
+                return;
+            }
+
+            std::vector<std::size_t> order(n);
+            for (std::size_t row = row_begin; row < row_end; ++row) {
+                const float* row_similarities = out + (row - row_begin) * n;
+                order.clear();
+                for (std::size_t column = 0; column < n; ++column) {
+                    if (column != row) {
+                        order.push_back(column);
+                    }
+                }
+                std::partial_sort(order.begin(), order.begin() + columns, order.end(), [&](std::size_t a, std::size_t b) {
+                    return row_similarities[a] < row_similarities[b] || (row_similarities[a] == row_similarities[b] && a < b);
+                });
+                for (std::size_t i = 0; i < columns; ++i) {
+                    similarities[row * columns + i] = row_similarities[order[i]];
+                    neighbor_ids[row * columns + i] = ids[order[i]];
+                }
+            }
+        });
+    }
+
+    const std::vector<py::ssize_t> shape = { static_cast<py::ssize_t>(ids.size()), static_cast<py::ssize_t>(columns) };
+    py::object result = to_ndarray(std::move(similarities), shape);
+    if (result_type.itemsize() == sizeof(double)) {
+        result = result.attr("astype")(result_type);
+    }
+
+    if (top_k > 0) {
+        return py::make_tuple(to_ndarray(std::move(neighbor_ids), shape), result);
+    }
+    return result;
+}
+
+std::vector<musly_trackid> MuslyJukebox::generate_playlist(const std::vector<musly_trackid>& seed_ids, int length,
+    const std::optional<std::vector<musly_trackid>>& exclude_ids, const std::optional<id_array_t>& tag_track_ids,
+    const std::optional<tag_array_t>& tags, const std::optional<std::vector<int>>& tag_windows, int beam_width)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_GENERATE_PLAYLIST);
+
+    if (length < 0 || beam_width <= 0) {
+        throw musly_error("length must not be negative and beam_width must be positive");
+    }
+    if (tag_track_ids.has_value() != tags.has_value() || tags.has_value() != tag_windows.has_value()) {
+        throw musly_error("tag_track_ids, tags and tag_windows must be given together");
+    }
+
+    // the tags are copied while holding the GIL, so the buffers may change once the walk runs
+    PlaylistGenerator generator;
+    if (exclude_ids) {
+        generator.exclude(*exclude_ids);
+    }
+    if (tags) {
+        if (tag_track_ids->ndim() != 1 || (tags->ndim() != 1 && tags->ndim() != 2) || tags->shape(0) != tag_track_ids->shape(0)) {
+            throw musly_error("tags must have one row per track in tag_track_ids");
+        }
+        const std::size_t columns = tags->ndim() == 2 ? static_cast<std::size_t>(tags->shape(1)) : 1;
+        generator.set_tags(tag_track_ids->data(), tags->data(), static_cast<std::size_t>(tag_track_ids->shape(0)), columns, *tag_windows);
+    }
+
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return generator.generate(seed_ids, static_cast<std::size_t>(length), static_cast<std::size_t>(beam_width),
+        [this](musly_trackid track_id, std::size_t k) {
+            return search_nearest(track_id, nullptr, static_cast<int>(std::min<std::size_t>(k, std::numeric_limits<int>::max())), nullptr);
+        });
+}
+
+py::bytes MuslyJukebox::serialize_track(MuslyTrack* track)
+{
+    if (track == nullptr) {
+        throw musly_error("track must not be none");
+    }
+
+    // write straight into the buffer of a new bytes object
+    py::bytes bytes(nullptr, track_size());
+    int err = musly_track_tobin(m_jukebox, track->data(), reinterpret_cast<unsigned char*>(PyBytes_AsString(bytes.ptr())));
+    if (err < 0) {
+        throw musly_error("failed to convert track to bytearray");
+    }
+
+    return bytes;
+}
+
+MuslyTrack* MuslyJukebox::deserialize_track(py::bytes bytes)
+{
+    musly_track* track = musly_track_alloc(m_jukebox);
+    if (track == nullptr) {
+        throw musly_error("could not allocate track");
+    }
+
+    int ret = musly_track_frombin(m_jukebox, reinterpret_cast<unsigned char*>(PyBytes_AsString(bytes.ptr())), track);
+    if (ret < 0) {
+        musly_track_free(track);
+        throw musly_error("failed to convert bytearray to track");
+    }
+
+    return new MuslyTrack(track);
+}
+
+py::bytes MuslyJukebox::serialize_tracks(const std::vector<MuslyTrack*>& tracks)
+{
+    std::vector<musly_track*> musly_tracks(tracks.size());
+    for (std::size_t i = 0; i < tracks.size(); ++i) {
+        if (tracks[i] == nullptr) {
+            throw musly_error("track must not be none");
+        }
+        musly_tracks[i] = tracks[i]->data();
+    }
+
+    const std::size_t bin_size = track_size();
+    py::bytes bytes(nullptr, musly_tracks.size() * bin_size);
+    unsigned char* data = reinterpret_cast<unsigned char*>(PyBytes_AsString(bytes.ptr()));
+    {
+        py::gil_scoped_release release;
+
+        for (std::size_t i = 0; i < musly_tracks.size(); ++i) {
+            if (musly_track_tobin(m_jukebox, musly_tracks[i], data + i * bin_size) < 0) {
+                throw musly_error("failed to convert track to bytearray");
+            }
+        }
+    }
+
+    return bytes;
+}
+
+std::vector<MuslyTrack*> MuslyJukebox::deserialize_tracks(py::buffer buffer, std::optional<std::size_t> count)
+{
+    const py::buffer_info info = buffer.request();
+    if (info.ndim > 1 || (info.ndim == 1 && info.strides[0] != info.itemsize)) {
+        throw musly_error("buffer must be one-dimensional and contiguous");
+    }
+
+    const std::size_t bin_size = track_size();
+    const std::size_t size = info.size * info.itemsize;
+    const std::size_t track_count = count ? *count : size / bin_size;
+    if (track_count * bin_size > size || (!count && size % bin_size != 0)) {
+        throw musly_error("buffer size does not match the track size of the jukebox");
+    }
+
+    // all tracks share one allocation that is released together with the last of them
+    const std::size_t stride = (musly_track_size(m_jukebox) + sizeof(musly_track) - 1) / sizeof(musly_track);
+    std::shared_ptr<void> pool(new musly_track[std::max<std::size_t>(track_count * stride, 1)], std::default_delete<musly_track[]>());
+    musly_track* tracks = static_cast<musly_track*>(pool.get());
+    const unsigned char* data = static_cast<const unsigned char*>(info.ptr);
+    {
+        py::gil_scoped_release release;
+
+        for (std::size_t i = 0; i < track_count; ++i) {
+            if (musly_track_frombin(m_jukebox, const_cast<unsigned char*>(data + i * bin_size), tracks + i * stride) < 0) {
+                throw musly_error("failed to convert bytearray to track");
+            }
+        }
+    }
+
+    std::vector<MuslyTrack*> result;
+    result.reserve(track_count);
+    for (std::size_t i = 0; i < track_count; ++i) {
+        result.push_back(new MuslyTrack(tracks + i * stride, pool));
+    }
+
+    return result;
+}
+
+JukeboxSnapshot* MuslyJukebox::snapshot()
+{
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    // the copied track store shares all pages with this jukebox until they are written to
+    jukebox_ptr jukebox = clone_jukebox(m_jukebox);
+    std::unique_ptr<TrackStore> track_store(new TrackStore(*m_track_store));
+    std::shared_ptr<MuslyJukebox> state(new MuslyJukebox(jukebox.get(), std::move(track_store)));
+    jukebox.release();
+
+    // writers hold the lock exclusively, so the graph cannot change while it is copied
+    if (m_graph_index) {
+        state->m_graph_index.reset(new NeighborGraph(*m_graph_index));
+    }
+    state->m_graph_search_ef = m_graph_search_ef.load();
+    state->m_vectorized_prefilter = m_vectorized_prefilter.load();
+    {
+        // the index is never modified, only dropped, so the snapshot can share it
+        std::lock_guard<std::mutex> index_lock(m_index_mutex);
+        state->m_timbre_index = m_timbre_index;
+    }
+
+    return new JukeboxSnapshot(std::move(state));
+}
+
+void MuslyJukebox::serialize(BytesIO& out_stream)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_SERIALIZE);
+    std::shared_lock<std::shared_mutex> lock(m_mutex, std::defer_lock);
+    lock_without_gil(lock);
+
+    JukeboxStats::CountingStream<BytesIO> counted_stream(out_stream);
+    serialize_to(counted_stream);
+    counted_stream.add_to(m_stats);
+}
+
+void MuslyJukebox::save(const std::string& path, bool append)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_SERIALIZE);
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::lock_guard<std::mutex> journal_lock(m_journal_mutex);
+
+    if (!append) {
+        write_file(path);
+        return;
+    }
+
+    if (m_journal_path.empty() || m_journal_path != path) {
+        throw musly_error("cannot append to '" + path + "': the jukebox was not saved to or loaded from it since its style, track storage or graph index changed");
+    }
+
+    FileIO out_stream(path, "ab");
+    out_stream.seek(0, SEEK_END);
+    if (static_cast<std::uint64_t>(out_stream.tell()) != m_journal_size) {
+        throw musly_error("cannot append to '" + path + "': the file was modified since the jukebox was saved to or loaded from it");
+    }
+
+    std::uint64_t size;
+    try {
+        JukeboxStats::CountingStream<FileIO> counted_stream(out_stream);
+        append_segments(counted_stream);
+        counted_stream.add_to(m_stats);
+        size = out_stream.tell();
+        out_stream.close();
+    } catch (...) {
+        // cut off the partially written segments, so the file keeps its previous contents
+        try {
+            out_stream.close();
+        } catch (const musly_error&) {
+            // the write failed already
+        }
+        std::error_code error;
+        std::filesystem::resize_file(path, m_journal_size, error);
+        throw;
+    }
+
+    reset_journal(path, size);
+}
+
+void MuslyJukebox::compact(const std::string& path)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_SERIALIZE);
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::lock_guard<std::mutex> journal_lock(m_journal_mutex);
+
+    write_file(path);
+}
+
+void MuslyJukebox::write_file(const std::string& path)
+{
+    // write a complete new file next to the old one and replace it atomically, so the old file
+    // stays intact if writing fails
+    const std::string temp_path = temporary_path(path);
+    std::uint64_t size;
+    try {
+        FileIO out_stream(temp_path, "wb");
+        JukeboxStats::CountingStream<FileIO> counted_stream(out_stream);
+        serialize_to(counted_stream);
+        counted_stream.add_to(m_stats);
+        size = out_stream.tell();
+        out_stream.close();
+    } catch (...) {
+        std::error_code error;
+        std::filesystem::remove(temp_path, error);
+        throw;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        throw musly_error("could not replace jukebox file: " + path);
+    }
+
+    reset_journal(path, size);
+}
+
+void MuslyJukebox::reset_journal(const std::string& path, std::uint64_t size)
+{
+    m_journal_path = path;
+    m_journal_size = size;
+    m_journal_added.clear();
+    m_journal_removed.clear();
+}
+
+template <typename OutputStream>
+void MuslyJukebox::append_segments(OutputStream& out_stream)
+{
+    if (!m_journal_removed.empty()) {
+        std::vector<musly_trackid> track_ids(m_journal_removed.begin(), m_journal_removed.end());
+        std::sort(track_ids.begin(), track_ids.end());
+        const int count = static_cast<int>(track_ids.size());
+
+        write_segment_header(out_stream, _SEGMENT_REMOVE, count, track_ids.size() * sizeof(musly_trackid));
+        out_stream.write(track_ids.data(), track_ids.size() * sizeof(musly_trackid));
+    }
+
+    if (!m_journal_added.empty()) {
+        std::vector<musly_trackid> track_ids(m_journal_added.begin(), m_journal_added.end());
+        std::sort(track_ids.begin(), track_ids.end());
+        const int count = static_cast<int>(track_ids.size());
+
+        write_segment_header(out_stream, _SEGMENT_ADD, count, track_ids.size() * track_data_size());
+        write_track_data(out_stream, track_ids);
+    }
+
+    out_stream.flush();
+}
+
+template <typename OutputStream>
+void MuslyJukebox::write_track_data(OutputStream& out_stream, const std::vector<musly_trackid>& track_ids)
+{
+    // compact tracks keep their encoding, which restores the same records when read again
+    const TrackCodec* codec = m_track_store->compact() ? m_track_store->codec().get() : nullptr;
+    const std::size_t record_size = track_data_size() - sizeof(musly_trackid);
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[record_size]);
+    std::vector<musly_track> track(m_track_store->track_floats());
+    for (musly_trackid track_id : track_ids) {
+        if (!m_track_store->read(track_id, track.data()) || (codec == nullptr && musly_track_tobin(m_jukebox, track.data(), buffer.get()) < 0)) {
+            throw musly_error("failed to write data of track " + std::to_string(track_id));
+        }
+        if (codec != nullptr) {
+            codec->encode(track.data(), buffer.get());
+        }
+        out_stream.write(&track_id, sizeof(musly_trackid));
+        out_stream.write(buffer.get(), record_size);
+    }
+}
+
+std::uint64_t MuslyJukebox::track_data_size() const
+{
+    return sizeof(musly_trackid) + (m_track_store->compact() ? m_track_store->codec()->encoded_size() : static_cast<std::uint64_t>(track_size()));
+}
+
+template <typename InputStream>
+std::uint64_t MuslyJukebox::replay_segments(InputStream& in_stream, std::uint64_t remaining)
+{
+    while (replay_segment(in_stream, remaining)) {
+        // empty
+    }
+
+    return remaining;
+}
+
+template <typename InputStream>
+bool MuslyJukebox::replay_segment(InputStream& in_stream, std::uint64_t& remaining)
+{
+    // an incomplete segment can only be the last one, left behind by an interrupted append
+    if (remaining < _SEGMENT_HEADER_SIZE) {
+        return false;
+    }
+
+    char magic[sizeof(_SEGMENT_MAGIC)];
+    const Py_ssize_t magic_size = in_stream.read(magic, sizeof(magic));
+    if (magic_size <= 0) {
+        return false;
+    }
+
+    std::uint8_t kind = 0;
+    int count = -1;
+    std::uint64_t size = 0;
+    if (magic_size != sizeof(magic) || std::memcmp(magic, _SEGMENT_MAGIC, sizeof(magic)) != 0
+        || in_stream.read(&kind, 1) < 1 || in_stream.read(&count, sizeof(int)) < static_cast<Py_ssize_t>(sizeof(int))
+        || in_stream.read(&size, sizeof(size)) < static_cast<Py_ssize_t>(sizeof(size)) || count < 0) {
+        throw musly_error("failed loading jukebox: invalid segment");
+    }
+    if (size > remaining - _SEGMENT_HEADER_SIZE) {
+        return false;
+    }
+    remaining -= _SEGMENT_HEADER_SIZE + size;
+
+    const std::uint64_t expected_size = kind == _SEGMENT_REMOVE ? count * sizeof(musly_trackid)
+        : kind == _SEGMENT_ADD || kind == _SEGMENT_TRACK_DATA   ? count * track_data_size()
+        : kind == _SEGMENT_STORAGE                              ? sizeof(std::uint32_t) + count * sizeof(float)
+                                                                : size;
+    if (size != expected_size) {
+        throw musly_error("failed loading jukebox: invalid segment size");
+    }
+
+    if (kind == _SEGMENT_REMOVE) {
+        std::vector<musly_trackid> track_ids(count);
+        const Py_ssize_t ids_size = count * sizeof(musly_trackid);
+        if (in_stream.read(track_ids.data(), ids_size) < ids_size) {
+            throw musly_error("failed loading jukebox: truncated segment");
+        }
+        erase_tracks(track_ids);
+    } else if (kind == _SEGMENT_ADD) {
+        read_track_data(in_stream, count, [this](const std::vector<musly_trackid>& track_ids, const std::vector<musly_track*>& tracks) {
+            insert_tracks(tracks, track_ids, false);
+        });
+    } else if (kind == _SEGMENT_TRACK_DATA) {
+        // the tracks are registered with musly already, only their data is missing
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        drop_timbre_index();
+        read_track_data(in_stream, count, [this](const std::vector<musly_trackid>& track_ids, const std::vector<musly_track*>& tracks) {
+            for (std::size_t i = 0; i < tracks.size(); ++i) {
+                m_track_store->put(track_ids[i], tracks[i]);
+            }
+        });
+    } else if (kind == _SEGMENT_STORAGE) {
+        std::uint32_t encoding;
+        std::vector<float> parameters(count);
+        if (in_stream.read(&encoding, sizeof(encoding)) < static_cast<Py_ssize_t>(sizeof(encoding))
+            || in_stream.read(parameters.data(), count * sizeof(float)) < static_cast<Py_ssize_t>(count * sizeof(float))) {
+            throw musly_error("failed loading jukebox: truncated segment");
+        }
+
+        // the storage precedes all track data, so there are no tracks to convert yet
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (m_track_store->size() > 0) {
+            throw musly_error("failed loading jukebox: unexpected storage segment");
+        }
+        std::shared_ptr<const TrackCodec> codec = std::make_shared<const TrackCodec>(TrackCodec::restore(
+            static_cast<TrackCodec::encoding_t>(encoding), m_track_store->track_floats(), parameters));
+        drop_timbre_index();
+        m_track_store.reset(new TrackStore(m_track_store->track_size(), std::move(codec)));
+    } else if (kind == _SEGMENT_GRAPH) {
+        std::uint64_t graph_size = 0;
+        std::unique_ptr<NeighborGraph> graph = NeighborGraph::read([&](void* data, std::size_t bytes) {
+            graph_size += bytes;
+            return graph_size <= size && in_stream.read(data, bytes) == static_cast<Py_ssize_t>(bytes);
+        });
+        if (!graph || graph_size != size) {
+            throw musly_error("failed loading jukebox: invalid graph index");
+        }
+
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_graph_index = std::move(graph);
+    } else {
+        throw musly_error("failed loading jukebox: unknown segment kind " + std::to_string(kind));
+    }
+
+    return true;
+}
+
+template <typename InputStream>
+void MuslyJukebox::read_track_data(InputStream& in_stream, int count,
+    const std::function<void(const std::vector<musly_trackid>&, const std::vector<musly_track*>&)>& consume)
+{
+    const TrackCodec* codec = m_track_store->compact() ? m_track_store->codec().get() : nullptr;
+    const int bin_size = static_cast<int>(track_data_size() - sizeof(musly_trackid));
+    const std::size_t stride = (musly_track_size(m_jukebox) + sizeof(musly_track) - 1) / sizeof(musly_track);
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[bin_size]);
+    std::unique_ptr<musly_track[]> tracks(new musly_track[_SEGMENT_TRACKS_PER_CHUNK * stride]);
+    std::vector<musly_trackid> track_ids;
+    std::vector<musly_track*> musly_tracks;
+
+    for (int done = 0; done < count;) {
+        const int chunk = std::min(_SEGMENT_TRACKS_PER_CHUNK, count - done);
+        track_ids.resize(chunk);
+        musly_tracks.resize(chunk);
+        for (int i = 0; i < chunk; ++i) {
+            musly_tracks[i] = tracks.get() + i * stride;
+            if (in_stream.read(&track_ids[i], sizeof(musly_trackid)) < static_cast<Py_ssize_t>(sizeof(musly_trackid))
+                || in_stream.read(buffer.get(), bin_size) < bin_size) {
+                throw musly_error("failed loading jukebox: truncated segment");
+            }
+            if (codec != nullptr) {
+                codec->decode(buffer.get(), musly_tracks[i]);
+            } else if (musly_track_frombin(m_jukebox, buffer.get(), musly_tracks[i]) < 0) {
+                throw musly_error("failed loading jukebox: invalid track data in segment");
+            }
+        }
+
+        consume(track_ids, musly_tracks);
+        done += chunk;
+    }
+}
+
+template <typename OutputStream>
+void MuslyJukebox::serialize_to(OutputStream& out_stream)
+{
+    const int tracks_per_chunk = 100;
+    const uint8_t int_size = sizeof(int);
+
+    // write current musly_version, sizeof(int) and known int value for
+    // compatibility checks when deserializing the file at a later point in time
+    out_stream.write_line(musly_version(), '\0');
+    out_stream.write(&int_size, 1);
+    out_stream.write(&_ENDIAN_MAGIC_NUMBER, int_size);
+    out_stream.write_line(method(), '\0');
+    out_stream.write_line(decoder(), '\0');
+
+    const int header_size = musly_jukebox_binsize(m_jukebox, 1, 0);
+    if (header_size < 0) {
+        throw musly_error("could not get jukebox header size");
+    }
+    out_stream.write(&header_size, int_size);
+
+    const int buffer_length = std::max(header_size, tracks_per_chunk * track_size());
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[buffer_length]);
+    m_stats.record_buffer(buffer_length);
+
+    if (musly_jukebox_tobin(m_jukebox, buffer.get(), 1, 0, 0) < 0) {
+        throw musly_error("could not serialize jukebox header");
+    }
+    out_stream.write(buffer.get(), header_size);
+
+    // write jukebox header together with its size in bytes
+    const int total_tracks_to_write = musly_jukebox_trackcount(m_jukebox);
     int tracks_written = 0;
-    int bytes_written;
     while (tracks_written < total_tracks_to_write) {
         const int tracks_to_write = std::min(tracks_per_chunk, total_tracks_to_write - tracks_written);
         const int bytes_to_write = musly_jukebox_tobin(m_jukebox, buffer.get(), 0, tracks_to_write, tracks_written);
@@ -272,31 +1886,305 @@ void MuslyJukebox::serialize(BytesIO& out_stream)
         tracks_written += tracks_to_write;
     }
 
-    out_stream.flush();
+    if (m_track_store->compact()) {
+        const std::shared_ptr<const TrackCodec>& codec = m_track_store->codec();
+        const std::uint32_t encoding = codec->encoding();
+        const std::vector<float>& parameters = codec->parameters();
+        write_segment_header(out_stream, _SEGMENT_STORAGE, static_cast<int>(parameters.size()),
+            sizeof(encoding) + parameters.size() * sizeof(float));
+        out_stream.write(&encoding, sizeof(encoding));
+        out_stream.write(parameters.data(), parameters.size() * sizeof(float));
+    }
+
+    std::vector<musly_trackid> stored_ids = m_track_store->track_ids();
+    if (!stored_ids.empty()) {
+        std::sort(stored_ids.begin(), stored_ids.end());
+        const int count = static_cast<int>(stored_ids.size());
+        write_segment_header(out_stream, _SEGMENT_TRACK_DATA, count, stored_ids.size() * track_data_size());
+        write_track_data(out_stream, stored_ids);
+    }
+
+    if (m_graph_index) {
+        const int count = static_cast<int>(m_graph_index->size());
+        std::uint64_t size = 0;
+        m_graph_index->write([&](const void*, std::size_t bytes) { size += bytes; });
+        write_segment_header(out_stream, _SEGMENT_GRAPH, count, size);
+        m_graph_index->write([&](const void* data, std::size_t bytes) { out_stream.write(data, bytes); });
+    }
+
+    out_stream.flush();
+}
+
+MuslyJukebox* MuslyJukebox::create_from_stream(BytesIO& in_stream, bool ignore_decoder)
+{
+    const JukeboxStats::Stopwatch stopwatch;
+    JukeboxStats::CountingStream<BytesIO> counted_stream(in_stream);
+    std::unique_ptr<MuslyJukebox> jukebox(create_from(counted_stream, ignore_decoder));
+
+    // the stream may continue with other data, so only the segments written along with the
+    // jukebox are read and everything else is left to the caller
+    unsigned char header[sizeof(_SEGMENT_MAGIC) + 1];
+    std::uint64_t remaining = std::numeric_limits<std::uint64_t>::max();
+    while (in_stream.peek(header, sizeof(header)) == static_cast<Py_ssize_t>(sizeof(header))
+        && std::memcmp(header, _SEGMENT_MAGIC, sizeof(_SEGMENT_MAGIC)) == 0
+        && (header[sizeof(_SEGMENT_MAGIC)] == _SEGMENT_STORAGE || header[sizeof(_SEGMENT_MAGIC)] == _SEGMENT_TRACK_DATA
+            || header[sizeof(_SEGMENT_MAGIC)] == _SEGMENT_GRAPH)) {
+        jukebox->replay_segment(counted_stream, remaining);
+    }
+    in_stream.sync();
+
+    counted_stream.add_to(jukebox->m_stats);
+    jukebox->m_stats.record_call(JukeboxStats::OP_DESERIALIZE, stopwatch.elapsed_ns());
+
+    return jukebox.release();
+}
+
+MuslyJukebox* MuslyJukebox::load(const std::string& path, bool ignore_decoder)
+{
+    py::gil_scoped_release release;
+    return read_file(path, ignore_decoder);
+}
+
+py::object MuslyJukebox::load_async(const std::string& path, bool ignore_decoder)
+{
+    return AsyncCall::start(py::none(), [path, ignore_decoder]() -> AsyncCall::finisher_t {
+        MuslyJukebox* jukebox = read_file(path, ignore_decoder);
+        return [jukebox] { return py::cast(jukebox, py::return_value_policy::take_ownership); };
+    });
+}
+
+MuslyJukebox* MuslyJukebox::read_file(const std::string& path, bool ignore_decoder)
+{
+    const JukeboxStats::Stopwatch stopwatch;
+    FileIO in_stream(path, "rb");
+    JukeboxStats::CountingStream<FileIO> counted_stream(in_stream);
+    std::unique_ptr<MuslyJukebox> jukebox(create_from(counted_stream, ignore_decoder));
+
+    const Py_ssize_t position = in_stream.tell();
+    in_stream.seek(0, SEEK_END);
+    const std::uint64_t file_size = in_stream.tell();
+    in_stream.seek(position, SEEK_SET);
+
+    // appending continues behind the last complete segment
+    const std::uint64_t remaining = jukebox->replay_segments(counted_stream, file_size - position);
+    jukebox->reset_journal(path, file_size - remaining);
+
+    counted_stream.add_to(jukebox->m_stats);
+    jukebox->m_stats.record_call(JukeboxStats::OP_DESERIALIZE, stopwatch.elapsed_ns());
+
+    return jukebox.release();
+}
+
+template <typename InputStream>
+MuslyJukebox* MuslyJukebox::create_from(InputStream& in_stream, bool ignore_decoder)
+{
+    std::string version = in_stream.read_line('\0');
+    if (version.empty() || version != musly_version()) {
+        throw musly_error("failed loading jukebox: created with different musly version '" + version + "'");
+    }
+
+    uint8_t int_size = 0;
+    in_stream.read(&int_size, sizeof(uint8_t));
+    if (int_size != sizeof(int)) {
+        throw musly_error("failed loading jukebox: different architecture");
+    }
+
+    unsigned int byte_order = 0;
+    in_stream.read(&byte_order, int_size);
+    if (byte_order != _ENDIAN_MAGIC_NUMBER) {
+        throw musly_error("failed loading jukebox: invalid byte order");
+    }
+
+    const std::string decoders = musly_jukebox_listdecoders();
+    const std::string method = in_stream.read_line('\0');
+    std::string decoder = in_stream.read_line('\0');
+    if (decoder.empty() || decoders.find(decoder) == std::string::npos) {
+        if (!ignore_decoder) {
+            throw musly_error("failed loading jukebox: decoder '" + decoder + "' not available");
+        }
+        decoder = "";
+    }
+
+    std::unique_ptr<MuslyJukebox> jukebox(new MuslyJukebox(method.c_str(), decoder.empty() ? nullptr : decoder.c_str()));
+
+    int header_size;
+    if (in_stream.read(&header_size, int_size) < int_size) {
+        throw musly_error("failed loading jukebox: could not read header size");
+    }
+
+    std::unique_ptr<unsigned char[]> header(new unsigned char[header_size]);
+    in_stream.read(header.get(), header_size);
+    const int track_count = musly_jukebox_frombin(jukebox->m_jukebox, header.get(), 1, 0);
+
+    if (track_count < 0) {
+        throw musly_error("failed loading jukebox: invalid header");
+    }
+
+    const int track_size = musly_jukebox_binsize(jukebox->m_jukebox, 0, 1);
+    const int tracks_per_chunk = 100;
+    const int buffer_len = track_size * tracks_per_chunk;
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[buffer_len]);
+    jukebox->m_stats.record_buffer(std::max(header_size, buffer_len));
+
+    int tracks_read = 0;
+    while (tracks_read < track_count) {
+        const int tracks_to_read = std::min(tracks_per_chunk, track_count - tracks_read);
+        const int bytes_to_read = tracks_to_read * track_size;
+
+        if (in_stream.read(buffer.get(), bytes_to_read) < bytes_to_read) {
+            throw musly_error("failed loading jukebox: received less tracks than expected");
+        }
+        if (musly_jukebox_frombin(jukebox->m_jukebox, buffer.get(), 0, tracks_to_read) < 0) {
+            throw musly_error("failed loading jukebox: failed to load track information");
+        }
+
+        tracks_read += tracks_to_read;
+    }
+
+    return jukebox.release();
+}
+
+void MuslyJukebox::save_mapped(const std::string& path)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_SERIALIZE);
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    mapped_file_writer out(path);
+    write_mapped(out);
+}
+
+void MuslyJukebox::save_shared(const std::string& name)
+{
+    JukeboxStats::Timer timer(m_stats, JukeboxStats::OP_SERIALIZE);
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    mapped_memory_writer out(name);
+    write_mapped(out);
+}
+
+bool MuslyJukebox::remove_shared(const std::string& name)
+{
+    return SharedMemory::remove(name);
+}
+
+template <typename MappedWriter>
+void MuslyJukebox::write_mapped(MappedWriter& out)
+{
+    const std::vector<musly_trackid> ids = registered_track_ids();
+
+    // the magic is written last, so a partially written image is never accepted
+    mapped_header_t header;
+    std::memset(&header, 0, sizeof(header));
+    header.format_version = _MAPPED_FORMAT_VERSION;
+    header.int_size = sizeof(int);
+    header.byte_order = _ENDIAN_MAGIC_NUMBER;
+    write_fixed_string(header.musly_version, sizeof(header.musly_version), musly_version());
+    write_fixed_string(header.method, sizeof(header.method), method());
+    write_fixed_string(header.decoder, sizeof(header.decoder), decoder());
+
+    const int jukebox_header_size = musly_jukebox_binsize(m_jukebox, 1, 0);
+    const int jukebox_tracks_size = musly_jukebox_binsize(m_jukebox, 0, ids.size());
+    if (jukebox_header_size < 0 || jukebox_tracks_size < 0) {
+        throw musly_error("could not get jukebox size");
+    }
+    std::vector<unsigned char> jukebox_data(jukebox_header_size + jukebox_tracks_size);
+    if (musly_jukebox_tobin(m_jukebox, jukebox_data.data(), 1, 0, 0) < 0
+        || (!ids.empty() && musly_jukebox_tobin(m_jukebox, jukebox_data.data() + jukebox_header_size, 0, ids.size(), 0) < 0)) {
+        throw musly_error("could not serialize jukebox");
+    }
+
+    // records are written straight from the track store, so the index refers to the store's slots
+    const std::vector<TrackStore::index_entry_t> index = m_track_store->record_index();
+
+    header.jukebox_track_count = ids.size();
+    header.jukebox_header_offset = sizeof(header);
+    header.jukebox_header_size = jukebox_header_size;
+    header.jukebox_tracks_offset = header.jukebox_header_offset + header.jukebox_header_size;
+    header.jukebox_tracks_size = jukebox_tracks_size;
+    header.track_size = m_track_store->track_size();
+    header.record_stride = m_track_store->record_size();
+    header.record_count = m_track_store->record_count();
+    header.index_count = index.size();
+    header.index_offset = align_to(header.jukebox_tracks_offset + header.jukebox_tracks_size, sizeof(std::uint64_t));
+
+    const std::vector<float>& codec_parameters = m_track_store->codec()->parameters();
+    header.record_encoding = m_track_store->codec()->encoding();
+    header.codec_parameter_count = codec_parameters.size();
+    header.codec_parameters_offset = header.index_offset + index.size() * sizeof(TrackStore::index_entry_t);
+    header.records_offset = align_to(header.codec_parameters_offset + codec_parameters.size() * sizeof(float), _MAPPED_RECORD_ALIGNMENT);
+
+    out.reserve(header.records_offset + header.record_count * header.record_stride);
+
+    const char padding[_MAPPED_RECORD_ALIGNMENT] = { 0 };
+    const auto pad_to = [&](std::uint64_t offset) {
+        out.write(padding, offset - out.position());
+    };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(jukebox_data.data()), jukebox_data.size());
+    pad_to(header.index_offset);
+    out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(TrackStore::index_entry_t));
+    out.write(reinterpret_cast<const char*>(codec_parameters.data()), codec_parameters.size() * sizeof(float));
+    pad_to(header.records_offset);
+    m_track_store->write_records([&](const char* data, std::size_t size) { out.write(data, size); });
+
+    out.finish(_MAPPED_MAGIC, sizeof(_MAPPED_MAGIC));
+}
+
+py::dict MuslyJukebox::stats() const
+{
+    return m_stats.to_dict();
+}
+
+void MuslyJukebox::reset_stats()
+{
+    m_stats.reset();
+}
+
+MuslyJukebox* MuslyJukebox::open_mapped(const std::string& path, bool ignore_decoder)
+{
+    py::gil_scoped_release release;
+
+    std::shared_ptr<MappedFile> file(new MappedFile(path));
+    return attach_mapping(file, file->data(), file->size(), ignore_decoder);
+}
+
+MuslyJukebox* MuslyJukebox::attach_shared(const std::string& name, bool ignore_decoder)
+{
+    py::gil_scoped_release release;
+
+    std::shared_ptr<SharedMemory> memory = SharedMemory::open(name);
+    return attach_mapping(memory, memory->data(), memory->size(), ignore_decoder);
 }
 
-MuslyJukebox* MuslyJukebox::create_from_stream(BytesIO& in_stream, bool ignore_decoder)
+MuslyJukebox* MuslyJukebox::attach_mapping(std::shared_ptr<const void> owner, const unsigned char* mapping, std::size_t mapping_size, bool ignore_decoder)
 {
-    std::string version = in_stream.read_line('\0');
-    if (version.empty() || version != musly_version()) {
-        throw musly_error("failed loading jukebox: created with different musly version '" + version + "'");
+    if (mapping_size < sizeof(mapped_header_t)) {
+        throw musly_error("failed loading jukebox: file is too small");
     }
 
-    uint8_t int_size = 0;
-    in_stream.read(&int_size, sizeof(uint8_t));
-    if (int_size != sizeof(int)) {
-        throw musly_error("failed loading jukebox: different architecture");
+    mapped_header_t header;
+    std::memcpy(&header, mapping, sizeof(header));
+    if (std::memcmp(header.magic, _MAPPED_MAGIC, sizeof(header.magic)) != 0 || header.format_version != _MAPPED_FORMAT_VERSION) {
+        throw musly_error("failed loading jukebox: not a mapped jukebox file");
     }
 
-    unsigned int byte_order = 0;
-    in_stream.read(&byte_order, int_size);
-    if (byte_order != _ENDIAN_MAGIC_NUMBER) {
+    const std::string version = read_fixed_string(header.musly_version, sizeof(header.musly_version));
+    if (version != musly_version()) {
+        throw musly_error("failed loading jukebox: created with different musly version '" + version + "'");
+    }
+    if (header.int_size != sizeof(int)) {
+        throw musly_error("failed loading jukebox: different architecture");
+    }
+    if (header.byte_order != _ENDIAN_MAGIC_NUMBER) {
         throw musly_error("failed loading jukebox: invalid byte order");
     }
 
     const std::string decoders = musly_jukebox_listdecoders();
-    const std::string method = in_stream.read_line('\0');
-    std::string decoder = in_stream.read_line('\0');
+    const std::string method = read_fixed_string(header.method, sizeof(header.method));
+    std::string decoder = read_fixed_string(header.decoder, sizeof(header.decoder));
     if (decoder.empty() || decoders.find(decoder) == std::string::npos) {
         if (!ignore_decoder) {
             throw musly_error("failed loading jukebox: decoder '" + decoder + "' not available");
@@ -304,47 +2192,71 @@ MuslyJukebox* MuslyJukebox::create_from_stream(BytesIO& in_stream, bool ignore_d
         decoder = "";
     }
 
-    std::unique_ptr<MuslyJukebox> jukebox(new MuslyJukebox(method.c_str(), decoder.empty() ? nullptr : decoder.c_str()));
+    if (header.jukebox_header_offset < sizeof(header)
+        || header.jukebox_header_size == 0
+        || header.jukebox_track_count < 0
+        || !region_fits(header.jukebox_header_offset, header.jukebox_header_size, 1, mapping_size)
+        || !region_fits(header.jukebox_tracks_offset, header.jukebox_tracks_size, 1, mapping_size)
+        || !region_fits(header.index_offset, header.index_count, sizeof(TrackStore::index_entry_t), mapping_size)
+        || !region_fits(header.records_offset, header.record_count, header.record_stride, mapping_size)
+        || !region_fits(header.codec_parameters_offset, header.codec_parameter_count, sizeof(float), mapping_size)
+        || header.index_offset % alignof(TrackStore::index_entry_t) != 0
+        || header.records_offset % alignof(musly_track) != 0
+        || header.index_count > header.record_count
+        || header.codec_parameters_offset % alignof(float) != 0
+        || header.record_encoding > TrackCodec::INT8) {
+        throw musly_error("failed loading jukebox: file is truncated or corrupt");
+    }
 
-    int header_size;
-    if (in_stream.read(&header_size, int_size) < int_size) {
-        throw musly_error("failed loading jukebox: could not read header size");
+    // tracks are looked up by a binary search over the index
+    const TrackStore::index_entry_t* index = reinterpret_cast<const TrackStore::index_entry_t*>(mapping + header.index_offset);
+    for (std::uint64_t i = 0; i < header.index_count; ++i) {
+        if (index[i].record >= header.record_count || (i > 0 && index[i].track_id <= index[i - 1].track_id)) {
+            throw musly_error("failed loading jukebox: invalid track index");
+        }
     }
 
-    std::unique_ptr<unsigned char> header(new unsigned char[header_size]);
-    in_stream.read(header.get(), header_size);
-    const int track_count = musly_jukebox_frombin(jukebox->m_jukebox, header.get(), 1, 0);
+    std::unique_ptr<MuslyJukebox> jukebox(new MuslyJukebox(method.c_str(), decoder.empty() ? nullptr : decoder.c_str()));
+    if (header.track_size != jukebox->m_track_store->track_size()) {
+        throw musly_error("failed loading jukebox: invalid track size");
+    }
 
-    if (track_count < 0) {
+    // tracks added later are stored in the encoding of the mapped records as well
+    const float* codec_parameters = reinterpret_cast<const float*>(mapping + header.codec_parameters_offset);
+    std::shared_ptr<const TrackCodec> codec = std::make_shared<const TrackCodec>(TrackCodec::restore(
+        static_cast<TrackCodec::encoding_t>(header.record_encoding), jukebox->m_track_store->track_floats(),
+        std::vector<float>(codec_parameters, codec_parameters + header.codec_parameter_count)));
+    if (header.record_stride < codec->encoded_size()) {
+        throw musly_error("failed loading jukebox: invalid track size");
+    }
+    jukebox->m_track_store.reset(new TrackStore(header.track_size, std::move(codec)));
+
+    // libmusly keeps its own copy of the jukebox state, the track records stay in the mapping
+    unsigned char* data = const_cast<unsigned char*>(mapping);
+    const int track_count = musly_jukebox_frombin(jukebox->m_jukebox, data + header.jukebox_header_offset, 1, 0);
+    if (track_count < 0 || track_count != header.jukebox_track_count
+        || musly_jukebox_binsize(jukebox->m_jukebox, 1, 0) != static_cast<std::int64_t>(header.jukebox_header_size)
+        || musly_jukebox_binsize(jukebox->m_jukebox, 0, track_count) != static_cast<std::int64_t>(header.jukebox_tracks_size)) {
         throw musly_error("failed loading jukebox: invalid header");
     }
-
-    const int track_size = musly_jukebox_binsize(jukebox->m_jukebox, 0, 1);
-    const int tracks_per_chunk = 100;
-    const int buffer_len = track_size * tracks_per_chunk;
-    std::unique_ptr<unsigned char> buffer(new unsigned char[buffer_len]);
-
-    int tracks_read = 0;
-    while (tracks_read < track_count) {
-        const int tracks_to_read = std::min(tracks_per_chunk, track_count - tracks_read);
-        const int bytes_to_read = tracks_to_read * track_size;
-
-        if (in_stream.read(buffer.get(), bytes_to_read) < bytes_to_read) {
-            throw musly_error("failed loading jukebox: received less tracks than expected");
-        }
-        if (musly_jukebox_frombin(jukebox->m_jukebox, buffer.get(), 0, tracks_to_read) < 0) {
-            throw musly_error("failed loading jukebox: failed to load track information");
-        }
-
-        tracks_read += tracks_to_read;
+    if (track_count > 0 && musly_jukebox_frombin(jukebox->m_jukebox, data + header.jukebox_tracks_offset, 0, track_count) < 0) {
+        throw musly_error("failed loading jukebox: failed to load track information");
     }
 
+    jukebox->m_track_store->attach(std::move(owner), index, header.index_count, mapping + header.records_offset, header.record_stride);
+
     return jukebox.release();
 }
 
 void MuslyJukebox::register_class(py::module_& module)
 {
-    py::class_<MuslyJukebox>(module, "MuslyJukebox")
+    py::class_<MuslyJukebox>(module, "MuslyJukebox", R"pbdoc(
+            Musly jukebox for track analysis and music similarity computation.
+
+            A jukebox can be shared between threads. Similarity queries release the GIL and run concurrently,
+            while :func:`set_style`, :func:`add_tracks` and :func:`remove_tracks` wait for running queries
+            and block new ones until they are done.
+        )pbdoc")
         .def(py::init<const char*, const char*>(), py::arg("method") = nullptr, py::arg("decoder") = nullptr, R"pbdoc(
             __init__(method: str = None, decoder: str = None) -> None
 
@@ -372,6 +2284,9 @@ void MuslyJukebox::register_class(py::module_& module)
 
             Load previously serialized MuslyJukebox from an io.BytesIO stream.
 
+            The stream is left directly behind the jukebox, its track data and its graph index. Segments appended by
+            :func:`save` with `append` set are not replayed, use :func:`load` for such files.
+
             :param stream:
                 an readable binary stream, like the result of `open('electronic-music.jukebox', 'rb')`.
             :param ignore_decoder:
@@ -381,6 +2296,94 @@ void MuslyJukebox::register_class(py::module_& module)
             :raises MuslyError: if the deserialization failed
         )pbdoc")
 
+        .def_static("load", &MuslyJukebox::load, py::arg("path"), py::arg("ignore_decoder") = true,
+            py::return_value_policy::take_ownership, R"pbdoc(
+            load(path: str, ignore_decoder: bool = True) -> MuslyJukebox
+
+
+            Load a jukebox from a file written with :func:`save` or :func:`serialize_to_stream`.
+
+            The file is read with native buffered I/O while the GIL is released. Segments appended
+            with :func:`save` are replayed in order; an incomplete last segment, as left behind by an
+            interrupted append, is ignored. Appending to such a file fails until it is rewritten with
+            :func:`compact`.
+
+            :param path:
+                the path to the jukebox file.
+            :param ignore_decoder:
+                when `True`, the resulting jukebox will use the default decoder, in case the original decoder is not available.
+            :return: the deserialized jukebox
+            :raises MuslyError: if the file cannot be opened or the deserialization failed
+        )pbdoc")
+
+        .def_static("load_async", &MuslyJukebox::load_async, py::arg("path"), py::arg("ignore_decoder") = true, R"pbdoc(
+            load_async(path: str, ignore_decoder: bool = True) -> asyncio.Future[MuslyJukebox]
+
+
+            Like :func:`load`, but load the jukebox on a native worker thread and return an awaitable future
+            of the running event loop for it.
+
+            :param path:
+                the path to the jukebox file.
+            :param ignore_decoder:
+                when `True`, the resulting jukebox will use the default decoder, in case the original decoder is not available.
+            :return: a future for the deserialized jukebox, which fails with MuslyError if loading failed.
+            :raises RuntimeError: if there is no running event loop in the calling thread.
+        )pbdoc")
+
+        .def_static("open_mapped", &MuslyJukebox::open_mapped, py::arg("path"), py::arg("ignore_decoder") = true,
+            py::return_value_policy::take_ownership, R"pbdoc(
+            open_mapped(path: str, ignore_decoder: bool = True) -> MuslyJukebox
+
+
+            Open a jukebox file previously written with :func:`save_mapped` by mapping it into memory.
+
+            Only the musly jukebox state is loaded during this call. The track data used by :func:`nearest` and
+            :func:`similarity_matrix` stays in the file and is paged in on first access, so several processes
+            opening the same file share the same pages of the operating system's page cache.
+
+            :param path:
+                the path to the jukebox file.
+            :param ignore_decoder:
+                when `True`, the resulting jukebox will use the default decoder, in case the original decoder is not available.
+            :return: the loaded jukebox
+            :raises MuslyError: if the file cannot be mapped or is no compatible jukebox file
+        )pbdoc")
+
+        .def_static("attach_shared", &MuslyJukebox::attach_shared, py::arg("name"), py::arg("ignore_decoder") = true,
+            py::return_value_policy::take_ownership, R"pbdoc(
+            attach_shared(name: str, ignore_decoder: bool = True) -> MuslyJukebox
+
+
+            Attach to a jukebox written into shared memory with :func:`save_shared`, like :func:`open_mapped`.
+
+            The shared memory is mapped read-only and queries read the track data directly from its pages, so any
+            number of processes on the host use a single copy of the tracks. Only the musly jukebox state is loaded
+            during this call. Tracks added to the attached jukebox are kept in the memory of the process.
+
+            :param name:
+                the name of the shared memory object.
+            :param ignore_decoder:
+                when `True`, the resulting jukebox will use the default decoder, in case the original decoder is not available.
+            :return: the attached jukebox
+            :raises MuslyError:
+                if there is no shared memory object with the given name, it holds no compatible jukebox, or on Windows.
+        )pbdoc")
+
+        .def_static("remove_shared", &MuslyJukebox::remove_shared, py::arg("name"), R"pbdoc(
+            remove_shared(name: str) -> bool
+
+
+            Remove the name of a shared memory object written by :func:`save_shared`.
+
+            Attached jukeboxes stay usable, the memory is released once the last of them is gone.
+
+            :param name:
+                the name of the shared memory object.
+            :return: `False` if there was no object with the given name.
+            :raises MuslyError: if the name is invalid or on Windows.
+        )pbdoc")
+
         .def_property_readonly("method", &MuslyJukebox::method, R"pbdoc(
             The method for audio data analysis used by this jukebox instance.
         )pbdoc")
@@ -409,6 +2412,61 @@ void MuslyJukebox::register_class(py::module_& module)
             A list of all track ids assigned to tracks added to this jukebox instance.
         )pbdoc")
 
+        .def_property_readonly("track_ids_array", &MuslyJukebox::track_ids_array, R"pbdoc(
+            Like :attr:`track_ids`, but as `numpy.ndarray` of `int32` values.
+        )pbdoc")
+
+        .def_property("analysis_cache", &MuslyJukebox::analysis_cache, &MuslyJukebox::set_analysis_cache, R"pbdoc(
+            Directory of an on-disk cache of audio file analysis results, or `None` to disable caching.
+
+            When set, :func:`track_from_audiofile` and :func:`analyze_files` look up the analysis result of a file
+            by a hash of its content, the analysis method, the decoder and the excerpt parameters before decoding it, and store
+            new results in the cache. Files are found by their path, size and modification time first, so their content is
+            only hashed when they are new or changed. Each combination of method, decoder and excerpt is analyzed and
+            cached separately. The directory is created if needed and can be shared between processes.
+        )pbdoc")
+
+        .def_property("vectorized_prefilter", &MuslyJukebox::vectorized_prefilter, &MuslyJukebox::set_vectorized_prefilter, R"pbdoc(
+            Whether :func:`nearest` preselects candidates with a vectorized scan instead of musly's neighbor guessing.
+
+            Only supported by the `timbre` method. The jukebox keeps the Gaussian timbre models of all stored tracks
+            in a structure-of-arrays index, which is built on the first query after tracks changed. Queries with more
+            candidates than the prefilter keeps compute the symmetric Kullback-Leibler divergence between the seed and
+            every candidate with SIMD instructions (selected for the CPU at runtime on x86-64 Linux) and pass the
+            closest ones on to musly. The returned similarities are still computed by musly, but as musly normalizes
+            these divergences per track, a neighbor may be missed if its raw divergence ranks far behind.
+
+            :raises MuslyError:
+                when enabled for a jukebox with another method than `timbre`.
+        )pbdoc")
+        .def_property("graph_search_ef", &MuslyJukebox::graph_search_ef, &MuslyJukebox::set_graph_search_ef, R"pbdoc(
+            The number of candidates :func:`nearest` keeps while searching the graph index, `64` by default.
+
+            Larger values find more of the exact nearest neighbors at the cost of more similarity computations.
+            Values below `k` are raised to `k` for a query.
+
+            :raises MuslyError:
+                if the value is not positive.
+        )pbdoc")
+        .def_property_readonly("has_graph_index", &MuslyJukebox::has_graph_index, R"pbdoc(
+            Whether the jukebox has a graph index for :func:`nearest`, see :func:`build_graph_index`.
+        )pbdoc")
+        .def_property("track_storage", &MuslyJukebox::track_storage, &MuslyJukebox::set_track_storage, R"pbdoc(
+            The encoding of the track data kept by the jukebox: `"float32"` (default), `"float16"` or `"int8"`.
+
+            Compact encodings reduce the memory needed per track to a half or a quarter. `"int8"` scales every value
+            of a track to the range of that value over the tracks stored when the encoding was selected, later tracks
+            are clamped to that range. Similarities are computed by musly on decoded copies of the tracks, so the
+            results differ slightly from those using the original data. Results are not re-ranked with float32 data,
+            which the jukebox no longer keeps, so check with :func:`evaluate_track_storage` whether the recall is
+            acceptable before switching. Changing the encoding converts all stored tracks, which cannot be undone
+            without re-adding them. :func:`save`, :func:`serialize_to_stream` and :func:`save_mapped` write the
+            tracks in their encoding, which the jukebox keeps when it is loaded again.
+
+            :raises MuslyError:
+                if the encoding is unknown.
+        )pbdoc")
+
         .def("track_from_audiofile", &MuslyJukebox::track_from_audiofile, py::arg("input_stream"), py::arg("length"),
             py::arg("start"), py::return_value_policy::take_ownership, R"pbdoc(
             track_from_audiofile(input_stream: io.BytesIO, length: int, start: int) -> MuslyTrack
@@ -426,14 +2484,36 @@ void MuslyJukebox::register_class(py::module_& module)
                 if no track can be created from the given input stream.
         )pbdoc")
 
+        .def("analyze_file_async", &MuslyJukebox::analyze_file_async, py::arg("filename"), py::arg("length"), py::arg("start"), R"pbdoc(
+            analyze_file_async(filename: str, length: int, start: int) -> asyncio.Future[MuslyTrack]
+
+
+            Like :func:`track_from_audiofile`, but analyze the file on a native worker thread and return an
+            awaitable future of the running event loop for the track.
+
+            Every call uses an analyzer of its own, so any number of analyses can be in flight at the same time.
+            They share a pool of one worker thread per CPU core with :func:`nearest_async` and :func:`load_async`.
+
+            :param filename:
+                the path to the audio file to analyze.
+            :param length:
+                the length of the excerpt to analyze in seconds.
+            :param start:
+                the start of the excerpt in seconds, see :func:`track_from_audiofile`.
+            :return: a future for the track, which fails with MuslyError if the file cannot be analyzed.
+            :raises RuntimeError: if there is no running event loop in the calling thread.
+        )pbdoc")
+
         .def("track_from_audiodata", &MuslyJukebox::track_from_audiodata, py::arg("pcm_data"),
             py::return_value_policy::take_ownership, R"pbdoc(
-            track_from_audiodata(pcm_data: list[float]) -> MuslyTrack
+            track_from_audiodata(pcm_data: numpy.ndarray | list[float]) -> MuslyTrack
 
 
             Create a MuslyTrack by analyzing the provided PCM samples.
 
             The input samples are expected to represent a mono signal with 22050Hz sample rate using float values.
+            Contiguous float32 buffers, like a `numpy.ndarray`, a `memoryview` or an `array.array('f')`, are analyzed
+            in place without copying. The GIL is released during the analysis.
 
             :param pcm_data:
                 the sample data to analyze.
@@ -441,6 +2521,31 @@ void MuslyJukebox::register_class(py::module_& module)
                 if no track can be created from the given sample data.
         )pbdoc")
 
+        .def("analyze_files", &MuslyJukebox::analyze_files, py::arg("filenames"), py::arg("length"), py::arg("start"),
+            py::arg("threads") = 0, py::return_value_policy::take_ownership, R"pbdoc(
+            analyze_files(filenames: list[str], length: int, start: int, threads: int = 0) -> list[tuple[MuslyTrack | None, str | None]]
+
+
+            Create MuslyTracks for a batch of audio files by analysing them in parallel.
+
+            Each file is decoded and analyzed like in :func:`track_from_audiofile`, but the work is distributed over
+            a pool of native threads and the GIL is released while the files are processed.
+
+            :param filenames:
+                a list of paths to the audio files to analyze.
+            :param length:
+                the length of the excerpt to analyze in seconds.
+            :param start:
+                the start of the excerpt in seconds, see :func:`track_from_audiofile`.
+            :param threads:
+                the number of worker threads. If `0`, one thread per CPU core is used.
+            :return:
+                a list with one `(track, error)` tuple per input file in input order.
+                For a file that could not be analyzed, `track` is `None` and `error` contains the reason.
+            :raises MuslyError:
+                if the analysis workers cannot be initialized.
+        )pbdoc")
+
         .def("serialize_track", &MuslyJukebox::serialize_track, py::arg("track"),
             py::return_value_policy::take_ownership, R"pbdoc(
             serialize_track(track: MuslyTrack) -> bytes
@@ -469,18 +2574,178 @@ void MuslyJukebox::register_class(py::module_& module)
                 if the given data cannot be deserialized into a MuslyTrack.
         )pbdoc")
 
+        .def("serialize_tracks", &MuslyJukebox::serialize_tracks, py::arg("tracks"), R"pbdoc(
+            serialize_tracks(tracks: list[MuslyTrack]) -> bytes
+
+
+            Serialize a list of MuslyTracks into one contiguous `bytes` object.
+
+            The result contains one record of :attr:`track_size` bytes per track in the order of `tracks`.
+
+            :param tracks:
+                a list of MuslyTrack objects.
+            :raises MuslyError:
+                if one of the tracks cannot be serialized.
+        )pbdoc")
+
+        .def("deserialize_tracks", &MuslyJukebox::deserialize_tracks, py::arg("buffer"), py::arg("count") = py::none(),
+            py::return_value_policy::take_ownership, R"pbdoc(
+            deserialize_tracks(buffer: bytes | numpy.ndarray | memoryview, count: int = None) -> list[MuslyTrack]
+
+
+            Deserialize a batch of MuslyTracks from a contiguous buffer, like one created with :func:`serialize_tracks`.
+
+            The buffer is read in place and all resulting tracks share a single native allocation.
+
+            :param buffer:
+                any contiguous object supporting the buffer protocol, containing records of :attr:`track_size` bytes.
+            :param count:
+                the number of tracks to read from the start of the buffer.
+                If `None`, the buffer size must be a multiple of :attr:`track_size`.
+            :return:
+                a list of MuslyTrack instances.
+            :raises MuslyError:
+                if the buffer size does not fit or the data cannot be deserialized.
+        )pbdoc")
+
+        .def("snapshot", &MuslyJukebox::snapshot, py::return_value_policy::take_ownership, R"pbdoc(
+            snapshot() -> JukeboxSnapshot
+
+
+            Create an immutable read view of the current state of the jukebox.
+
+            The snapshot shares the track data of the jukebox, which is only copied page-wise once the jukebox
+            modifies it, so taking a snapshot is cheap even for large catalogs. Queries on the snapshot never
+            wait for modifications of the jukebox. To publish a new catalog version without blocking readers,
+            modify the jukebox and replace the reference to the snapshot used by readers with a new one.
+
+            :return:
+                a new snapshot of the jukebox.
+            :raises MuslyError:
+                if the jukebox state cannot be copied.
+        )pbdoc")
+
         .def("serialize_to_stream", &MuslyJukebox::serialize, py::arg("output_stream"), R"pbdoc(
             serialize_to_stream(output_stream: io.BytesIO) -> None
 
 
             Serialize jukebox instance into a `io.BytesIO` stream`.
 
+            The stored data of all tracks and the graph index built by :func:`build_graph_index` are written along
+            with the jukebox, so loaded jukeboxes answer :func:`nearest` for all of their tracks.
+
             :param output_stream:
                 an output stream, like one created by `open('electronic-music.jukebox', 'wb')`.
             :raises MuslyError:
                 if the jukebox cannot be written into the given output stream.
         )pbdoc")
 
+        .def("save", &MuslyJukebox::save, py::arg("path"), py::arg("append") = false, R"pbdoc(
+            save(path: str, append: bool = False) -> None
+
+
+            Serialize the jukebox into a file.
+
+            The file has the same format as the output of :func:`serialize_to_stream`, but is written with native
+            buffered I/O while the GIL is released. Without `append`, the file is written next to `path` and then
+            renamed, so an existing file stays intact if writing fails.
+
+            With `append`, only the tracks added and removed since the jukebox was last saved to or loaded from
+            the same file are appended to it as segments, which :func:`load` replays. If appending fails, the file
+            is cut back to its previous size. Use :func:`compact` to fold the segments into a single jukebox again.
+
+            :param path:
+                the path of the file to write.
+            :param append:
+                when `True`, append the changes since the last save instead of rewriting the file.
+            :raises MuslyError:
+                if the jukebox cannot be written into the given file, or `append` is set and the file is not the
+                one the jukebox was last saved to or loaded from, or it was changed since, or the style or track storage
+                was set or the graph index was built or dropped since.
+        )pbdoc")
+
+        .def("compact", &MuslyJukebox::compact, py::arg("path"), R"pbdoc(
+            compact(path: str) -> None
+
+
+            Replace the jukebox file at `path` by a complete serialization of the jukebox without segments.
+
+            The new file is written next to the old one and then renamed, so readers never see a partial file.
+
+            :param path:
+                the path of the file to replace.
+            :raises MuslyError:
+                if the jukebox cannot be written or the file cannot be replaced.
+        )pbdoc")
+
+        .def("save_mapped", &MuslyJukebox::save_mapped, py::arg("path"), R"pbdoc(
+            save_mapped(path: str) -> None
+
+
+            Write the jukebox together with the data of its registered tracks into a file for :func:`open_mapped`.
+
+            Besides the musly jukebox state, the file contains the fixed-size track records of the jukebox's
+            track store and an index of these records sorted by track id. Data is stored in native byte order.
+
+            The file is written next to `path` and then renamed over it, so jukeboxes that have the old file mapped,
+            including this one, keep working.
+
+            :param path:
+                the path of the file to write.
+            :raises MuslyError:
+                if the jukebox cannot be written into the given file.
+        )pbdoc")
+
+        .def("save_shared", &MuslyJukebox::save_shared, py::arg("name"), R"pbdoc(
+            save_shared(name: str) -> None
+
+
+            Write the jukebox in the format of :func:`save_mapped` into a POSIX shared memory object for :func:`attach_shared`.
+
+            The object outlives the process until it is removed with :func:`remove_shared`; on Linux it shows up as a
+            file in `/dev/shm`. An existing object of the same name is replaced, processes attached to it keep
+            using the old jukebox. On Linux the jukebox is written under a temporary name and replaces the old one
+            atomically. Elsewhere the old object is removed first, so attaching fails until the new jukebox is
+            written completely and should be retried. Nothing is left behind if writing fails.
+
+            :param name:
+                the name of the shared memory object, without slashes except for an optional leading one.
+            :raises MuslyError:
+                if the shared memory cannot be created or written, or on Windows.
+        )pbdoc")
+
+        .def("stats", &MuslyJukebox::stats, R"pbdoc(
+            stats() -> dict
+
+
+            Return the counters collected since the jukebox was created or :func:`reset_stats` was called.
+
+            Counters are only collected if pymusly was built with the CMake option `PYMUSLY_ENABLE_STATS`,
+            otherwise the result is `{"enabled": False}`. When enabled, the dict contains
+
+            - `operations`: per operation, the number of `calls`, their `total_seconds` and `max_seconds`, and a
+              latency `histogram` whose entry `i` counts calls that took less than `2**i` microseconds (the last
+              entry counts all slower calls). The operations `musly_analysis` and `musly_similarity_batch` measure
+              the time spent inside libmusly, which is part of the time of the operation calling it. A batch is a
+              single call into libmusly's similarity functions; queries split their tracks into batches, so one
+              call of e.g. :func:`similarity_matrix` counts many batches, and times of batches computed on several
+              threads at once add up.
+            - `streams`: `calls`, `bytes` and `seconds` of the `read` and `write` calls on serialization streams.
+            - `tracks_analyzed`: the number of successfully analyzed audio files and PCM buffers.
+            - `peak_buffer_bytes`: the size of the largest temporary buffer used by a single call.
+
+            The time of an operation not spent in libmusly or in streams is spent in the bindings, e.g.
+            converting arguments, waiting for locks or copying data. Converting the arguments and results
+            to and from Python objects before and after the native call is not included.
+        )pbdoc")
+
+        .def("reset_stats", &MuslyJukebox::reset_stats, R"pbdoc(
+            reset_stats() -> None
+
+
+            Reset all counters returned by :func:`stats` to zero.
+        )pbdoc")
+
         .def("set_style", &MuslyJukebox::set_style, py::arg("tracks"), R"pbdoc(
             set_style(tracks: list[MuslyTrack]) -> None
 
@@ -503,6 +2768,7 @@ void MuslyJukebox::register_class(py::module_& module)
 
             Register tracks with the Musly jukebox.
 
+            The jukebox keeps a copy of the track data, so tracks can be referenced by id in :func:`nearest`.
             When the tracks parameter contains a list of id/track tuples, the provided IDs will be used for registration.
             In case a list containing only MuslyTrack instances is provided, IDs will be generated for each track.
 
@@ -530,9 +2796,9 @@ void MuslyJukebox::register_class(py::module_& module)
                 a list of track ids that belong to previously added tracks.
         )pbdoc")
 
-        .def("compute_similarity", &MuslyJukebox::compute_similarity, py::arg("seed"), py::arg("tracks"), R"pbdoc(
+        .def("compute_similarity", py::overload_cast<MuslyJukebox::track_tuple_t, const std::vector<MuslyJukebox::track_tuple_t>&>(&MuslyJukebox::compute_similarity), py::arg("seed"), py::arg("tracks"), R"pbdoc(
             compute_similarity(seed: tuple[int,MuslyTrack], tracks: list[tuple[int,MuslyTrack]]) -> list[float]
-
+            compute_similarity(seed_id: int, track_ids: list[int]) -> list[float]
 
             Compute the similarity between a seed track and a list of other tracks.
 
@@ -542,6 +2808,9 @@ void MuslyJukebox::register_class(py::module_& module)
             - set the music style of the jukebox by using a representative sample of analyzed tracks with :func:`set_style`
             - register the audio tracks with the jukebox using :func:`add_tracks`
 
+            Tracks registered with :func:`add_tracks` can also be referenced by their id alone, in which case
+            the track data stored inside the jukebox is used.
+
             :param seed:
                 a tuple containing a track id and a MuslyTrack instance used as reference.
             :param tracks:
@@ -551,7 +2820,193 @@ void MuslyJukebox::register_class(py::module_& module)
             :return:
                 a list with similarities to the seed track for each given track.
             :raises MuslyError:
-                if the style computation failed.
+                if the style computation failed or no track data is registered for one of the given ids.
+        )pbdoc")
+
+        .def("compute_similarity", py::overload_cast<musly_trackid, const std::vector<musly_trackid>&>(&MuslyJukebox::compute_similarity), py::arg("seed_id"), py::arg("track_ids"))
+
+        .def("compute_similarity_array", &MuslyJukebox::compute_similarity_array, py::arg("seed"), py::arg("tracks"), R"pbdoc(
+            compute_similarity_array(seed: tuple[int,MuslyTrack], tracks: list[tuple[int,MuslyTrack]]) -> numpy.ndarray
+
+
+            Like :func:`compute_similarity`, but return the similarities as `numpy.ndarray` of `float32` values.
+
+            The array takes ownership of the native result buffer, so no Python float objects are created.
+        )pbdoc")
+
+        .def("nearest", &MuslyJukebox::nearest, py::arg("seed_id"), py::arg("k"), py::arg("candidate_ids") = py::none(), R"pbdoc(
+            nearest(seed_id: int, k: int, candidate_ids: list[int] = None) -> list[tuple[int,float]]
+
+
+            Find the `k` registered tracks that are most similar to the track with id `seed_id`.
+
+            The jukebox keeps a copy of the data of every track registered with :func:`add_tracks`, so no MuslyTrack
+            instances need to be passed in. For large catalogs, musly's neighbor guessing is used to preselect
+            candidates before their exact similarity is computed. The seed track itself is never part of the result.
+
+            If the jukebox has a graph index and no `candidate_ids` are given, the neighbors are searched in the
+            graph instead, see :func:`build_graph_index`.
+
+            Each concurrent query uses its own copy of the musly jukebox state. :func:`add_tracks` and
+            :func:`remove_tracks` apply their change to every copy, while :func:`set_style` drops them and the next
+            queries copy the state of the whole catalog again.
+
+            :param seed_id:
+                the id of a track registered with :func:`add_tracks`.
+            :param k:
+                the maximum number of neighbors to return.
+            :param candidate_ids:
+                restrict the search to these track ids. If `None`, all registered tracks are considered.
+            :return:
+                a list of up to `k` `(track_id, similarity)` tuples, ordered from most to least similar.
+                Smaller similarity values denote more similar tracks, like in :func:`compute_similarity`.
+            :raises MuslyError:
+                if no track data is registered for `seed_id` or the similarity computation failed.
+        )pbdoc")
+
+        .def("nearest_async", &MuslyJukebox::nearest_async, py::arg("seed_id"), py::arg("k"), py::arg("candidate_ids") = py::none(), R"pbdoc(
+            nearest_async(seed_id: int, k: int, candidate_ids: list[int] = None) -> asyncio.Future[list[tuple[int,float]]]
+
+
+            Like :func:`nearest`, but run the query on a native worker thread and return an awaitable future of
+            the running event loop for its result.
+
+            Queries run concurrently with each other, see :class:`MuslyJukebox`.
+
+            :param seed_id:
+                the id of a track registered with :func:`add_tracks`.
+            :param k:
+                the maximum number of neighbors to return.
+            :param candidate_ids:
+                restrict the search to these track ids. If `None`, all registered tracks are considered.
+            :return: a future for the neighbors, which fails with MuslyError if the query failed.
+            :raises RuntimeError: if there is no running event loop in the calling thread.
+        )pbdoc")
+
+        .def("nearest_array", &MuslyJukebox::nearest_array, py::arg("seed_id"), py::arg("k"), py::arg("candidate_ids") = py::none(), R"pbdoc(
+            nearest_array(seed_id: int, k: int, candidate_ids: list[int] = None) -> tuple[numpy.ndarray, numpy.ndarray]
+
+
+            Like :func:`nearest`, but return the result as a tuple of two `numpy.ndarray` objects.
+
+            The first array contains the `int32` track ids, the second one the corresponding `float32` similarities.
+        )pbdoc")
+
+        .def("similarity_matrix", &MuslyJukebox::similarity_matrix, py::arg("track_ids") = py::none(), py::arg("threads") = 0,
+            py::arg("dtype") = py::none(), py::arg("top_k") = 0, R"pbdoc(
+            similarity_matrix(track_ids: list[int] = None, threads: int = 0, dtype: numpy.dtype = numpy.float32, top_k: int = 0) -> numpy.ndarray | tuple[numpy.ndarray, numpy.ndarray]
+
+
+            Compute the similarities between all pairs of registered tracks.
+
+            Seeds and candidates are split into tiles which are processed by a pool of native threads with the GIL released.
+
+            :param track_ids:
+                the ids of the tracks to compare. If `None`, all tracks in the order of :attr:`track_ids` are used.
+            :param threads:
+                the number of worker threads. If `0`, one thread per CPU core is used.
+            :param dtype:
+                the dtype of the similarity values, either `numpy.float32` (default) or `numpy.float64`.
+            :param top_k:
+                when `0`, return the dense `n x n` matrix where element `[i, j]` is the similarity of track `j` to seed `i`.
+                Otherwise, only return the `top_k` most similar other tracks for each seed as a tuple of two `n x top_k`
+                arrays containing the neighbor ids and their similarities, ordered from most to least similar.
+            :raises MuslyError:
+                if a track has no registered track data or the similarity computation failed.
+        )pbdoc")
+
+        .def("generate_playlist", &MuslyJukebox::generate_playlist, py::arg("seed_ids"), py::arg("length"),
+            py::arg("exclude_ids") = py::none(), py::arg("tag_track_ids") = py::none(), py::arg("tags") = py::none(),
+            py::arg("tag_windows") = py::none(), py::arg("beam_width") = 1, R"pbdoc(
+            generate_playlist(seed_ids: list[int], length: int, exclude_ids: list[int] = None, tag_track_ids: numpy.ndarray = None, tags: numpy.ndarray = None, tag_windows: list[int] = None, beam_width: int = 1) -> list[int]
+
+
+            Generate a playlist by walking from the seed tracks through the similarity space.
+
+            After the seeds, each step appends one of the nearest neighbors of the last track, as found by
+            :func:`nearest`. A beam search follows the `beam_width` playlists with the lowest sum of similarities
+            between consecutive tracks and returns the best one, a width of `1` always picks the most similar
+            track. No track appears twice. The whole walk runs natively with the GIL released.
+
+            :param seed_ids:
+                the ids of the tracks the playlist starts with, the walk continues from the last one.
+            :param length:
+                the number of tracks of the playlist, including the seeds. The playlist is shorter if no more
+                tracks satisfy the rules.
+            :param exclude_ids:
+                ids of tracks that must not be appended.
+            :param tag_track_ids:
+                a 1-d integer array of track ids the rows of `tags` belong to.
+            :param tags:
+                a 1-d or `n x c` 2-d integer array with `c` tags, e.g. artist and album ids, for each track in
+                `tag_track_ids`. Negative values denote missing tags.
+            :param tag_windows:
+                for each tag column, the number of preceding tracks a track must not share that tag with.
+            :param beam_width:
+                the number of playlists followed at once.
+            :return:
+                the ordered track ids of the playlist, starting with the seeds.
+            :raises MuslyError:
+                if the arguments are invalid, no track data is registered for a track of the walk or the
+                similarity computation failed.
+        )pbdoc")
+
+        .def("build_graph_index", &MuslyJukebox::build_graph_index, py::arg("max_neighbors") = 16,
+            py::arg("ef_construction") = 100, py::arg("threads") = 0, R"pbdoc(
+            build_graph_index(max_neighbors: int = 16, ef_construction: int = 100, threads: int = 0) -> None
+
+
+            Build a graph index for approximate nearest neighbor queries over all tracks with stored data.
+
+            The index is a hierarchical navigable small world graph using musly's similarity as distance. Once built,
+            :func:`nearest` without `candidate_ids` visits only a small part of the tracks instead of computing the
+            similarity to all of them, which may miss some of the exact neighbors, see :attr:`graph_search_ef`.
+            Tracks added with :func:`add_tracks` are linked into the graph right away, removed tracks are unlisted.
+            Setting the style drops the index. The index is saved and loaded with the jukebox, but only tracks with
+            stored data are reachable.
+
+            The jukebox is locked while the graph is built, queries wait for it to finish.
+
+            :param max_neighbors:
+                the number of links per track and level, twice as many are kept on the lowest level.
+            :param ef_construction:
+                the number of candidates kept while searching the neighbors of a new track.
+            :param threads:
+                the number of worker threads. If `0`, one thread per CPU core is used.
+            :raises MuslyError:
+                if the parameters are out of range or the similarity computation failed.
+        )pbdoc")
+
+        .def("drop_graph_index", &MuslyJukebox::drop_graph_index, R"pbdoc(
+            drop_graph_index() -> None
+
+
+            Remove the graph index, so :func:`nearest` computes exact results again.
+        )pbdoc")
+
+        .def("evaluate_track_storage", &MuslyJukebox::evaluate_track_storage, py::arg("encoding"), py::arg("k") = 10,
+            py::arg("samples") = 100, R"pbdoc(
+            evaluate_track_storage(encoding: str, k: int = 10, samples: int = 100) -> dict
+
+
+            Measure how a compact :attr:`track_storage` would change the results of similarity queries.
+
+            For `samples` seed tracks spread over all stored tracks, the similarities to all other stored tracks are
+            computed once with the current float32 data and once with the data encoded as `encoding`. Each sample
+            costs two similarity computations per stored track.
+
+            :param encoding:
+                the encoding to evaluate, see :attr:`track_storage`.
+            :param k:
+                the number of nearest neighbors to compare.
+            :param samples:
+                the maximum number of seed tracks.
+            :return:
+                a dict with the mean share of the `k` nearest neighbors that are found with the encoded data
+                (`recall`), the mean absolute difference of the similarities (`mean_absolute_error`) and the size of
+                an encoded track in bytes (`bytes_per_track`).
+            :raises MuslyError:
+                if the encoding is unknown or the tracks are not stored as float32.
         )pbdoc");
 }
 
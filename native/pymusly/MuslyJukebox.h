@@ -2,25 +2,57 @@
 #define MUSLY_JUKEBOX_H_
 
 #include "BytesIO.h"
+#include "FileIO.h"
+#include "JukeboxStats.h"
 #include "MuslyTrack.h"
+#include "NeighborGraph.h"
+#include "TrackStore.h"
 #include "common.h"
 
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl_bind.h>
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <musly/musly_types.h>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace pymusly {
 
+class AnalysisCache;
+class JukeboxSnapshot;
+class TimbreIndex;
+
 class PYMUSLY_EXPORT MuslyJukebox {
 public:
     typedef std::pair<musly_trackid, MuslyTrack*> track_tuple_t;
+    typedef std::pair<MuslyTrack*, std::optional<std::string>> analysis_result_t;
+    typedef std::pair<musly_trackid, float> neighbor_t;
+    typedef pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> pcm_array_t;
+    typedef pybind11::array_t<musly_trackid, pybind11::array::c_style | pybind11::array::forcecast> id_array_t;
+    typedef pybind11::array_t<int, pybind11::array::c_style | pybind11::array::forcecast> tag_array_t;
 
 public:
     static MuslyJukebox* create_from_stream(pymusly::BytesIO& in_stream, bool ignore_decoder = true);
 
+    static MuslyJukebox* load(const std::string& path, bool ignore_decoder = true);
+
+    static pybind11::object load_async(const std::string& path, bool ignore_decoder = true);
+
+    static MuslyJukebox* open_mapped(const std::string& path, bool ignore_decoder = true);
+
+    static MuslyJukebox* attach_shared(const std::string& name, bool ignore_decoder = true);
+
+    static bool remove_shared(const std::string& name);
+
     static void register_class(pybind11::module_& module);
 
 public:
@@ -35,20 +67,75 @@ public:
 
     int track_size() const;
 
+    std::optional<std::string> analysis_cache();
+
+    void set_analysis_cache(const std::optional<std::string>& directory);
+
+    bool vectorized_prefilter() const;
+
+    void set_vectorized_prefilter(bool enabled);
+
+    int graph_search_ef() const;
+
+    void set_graph_search_ef(int ef);
+
+    bool has_graph_index() const;
+
+    void build_graph_index(int max_neighbors, int ef_construction, unsigned int threads);
+
+    void drop_graph_index();
+
+    std::string track_storage() const;
+
+    void set_track_storage(const std::string& encoding);
+
+    /**
+     * Compare nearest neighbors and similarities using the stored tracks to those using the
+     * tracks in the given encoding, for `samples` seeds spread over the stored tracks.
+     */
+    pybind11::dict evaluate_track_storage(const std::string& encoding, int k, int samples);
+
+    /**
+     * The current analysis cache, or null. Must be called with the GIL released.
+     */
+    std::shared_ptr<const AnalysisCache> shared_analysis_cache();
+
     MuslyTrack* track_from_audiofile(const char* filename, int length, int start);
 
-    MuslyTrack* track_from_audiodata(const std::vector<float>& pcm_data);
+    pybind11::object analyze_file_async(const std::string& filename, int length, int start);
+
+    MuslyTrack* track_from_audiodata(pcm_array_t pcm_data);
+
+    /**
+     * Analyze mono 22050Hz samples into a newly allocated musly track.
+     *
+     * Must be called with the GIL released; concurrent calls are serialized.
+     */
+    musly_track* analyze_pcm(const float* samples, std::size_t sample_count);
+
+    std::vector<analysis_result_t> analyze_files(const std::vector<std::string>& filenames, int length, int start, unsigned int threads = 0);
 
     MuslyTrack* deserialize_track(pybind11::bytes bytes);
 
     pybind11::bytes serialize_track(MuslyTrack* track);
 
+    std::vector<MuslyTrack*> deserialize_tracks(pybind11::buffer buffer, std::optional<std::size_t> count = std::nullopt);
+
+    pybind11::bytes serialize_tracks(const std::vector<MuslyTrack*>& tracks);
+
     void set_style(const std::vector<MuslyTrack*>& tracks);
 
+    /**
+     * Set the music style from the given tracks. Must be called with the GIL released.
+     */
+    void apply_style(const std::vector<musly_track*>& tracks);
+
     int track_count() const;
 
     std::vector<musly_trackid> track_ids() const;
 
+    pybind11::array_t<musly_trackid> track_ids_array() const;
+
     musly_trackid highest_track_id() const;
 
     std::vector<musly_trackid> add_tracks(const std::vector<MuslyTrack*>& tracks);
@@ -57,12 +144,217 @@ public:
 
     void remove_tracks(const std::vector<musly_trackid>& track_ids);
 
+    /**
+     * Register tracks with musly and keep a copy of the data of those accepted by `keep_data`.
+     *
+     * Must be called with the GIL released.
+     */
+    std::vector<musly_trackid> insert_tracks(const std::vector<musly_track*>& tracks, std::vector<musly_trackid> track_ids,
+        bool generate_ids, const std::function<bool(musly_trackid)>& keep_data = nullptr);
+
+    /**
+     * Unregister tracks from musly and drop their data. Must be called with the GIL released.
+     */
+    void erase_tracks(const std::vector<musly_trackid>& track_ids);
+
+    /**
+     * Copy the stored data of a track into `track`, returns false if there is none.
+     */
+    bool copy_track(musly_trackid track_id, std::vector<musly_track>& track) const;
+
     std::vector<float> compute_similarity(track_tuple_t seed, const std::vector<track_tuple_t>& track_tuples);
 
+    std::vector<float> compute_similarity(musly_trackid seed_id, const std::vector<musly_trackid>& track_ids);
+
+    pybind11::array_t<float> compute_similarity_array(track_tuple_t seed, const std::vector<track_tuple_t>& track_tuples);
+
+    std::vector<neighbor_t> nearest(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids = std::nullopt);
+
+    pybind11::object nearest_async(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids = std::nullopt);
+
+    /**
+     * Find the `k` candidates most similar to the seed, using `seed_track` as its data if given.
+     *
+     * Candidates default to all tracks with stored data. Must be called with the GIL released.
+     */
+    std::vector<neighbor_t> find_nearest(musly_trackid seed_id, const musly_track* seed_track, int k, const std::vector<musly_trackid>* candidate_ids);
+
+    std::pair<pybind11::array_t<musly_trackid>, pybind11::array_t<float>> nearest_array(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids = std::nullopt);
+
+    pybind11::object similarity_matrix(const std::optional<std::vector<musly_trackid>>& track_ids, unsigned int threads, const pybind11::object& dtype, int top_k);
+
+    std::vector<musly_trackid> generate_playlist(const std::vector<musly_trackid>& seed_ids, int length, const std::optional<std::vector<musly_trackid>>& exclude_ids,
+        const std::optional<id_array_t>& tag_track_ids, const std::optional<tag_array_t>& tags, const std::optional<std::vector<int>>& tag_windows, int beam_width);
+
+    JukeboxSnapshot* snapshot();
+
     void serialize(pymusly::BytesIO& out_stream);
 
+    void save(const std::string& path, bool append = false);
+
+    void compact(const std::string& path);
+
+    void save_mapped(const std::string& path);
+
+    void save_shared(const std::string& name);
+
+    pybind11::dict stats() const;
+
+    void reset_stats();
+
 private:
+    template <typename InputStream>
+    static MuslyJukebox* create_from(InputStream& in_stream, bool ignore_decoder);
+
+    /**
+     * Load a jukebox saved with save(). Must be called with the GIL released.
+     */
+    static MuslyJukebox* read_file(const std::string& path, bool ignore_decoder);
+
+    /**
+     * Create a jukebox from an image in the mapped format, whose track records stay in the mapping
+     * kept alive by `owner`. Must be called with the GIL released.
+     */
+    static MuslyJukebox* attach_mapping(std::shared_ptr<const void> owner, const unsigned char* mapping, std::size_t mapping_size, bool ignore_decoder);
+
+    template <typename OutputStream>
+    void serialize_to(OutputStream& out_stream);
+
+    template <typename MappedWriter>
+    void write_mapped(MappedWriter& out);
+
+    class ReplicaLease;
+
+    MuslyJukebox(musly_jukebox* jukebox, std::unique_ptr<TrackStore> track_store);
+
+    std::vector<musly_trackid> registered_track_ids() const;
+
+    void reset_journal(const std::string& path, std::uint64_t size);
+
+    template <typename OutputStream>
+    void append_segments(OutputStream& out_stream);
+
+    /**
+     * Write the jukebox to a new file that replaces `path`. Must be called with the lock and the
+     * journal lock held.
+     */
+    void write_file(const std::string& path);
+
+    /**
+     * Replay all segments in the next `remaining` bytes of the stream. Returns the number of
+     * bytes behind the last complete segment.
+     */
+    template <typename InputStream>
+    std::uint64_t replay_segments(InputStream& in_stream, std::uint64_t remaining);
+
+    /**
+     * Replay the next segment if it ends within `remaining` bytes and subtract its size, returns
+     * false at the end of the stream or if the segment is incomplete.
+     */
+    template <typename InputStream>
+    bool replay_segment(InputStream& in_stream, std::uint64_t& remaining);
+
+    /**
+     * The size of a pair of track id and track data in segments.
+     */
+    std::uint64_t track_data_size() const;
+
+    /**
+     * Write pairs of track id and stored track data in the layout of segments.
+     */
+    template <typename OutputStream>
+    void write_track_data(OutputStream& out_stream, const std::vector<musly_trackid>& track_ids);
+
+    /**
+     * Read `count` pairs of track id and track data written by write_track_data(), which are
+     * passed to `consume` in chunks.
+     */
+    template <typename InputStream>
+    void read_track_data(InputStream& in_stream, int count,
+        const std::function<void(const std::vector<musly_trackid>&, const std::vector<musly_track*>&)>& consume);
+
+    /**
+     * The jukebox used by track_from_audiofile() and analyze_pcm(), created on first use. Must be
+     * called with m_analysis_mutex held.
+     */
+    musly_jukebox* analyzer();
+
+    musly_jukebox* acquire_replica();
+
+    void release_replica(musly_jukebox* replica);
+
+    /**
+     * Drop all copies of the jukebox state and the timbre index. Must be called by writers that
+     * replace the jukebox state.
+     */
+    void clear_replicas();
+
+    /**
+     * Apply a change of the jukebox state to all copies of it and drop the timbre index. Copies
+     * `update` returns false for are dropped. Must be called by writers holding the lock.
+     */
+    void update_replicas(const std::function<bool(musly_jukebox*)>& update);
+
+    /**
+     * Drop the timbre index. Must be called by writers that change the stored tracks.
+     */
+    void drop_timbre_index();
+
+    /**
+     * The timbre index of all stored tracks, built on first use. Must be called with the lock held.
+     */
+    std::shared_ptr<const TimbreIndex> timbre_index();
+
+    /**
+     * Compute the similarity of the seed to `count` tracks of `store`, decoding compact tracks
+     * tile by tile. Must be called with the lock held.
+     */
+    void stored_similarity(musly_jukebox* replica, const TrackStore& store, musly_track* seed, musly_trackid seed_id,
+        const musly_trackid* track_ids, std::size_t count, float* out);
+
+    /**
+     * Similarities of stored tracks to the seed as distances for the neighbor graph, infinite for
+     * tracks without stored data. Must be called with the lock held.
+     */
+    NeighborGraph::distances_t graph_distances(musly_jukebox* jukebox, musly_track* seed, musly_trackid seed_id);
+
+    /**
+     * Implementation of find_nearest(). Must be called with the lock held.
+     */
+    std::vector<neighbor_t> search_nearest(musly_trackid seed_id, const musly_track* seed_track, int k, const std::vector<musly_trackid>* candidate_ids);
+
     musly_jukebox* m_jukebox;
+    std::unique_ptr<TrackStore> m_track_store;
+
+    // analyses run on a jukebox of their own, so they never touch m_jukebox while writers change it
+    std::mutex m_analysis_mutex;
+    musly_jukebox* m_analyzer;
+    std::shared_ptr<const AnalysisCache> m_analysis_cache;
+
+    // queries run concurrently under a shared lock, each on its own copy of the jukebox state
+    // from m_replicas. Writers take the lock exclusively, when no copy is in use, and apply
+    // their change to every copy.
+    mutable std::shared_mutex m_mutex;
+    std::mutex m_replica_mutex;
+    std::vector<musly_jukebox*> m_replicas;
+
+    std::atomic<bool> m_vectorized_prefilter;
+    std::mutex m_index_mutex;
+    std::shared_ptr<const TimbreIndex> m_timbre_index;
+
+    // maintained by writers along with the track store, so it is guarded by m_mutex
+    std::unique_ptr<NeighborGraph> m_graph_index;
+    std::atomic<int> m_graph_search_ef;
+
+    // changes since the jukebox was last written to or loaded from m_journal_path, which
+    // save() can append to that file instead of rewriting it
+    std::mutex m_journal_mutex;
+    std::string m_journal_path;
+    std::uint64_t m_journal_size;
+    std::unordered_set<musly_trackid> m_journal_added;
+    std::unordered_set<musly_trackid> m_journal_removed;
+
+    JukeboxStats m_stats;
 };
 
 } // namespace pymusly
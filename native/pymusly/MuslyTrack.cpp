@@ -18,9 +18,18 @@ MuslyTrack::MuslyTrack(musly_track* track)
     // empty
 }
 
+MuslyTrack::MuslyTrack(musly_track* track, std::shared_ptr<void> pool)
+    : m_track(track)
+    , m_pool(std::move(pool))
+{
+    // empty
+}
+
 MuslyTrack::~MuslyTrack()
 {
-    musly_track_free(m_track);
+    if (!m_pool) {
+        musly_track_free(m_track);
+    }
     m_track = nullptr;
 }
 
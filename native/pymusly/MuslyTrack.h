@@ -3,6 +3,7 @@
 
 #include "common.h"
 
+#include <memory>
 #include <musly/musly_types.h>
 #include <pybind11/pybind11.h>
 #include <utility>
@@ -16,6 +17,13 @@ public:
 public:
     MuslyTrack(musly_track* track);
 
+    /**
+     * Create a track that lives inside a block of memory shared with other tracks.
+     *
+     * The track data is not freed individually, the block is released together with its last track.
+     */
+    MuslyTrack(musly_track* track, std::shared_ptr<void> pool);
+
     ~MuslyTrack();
 
     musly_track* data() const;
@@ -31,6 +39,7 @@ private:
     MuslyTrack& operator=(MuslyTrack&& other) = delete;
 
     musly_track* m_track;
+    std::shared_ptr<void> m_pool;
 };
 
 } // namespace pymusly
@@ -0,0 +1,304 @@
+#include "NeighborGraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <unordered_set>
+
+namespace pymusly {
+
+NeighborGraph::NeighborGraph(int max_neighbors, int ef_construction)
+    : m_max_neighbors(max_neighbors)
+    , m_ef_construction(ef_construction)
+    , m_entry(_NO_NODE)
+    , m_max_level(-1)
+    , m_random(std::mt19937::default_seed)
+{
+    // empty
+}
+
+NeighborGraph::NeighborGraph(const NeighborGraph& other)
+    : m_max_neighbors(other.m_max_neighbors)
+    , m_ef_construction(other.m_ef_construction)
+    , m_nodes(other.m_nodes)
+    , m_node_ids(other.m_node_ids)
+    , m_entry(other.m_entry)
+    , m_max_level(other.m_max_level)
+    , m_random(other.m_random)
+{
+    // empty
+}
+
+int NeighborGraph::max_neighbors() const
+{
+    return m_max_neighbors;
+}
+
+int NeighborGraph::ef_construction() const
+{
+    return m_ef_construction;
+}
+
+std::size_t NeighborGraph::size() const
+{
+    return m_node_ids.size();
+}
+
+bool NeighborGraph::contains(musly_trackid track_id) const
+{
+    return m_node_ids.count(track_id) > 0;
+}
+
+void NeighborGraph::build(const std::vector<musly_trackid>& track_ids, ThreadPool& pool,
+    const std::function<distances_t(unsigned int, musly_trackid)>& distances_for)
+{
+    const std::uint32_t first = static_cast<std::uint32_t>(m_nodes.size());
+    for (musly_trackid track_id : track_ids) {
+        add_node(track_id);
+    }
+    if (track_ids.empty()) {
+        return;
+    }
+
+    // nodes are only reachable once linked, so workers never see the links of a node in flux
+    // without holding its lock. The first node may become the entry all others start from.
+    std::unique_ptr<std::mutex[]> locks(new std::mutex[m_nodes.size()]);
+    link(first, distances_for(0, m_nodes[first].track_id), locks.get());
+    pool.parallel_for(track_ids.size() - 1, [&](unsigned int slot, std::size_t i) {
+        const std::uint32_t node = first + 1 + static_cast<std::uint32_t>(i);
+        link(node, distances_for(slot, m_nodes[node].track_id), locks.get());
+    });
+}
+
+void NeighborGraph::insert(musly_trackid track_id, const distances_t& distances)
+{
+    link(add_node(track_id), distances, nullptr);
+}
+
+void NeighborGraph::remove(musly_trackid track_id)
+{
+    auto it = m_node_ids.find(track_id);
+    if (it != m_node_ids.end()) {
+        m_nodes[it->second].removed = true;
+        m_node_ids.erase(it);
+    }
+}
+
+std::vector<NeighborGraph::neighbor_t> NeighborGraph::search(const distances_t& distances, std::size_t k, std::size_t ef) const
+{
+    if (m_entry == _NO_NODE || k == 0) {
+        return {};
+    }
+
+    float distance;
+    distances(&m_nodes[m_entry].track_id, 1, &distance);
+    std::vector<candidate_t> entries = { candidate_t(distance, m_entry) };
+    for (int level = m_max_level; level > 0; --level) {
+        entries = search_level(distances, entries, 1, level, nullptr);
+    }
+
+    std::vector<neighbor_t> neighbors;
+    for (const candidate_t& candidate : search_level(distances, entries, std::max(ef, k), 0, nullptr)) {
+        if (!m_nodes[candidate.second].removed && std::isfinite(candidate.first)) {
+            neighbors.emplace_back(m_nodes[candidate.second].track_id, candidate.first);
+            if (neighbors.size() == k) {
+                break;
+            }
+        }
+    }
+
+    return neighbors;
+}
+
+std::uint32_t NeighborGraph::add_node(musly_trackid track_id)
+{
+    // levels follow an exponential distribution, so each level holds about 1 / max_neighbors
+    // of the nodes of the level below
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double level_factor = 1.0 / std::log(static_cast<double>(m_max_neighbors));
+    const int level = std::min(static_cast<int>(-std::log(1.0 - uniform(m_random)) * level_factor), static_cast<int>(_MAX_LEVELS) - 1);
+
+    const std::uint32_t node = static_cast<std::uint32_t>(m_nodes.size());
+    auto it = m_node_ids.find(track_id);
+    if (it != m_node_ids.end()) {
+        m_nodes[it->second].removed = true;
+    }
+    m_nodes.push_back({ track_id, false, std::vector<std::vector<link_t>>(level + 1) });
+    m_node_ids[track_id] = node;
+
+    return node;
+}
+
+void NeighborGraph::link(std::uint32_t node, const distances_t& distances, std::mutex* locks)
+{
+    const auto lock_node = [locks](std::uint32_t node) {
+        return locks != nullptr ? std::unique_lock<std::mutex>(locks[node]) : std::unique_lock<std::mutex>();
+    };
+
+    const int level = static_cast<int>(m_nodes[node].links.size()) - 1;
+    std::uint32_t entry;
+    int max_level;
+    {
+        std::lock_guard<std::mutex> lock(m_entry_mutex);
+        if (m_entry == _NO_NODE) {
+            m_entry = node;
+            m_max_level = level;
+            return;
+        }
+        entry = m_entry;
+        max_level = m_max_level;
+    }
+
+    float distance;
+    distances(&m_nodes[entry].track_id, 1, &distance);
+    std::vector<candidate_t> entries = { candidate_t(distance, entry) };
+    for (int l = max_level; l > level; --l) {
+        entries = search_level(distances, entries, 1, l, locks);
+    }
+
+    for (int l = std::min(level, max_level); l >= 0; --l) {
+        const std::vector<candidate_t> candidates = search_level(distances, entries, m_ef_construction, l, locks);
+
+        std::vector<link_t> selected;
+        for (const candidate_t& candidate : candidates) {
+            if (candidate.second != node && std::isfinite(candidate.first)) {
+                selected.push_back({ candidate.second, candidate.first });
+                if (selected.size() == static_cast<std::size_t>(m_max_neighbors)) {
+                    break;
+                }
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock = lock_node(node);
+            m_nodes[node].links[l] = selected;
+        }
+
+        // link back, keeping only the closest links of neighbors that are full
+        for (const link_t& neighbor : selected) {
+            std::unique_lock<std::mutex> lock = lock_node(neighbor.node);
+            std::vector<link_t>& links = m_nodes[neighbor.node].links[l];
+            links.push_back({ node, neighbor.distance });
+            if (links.size() > level_capacity(l)) {
+                std::sort(links.begin(), links.end(), [](const link_t& a, const link_t& b) { return a.distance < b.distance; });
+                links.resize(level_capacity(l));
+            }
+        }
+
+        entries = candidates;
+    }
+
+    if (level > max_level) {
+        std::lock_guard<std::mutex> lock(m_entry_mutex);
+        if (level > m_max_level) {
+            m_entry = node;
+            m_max_level = level;
+        }
+    }
+}
+
+std::vector<NeighborGraph::candidate_t> NeighborGraph::search_level(const distances_t& distances, const std::vector<candidate_t>& entries,
+    std::size_t ef, int level, std::mutex* locks) const
+{
+    std::unordered_set<std::uint32_t> visited;
+    std::priority_queue<candidate_t, std::vector<candidate_t>, std::greater<candidate_t>> candidates;
+    std::priority_queue<candidate_t> results;
+    for (const candidate_t& entry : entries) {
+        if (visited.insert(entry.second).second) {
+            candidates.push(entry);
+            results.push(entry);
+            if (results.size() > ef) {
+                results.pop();
+            }
+        }
+    }
+
+    // the distances to all unvisited neighbors of a node are computed at once
+    std::vector<std::uint32_t> neighbors;
+    std::vector<std::uint32_t> pending;
+    std::vector<musly_trackid> track_ids;
+    std::vector<float> neighbor_distances;
+    while (!candidates.empty()) {
+        const candidate_t current = candidates.top();
+        if (results.size() >= ef && current.first > results.top().first) {
+            break;
+        }
+        candidates.pop();
+
+        // removed nodes have no distance, the search passes through them to their links instead
+        neighbors.clear();
+        pending.assign(1, current.second);
+        while (!pending.empty()) {
+            const std::uint32_t index = pending.back();
+            pending.pop_back();
+
+            std::unique_lock<std::mutex> lock;
+            if (locks != nullptr) {
+                lock = std::unique_lock<std::mutex>(locks[index]);
+            }
+            const node_t& node = m_nodes[index];
+            if (static_cast<std::size_t>(level) < node.links.size()) {
+                for (const link_t& link : node.links[level]) {
+                    if (visited.insert(link.node).second) {
+                        (m_nodes[link.node].removed ? pending : neighbors).push_back(link.node);
+                    }
+                }
+            }
+        }
+        if (neighbors.empty()) {
+            continue;
+        }
+
+        track_ids.resize(neighbors.size());
+        neighbor_distances.resize(neighbors.size());
+        for (std::size_t i = 0; i < neighbors.size(); ++i) {
+            track_ids[i] = m_nodes[neighbors[i]].track_id;
+        }
+        distances(track_ids.data(), track_ids.size(), neighbor_distances.data());
+
+        for (std::size_t i = 0; i < neighbors.size(); ++i) {
+            const float distance = neighbor_distances[i];
+            if (!std::isfinite(distance)) {
+                continue;
+            }
+            if (results.size() < ef || distance < results.top().first) {
+                candidates.push(candidate_t(distance, neighbors[i]));
+                results.push(candidate_t(distance, neighbors[i]));
+                if (results.size() > ef) {
+                    results.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<candidate_t> closest(results.size());
+    for (std::size_t i = closest.size(); i > 0; --i) {
+        closest[i - 1] = results.top();
+        results.pop();
+    }
+
+    return closest;
+}
+
+bool NeighborGraph::is_consistent() const
+{
+    for (const node_t& node : m_nodes) {
+        for (std::size_t level = 0; level < node.links.size(); ++level) {
+            for (const link_t& link : node.links[level]) {
+                if (link.node >= m_nodes.size() || m_nodes[link.node].links.size() <= level) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return m_nodes[m_entry].links.size() == static_cast<std::size_t>(m_max_level) + 1;
+}
+
+std::size_t NeighborGraph::level_capacity(int level) const
+{
+    return static_cast<std::size_t>(level == 0 ? 2 * m_max_neighbors : m_max_neighbors);
+}
+
+} // namespace pymusly
@@ -0,0 +1,210 @@
+#ifndef PYMUSLY_NEIGHBOR_GRAPH_H_
+#define PYMUSLY_NEIGHBOR_GRAPH_H_
+
+#include "ThreadPool.h"
+#include "common.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <musly/musly_types.h>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * A hierarchical navigable small world graph over tracks for approximate nearest neighbor search.
+ *
+ * The graph only knows track ids, distances are supplied by the caller for every insertion and
+ * query. Every node is linked to up to `max_neighbors` of the closest nodes found while inserting
+ * it on each of its levels, and up to twice as many on level 0. Links keep the distance they were
+ * created with, so pruning the links of a node never needs new distance computations.
+ *
+ * Removed tracks stay in the graph as unlisted nodes without distances, searches pass through them
+ * to their links, so the graph remains navigable.
+ */
+class PYMUSLY_EXPORT NeighborGraph {
+public:
+    /**
+     * Write the distances from the query to `count` tracks into `out`. Tracks that cannot be
+     * compared get an infinite distance and are neither visited nor returned.
+     */
+    typedef std::function<void(const musly_trackid* track_ids, std::size_t count, float* out)> distances_t;
+
+    typedef std::pair<musly_trackid, float> neighbor_t;
+
+public:
+    NeighborGraph(int max_neighbors, int ef_construction);
+
+    /**
+     * Copy the graph, for a jukebox snapshot. The source must not be modified meanwhile.
+     */
+    NeighborGraph(const NeighborGraph& other);
+
+    int max_neighbors() const;
+
+    int ef_construction() const;
+
+    /**
+     * The number of tracks in the graph, without removed ones.
+     */
+    std::size_t size() const;
+
+    bool contains(musly_trackid track_id) const;
+
+    /**
+     * Insert tracks concurrently on the workers of `pool`. `distances_for(slot, track_id)` returns
+     * the distances from the given track for use by the worker `slot`.
+     */
+    void build(const std::vector<musly_trackid>& track_ids, ThreadPool& pool,
+        const std::function<distances_t(unsigned int, musly_trackid)>& distances_for);
+
+    /**
+     * Insert a track, which replaces a previous node of the same track.
+     */
+    void insert(musly_trackid track_id, const distances_t& distances);
+
+    void remove(musly_trackid track_id);
+
+    /**
+     * The up to `k` tracks closest to the query, sorted by distance. `ef` is the number of
+     * candidates kept while searching, larger values find more of the true neighbors.
+     */
+    std::vector<neighbor_t> search(const distances_t& distances, std::size_t k, std::size_t ef) const;
+
+    /**
+     * Pass the graph to `write(data, size)` in the format read by read().
+     */
+    template <typename Writer>
+    void write(Writer&& write) const
+    {
+        const header_t header = { static_cast<std::uint32_t>(m_max_neighbors), static_cast<std::uint32_t>(m_ef_construction),
+            static_cast<std::uint32_t>(m_nodes.size()), m_entry, m_max_level };
+        write(&header, sizeof(header));
+
+        for (const node_t& node : m_nodes) {
+            const node_header_t node_header = { node.track_id, static_cast<std::uint32_t>(node.links.size()), node.removed ? 1U : 0U };
+            write(&node_header, sizeof(node_header));
+            for (const std::vector<link_t>& links : node.links) {
+                const std::uint32_t count = static_cast<std::uint32_t>(links.size());
+                write(&count, sizeof(count));
+                write(links.data(), links.size() * sizeof(link_t));
+            }
+        }
+    }
+
+    /**
+     * Restore a graph from `read(data, size)`, which returns whether all `size` bytes were read.
+     * Returns null if the data is truncated or inconsistent.
+     */
+    template <typename Reader>
+    static std::unique_ptr<NeighborGraph> read(Reader&& read)
+    {
+        header_t header;
+        if (!read(&header, sizeof(header)) || header.max_neighbors < 2 || header.ef_construction < 1) {
+            return nullptr;
+        }
+
+        std::unique_ptr<NeighborGraph> graph(new NeighborGraph(header.max_neighbors, header.ef_construction));
+        for (std::uint32_t i = 0; i < header.node_count; ++i) {
+            node_header_t node_header;
+            if (!read(&node_header, sizeof(node_header)) || node_header.levels == 0 || node_header.levels > _MAX_LEVELS) {
+                return nullptr;
+            }
+
+            graph->m_nodes.emplace_back();
+            node_t& node = graph->m_nodes.back();
+            node.track_id = node_header.track_id;
+            node.removed = node_header.removed != 0;
+            node.links.resize(node_header.levels);
+            for (std::vector<link_t>& links : node.links) {
+                std::uint32_t count;
+                if (!read(&count, sizeof(count)) || count > 2 * header.max_neighbors) {
+                    return nullptr;
+                }
+                links.resize(count);
+                if (!read(links.data(), count * sizeof(link_t))) {
+                    return nullptr;
+                }
+            }
+            if (!node.removed) {
+                graph->m_node_ids[node.track_id] = i;
+            }
+        }
+
+        if (graph->m_nodes.empty()) {
+            return graph;
+        }
+        if (header.entry >= header.node_count || header.max_level < 0) {
+            return nullptr;
+        }
+        graph->m_entry = header.entry;
+        graph->m_max_level = header.max_level;
+
+        return graph->is_consistent() ? std::move(graph) : nullptr;
+    }
+
+private:
+    static const std::uint32_t _NO_NODE = 0xffffffff;
+    static const std::uint32_t _MAX_LEVELS = 32;
+
+    struct header_t {
+        std::uint32_t max_neighbors;
+        std::uint32_t ef_construction;
+        std::uint32_t node_count;
+        std::uint32_t entry;
+        std::int32_t max_level;
+    };
+
+    struct node_header_t {
+        musly_trackid track_id;
+        std::uint32_t levels;
+        std::uint32_t removed;
+    };
+
+    struct link_t {
+        std::uint32_t node;
+        float distance;
+    };
+
+    struct node_t {
+        musly_trackid track_id;
+        bool removed;
+        std::vector<std::vector<link_t>> links;
+    };
+
+    typedef std::pair<float, std::uint32_t> candidate_t;
+
+    std::uint32_t add_node(musly_trackid track_id);
+
+    void link(std::uint32_t node, const distances_t& distances, std::mutex* locks);
+
+    /**
+     * The up to `ef` nodes closest to the query on `level`, sorted by distance, found by a best
+     * first search starting at `entries`. Locks nodes while reading their links if `locks` is set.
+     */
+    std::vector<candidate_t> search_level(const distances_t& distances, const std::vector<candidate_t>& entries,
+        std::size_t ef, int level, std::mutex* locks) const;
+
+    bool is_consistent() const;
+
+    std::size_t level_capacity(int level) const;
+
+    int m_max_neighbors;
+    int m_ef_construction;
+    std::vector<node_t> m_nodes;
+    std::unordered_map<musly_trackid, std::uint32_t> m_node_ids;
+    std::uint32_t m_entry;
+    int m_max_level;
+    std::mutex m_entry_mutex;
+    std::mt19937 m_random;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_NEIGHBOR_GRAPH_H_
@@ -0,0 +1,165 @@
+#include "PlaylistGenerator.h"
+#include "musly_error.h"
+
+#include <algorithm>
+
+namespace pymusly {
+
+namespace {
+
+// neighbors fetched per step and playlist of the beam at first, doubled while too few of them
+// are accepted
+const std::size_t _MIN_NEIGHBORS = 32;
+
+} // namespace
+
+PlaylistGenerator::PlaylistGenerator()
+{
+    // empty
+}
+
+void PlaylistGenerator::exclude(const std::vector<musly_trackid>& track_ids)
+{
+    m_excluded.insert(track_ids.begin(), track_ids.end());
+}
+
+void PlaylistGenerator::set_tags(const musly_trackid* track_ids, const int* tags, std::size_t count, std::size_t columns, const std::vector<int>& windows)
+{
+    if (windows.size() != columns) {
+        throw musly_error("expected one tag window per tag column");
+    }
+
+    m_tag_rows.clear();
+    m_tag_rows.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        m_tag_rows[track_ids[i]] = i;
+    }
+    m_tags.assign(tags, tags + count * columns);
+    m_windows = windows;
+}
+
+std::vector<musly_trackid> PlaylistGenerator::generate(const std::vector<musly_trackid>& seed_ids, std::size_t length, std::size_t beam_width,
+    const nearest_t& nearest) const
+{
+    if (seed_ids.empty()) {
+        throw musly_error("at least one seed track is required");
+    }
+    if (beam_width == 0) {
+        throw musly_error("beam_width must be positive");
+    }
+
+    path_t seeds = { {}, {}, {}, 0.0 };
+    for (musly_trackid track_id : seed_ids) {
+        seeds.track_ids.push_back(track_id);
+        seeds.rows.push_back(tag_row(track_id));
+        seeds.used.insert(track_id);
+    }
+    if (seeds.track_ids.size() >= length) {
+        seeds.track_ids.resize(length);
+        return seeds.track_ids;
+    }
+
+    // all playlists of the beam have the same length, the best one comes first
+    std::vector<path_t> beam;
+    beam.push_back(std::move(seeds));
+    neighbor_cache_t cache;
+    std::vector<expansion_t> expansions;
+    while (beam.front().track_ids.size() < length) {
+        expansions.clear();
+        for (std::size_t i = 0; i < beam.size(); ++i) {
+            expand(beam[i], i, beam_width, nearest, cache, expansions);
+        }
+        if (expansions.empty()) {
+            break;
+        }
+
+        const std::size_t count = std::min(beam_width, expansions.size());
+        std::partial_sort(expansions.begin(), expansions.begin() + count, expansions.end(), [](const expansion_t& a, const expansion_t& b) {
+            return a.distance < b.distance || (a.distance == b.distance && (a.path < b.path || (a.path == b.path && a.track_id < b.track_id)));
+        });
+
+        std::vector<path_t> next;
+        next.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            const expansion_t& expansion = expansions[i];
+            next.push_back(beam[expansion.path]);
+            path_t& path = next.back();
+            path.track_ids.push_back(expansion.track_id);
+            path.rows.push_back(tag_row(expansion.track_id));
+            path.used.insert(expansion.track_id);
+            path.distance = expansion.distance;
+        }
+        beam.swap(next);
+    }
+
+    return beam.front().track_ids;
+}
+
+std::size_t PlaylistGenerator::tag_row(musly_trackid track_id) const
+{
+    auto it = m_tag_rows.find(track_id);
+    return it != m_tag_rows.end() ? it->second : _NO_ROW;
+}
+
+bool PlaylistGenerator::accepts(const path_t& path, musly_trackid track_id) const
+{
+    if (path.used.count(track_id) > 0 || m_excluded.count(track_id) > 0) {
+        return false;
+    }
+
+    const std::size_t row = tag_row(track_id);
+    if (row == _NO_ROW) {
+        return true;
+    }
+
+    const std::size_t columns = m_windows.size();
+    for (std::size_t column = 0; column < columns; ++column) {
+        const int tag = m_tags[row * columns + column];
+        const std::size_t window = static_cast<std::size_t>(std::max(m_windows[column], 0));
+        if (tag < 0 || window == 0) {
+            continue;
+        }
+
+        const std::size_t first = path.rows.size() > window ? path.rows.size() - window : 0;
+        for (std::size_t i = first; i < path.rows.size(); ++i) {
+            if (path.rows[i] != _NO_ROW && m_tags[path.rows[i] * columns + column] == tag) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void PlaylistGenerator::expand(const path_t& path, std::size_t path_index, std::size_t beam_width, const nearest_t& nearest,
+    neighbor_cache_t& cache, std::vector<expansion_t>& expansions) const
+{
+    const musly_trackid last = path.track_ids.back();
+    std::size_t k = std::max(_MIN_NEIGHBORS, 2 * beam_width);
+    for (;;) {
+        auto& cached = cache[last];
+        if (cached.first < k) {
+            cached.second = nearest(last, k);
+            cached.first = k;
+        }
+
+        const std::size_t begin = expansions.size();
+        for (const neighbor_t& neighbor : cached.second) {
+            if (accepts(path, neighbor.first)) {
+                expansions.push_back({ path.distance + neighbor.second, path_index, neighbor.first });
+                if (expansions.size() - begin == beam_width) {
+                    return;
+                }
+            }
+        }
+
+        // fewer neighbors than asked for means there are no others
+        if (cached.second.size() < cached.first) {
+            return;
+        }
+        expansions.resize(begin);
+        k = 2 * cached.first;
+    }
+}
+
+} // namespace pymusly
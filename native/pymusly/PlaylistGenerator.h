@@ -0,0 +1,94 @@
+#ifndef PYMUSLY_PLAYLIST_GENERATOR_H_
+#define PYMUSLY_PLAYLIST_GENERATOR_H_
+
+#include "common.h"
+
+#include <cstddef>
+#include <functional>
+#include <musly/musly_types.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * Builds playlists by walking from track to track through the similarity space.
+ *
+ * Starting at the seed tracks, every step appends one of the nearest neighbors of the last track.
+ * A beam search keeps the `beam_width` playlists with the lowest sum of similarities between
+ * consecutive tracks, a width of 1 is a greedy walk. Tracks never repeat and must satisfy the
+ * exclusions and tag rules.
+ *
+ * The generator only knows track ids, neighbors are supplied by the caller.
+ */
+class PYMUSLY_EXPORT PlaylistGenerator {
+public:
+    typedef std::pair<musly_trackid, float> neighbor_t;
+
+    /**
+     * The up to `k` tracks most similar to the given track, most similar first, without itself.
+     */
+    typedef std::function<std::vector<neighbor_t>(musly_trackid track_id, std::size_t k)> nearest_t;
+
+public:
+    PlaylistGenerator();
+
+    void exclude(const std::vector<musly_trackid>& track_ids);
+
+    /**
+     * Set `columns` tags for each of `count` tracks, stored row by row in `tags`. A track sharing a
+     * tag of column `c` with one of the previous `windows[c]` tracks of a playlist is not appended.
+     * Negative tags and tracks without tags are never rejected.
+     */
+    void set_tags(const musly_trackid* track_ids, const int* tags, std::size_t count, std::size_t columns, const std::vector<int>& windows);
+
+    /**
+     * The seeds followed by up to `length` tracks in total. The playlist is shorter if no more
+     * tracks satisfy the rules.
+     */
+    std::vector<musly_trackid> generate(const std::vector<musly_trackid>& seed_ids, std::size_t length, std::size_t beam_width,
+        const nearest_t& nearest) const;
+
+private:
+    static const std::size_t _NO_ROW = static_cast<std::size_t>(-1);
+
+    struct path_t {
+        std::vector<musly_trackid> track_ids;
+        std::vector<std::size_t> rows;
+        std::unordered_set<musly_trackid> used;
+        double distance;
+    };
+
+    struct expansion_t {
+        double distance;
+        std::size_t path;
+        musly_trackid track_id;
+    };
+
+    /**
+     * The neighbors of a track fetched so far along with the number that was asked for.
+     */
+    typedef std::unordered_map<musly_trackid, std::pair<std::size_t, std::vector<neighbor_t>>> neighbor_cache_t;
+
+    std::size_t tag_row(musly_trackid track_id) const;
+
+    bool accepts(const path_t& path, musly_trackid track_id) const;
+
+    /**
+     * Append the up to `beam_width` best tracks that may follow `path` to `expansions`, fetching
+     * more neighbors of its last track as long as too few of them are accepted.
+     */
+    void expand(const path_t& path, std::size_t path_index, std::size_t beam_width, const nearest_t& nearest,
+        neighbor_cache_t& cache, std::vector<expansion_t>& expansions) const;
+
+    std::unordered_set<musly_trackid> m_excluded;
+    std::unordered_map<musly_trackid, std::size_t> m_tag_rows;
+    std::vector<int> m_tags;
+    std::vector<int> m_windows;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_PLAYLIST_GENERATOR_H_
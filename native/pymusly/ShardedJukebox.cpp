@@ -0,0 +1,457 @@
+#include "ShardedJukebox.h"
+#include "gil.h"
+#include "musly_error.h"
+#include "ndarray.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <pybind11/stl.h>
+#include <queue>
+#include <tuple>
+
+namespace py = pybind11;
+
+namespace pymusly {
+
+ShardedJukebox* ShardedJukebox::open_mapped(const std::vector<std::string>& paths, bool ignore_decoder, unsigned int threads)
+{
+    if (paths.empty()) {
+        throw musly_error("at least one shard is required");
+    }
+
+    std::vector<std::unique_ptr<MuslyJukebox>> shards;
+    for (const std::string& path : paths) {
+        shards.emplace_back(MuslyJukebox::open_mapped(path, ignore_decoder));
+        if (std::string(shards.back()->method()) != shards.front()->method()) {
+            throw musly_error("failed loading shard '" + path + "': all shards must use the same method");
+        }
+    }
+
+    return new ShardedJukebox(std::move(shards), threads);
+}
+
+ShardedJukebox::ShardedJukebox(unsigned int shards, const char* method, const char* decoder, unsigned int threads)
+    : m_pool(std::min(threads > 0 ? threads : ThreadPool::hardware_threads(), std::max(shards, 1U)))
+{
+    if (shards == 0) {
+        throw musly_error("at least one shard is required");
+    }
+
+    for (unsigned int i = 0; i < shards; ++i) {
+        m_shards.emplace_back(new MuslyJukebox(method, decoder));
+    }
+}
+
+ShardedJukebox::ShardedJukebox(std::vector<std::unique_ptr<MuslyJukebox>> shards, unsigned int threads)
+    : m_shards(std::move(shards))
+    , m_pool(std::min<std::size_t>(threads > 0 ? threads : ThreadPool::hardware_threads(), m_shards.size()))
+{
+    // empty
+}
+
+std::size_t ShardedJukebox::shard_count() const
+{
+    return m_shards.size();
+}
+
+MuslyJukebox& ShardedJukebox::shard(std::size_t index)
+{
+    if (index >= m_shards.size()) {
+        throw py::index_error("shard index out of range");
+    }
+
+    return *m_shards[index];
+}
+
+std::size_t ShardedJukebox::shard_of(musly_trackid track_id) const
+{
+    const long long count = static_cast<long long>(m_shards.size());
+    return static_cast<std::size_t>((track_id % count + count) % count);
+}
+
+int ShardedJukebox::track_count() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex, std::defer_lock);
+    lock_without_gil(lock);
+
+    // all tracks are registered with every shard
+    return m_shards.front()->track_count();
+}
+
+std::vector<musly_trackid> ShardedJukebox::track_ids() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex, std::defer_lock);
+    lock_without_gil(lock);
+
+    return m_shards.front()->track_ids();
+}
+
+void ShardedJukebox::set_style(const std::vector<MuslyTrack*>& tracks)
+{
+    std::vector<musly_track*> musly_tracks(tracks.size());
+    std::transform(tracks.begin(), tracks.end(), musly_tracks.begin(), [](MuslyTrack* track) { return track->data(); });
+
+    py::gil_scoped_release release;
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    m_pool.parallel_for(m_shards.size(), [&](unsigned int, std::size_t shard) {
+        m_shards[shard]->apply_style(musly_tracks);
+    });
+}
+
+std::vector<musly_trackid> ShardedJukebox::add_tracks(const std::vector<MuslyTrack*>& tracks)
+{
+    std::vector<musly_track*> musly_tracks(tracks.size());
+    std::transform(tracks.begin(), tracks.end(), musly_tracks.begin(), [](MuslyTrack* track) { return track->data(); });
+
+    py::gil_scoped_release release;
+    return insert_tracks(musly_tracks, std::vector<musly_trackid>(tracks.size()), true);
+}
+
+std::vector<musly_trackid> ShardedJukebox::add_tracks(const std::vector<MuslyJukebox::track_tuple_t>& track_tuples)
+{
+    std::vector<musly_trackid> track_ids(track_tuples.size());
+    std::vector<musly_track*> musly_tracks(track_tuples.size());
+    for (std::size_t i = 0; i < track_tuples.size(); ++i) {
+        track_ids[i] = track_tuples[i].first;
+        musly_tracks[i] = track_tuples[i].second->data();
+    }
+
+    py::gil_scoped_release release;
+    return insert_tracks(musly_tracks, std::move(track_ids), false);
+}
+
+std::vector<musly_trackid> ShardedJukebox::insert_tracks(const std::vector<musly_track*>& tracks, std::vector<musly_trackid> track_ids, bool generate_ids)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    // ids are generated by the first shard and then used for all others
+    std::size_t first = 0;
+    if (generate_ids) {
+        track_ids = m_shards.front()->insert_tracks(tracks, std::move(track_ids), true,
+            [this](musly_trackid track_id) { return shard_of(track_id) == 0; });
+        first = 1;
+    }
+
+    // shards must agree on the registered tracks, so if any shard fails, the tracks are removed
+    // again from all shards that took them. Every worker only sets the flag of its own shard.
+    std::vector<char> inserted(m_shards.size(), 0);
+    inserted[0] = generate_ids ? 1 : 0;
+    try {
+        m_pool.parallel_for(m_shards.size() - first, [&](unsigned int, std::size_t i) {
+            const std::size_t shard = first + i;
+            m_shards[shard]->insert_tracks(tracks, track_ids, false,
+                [this, shard](musly_trackid track_id) { return shard_of(track_id) == shard; });
+            inserted[shard] = 1;
+        });
+    } catch (...) {
+        for (std::size_t shard = 0; shard < m_shards.size(); ++shard) {
+            if (inserted[shard]) {
+                try {
+                    m_shards[shard]->erase_tracks(track_ids);
+                } catch (...) {
+                    // report the original failure, there is nothing left to undo
+                }
+            }
+        }
+        throw;
+    }
+
+    return track_ids;
+}
+
+void ShardedJukebox::remove_tracks(const std::vector<musly_trackid>& track_ids)
+{
+    py::gil_scoped_release release;
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    // keep the data of the removed tracks, so they can be added back to the shards that removed
+    // them if any shard fails, like insert_tracks() undoes failed additions
+    std::vector<musly_trackid> removed_ids(track_ids);
+    std::sort(removed_ids.begin(), removed_ids.end());
+    removed_ids.erase(std::unique(removed_ids.begin(), removed_ids.end()), removed_ids.end());
+    std::vector<std::vector<musly_track>> removed_data(removed_ids.size());
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < removed_ids.size(); ++i) {
+        if (m_shards[shard_of(removed_ids[i])]->copy_track(removed_ids[i], removed_data[kept])) {
+            removed_ids[kept++] = removed_ids[i];
+        }
+    }
+    removed_ids.resize(kept);
+    removed_data.resize(kept);
+
+    std::vector<char> removed(m_shards.size(), 0);
+    try {
+        m_pool.parallel_for(m_shards.size(), [&](unsigned int, std::size_t shard) {
+            m_shards[shard]->erase_tracks(track_ids);
+            removed[shard] = 1;
+        });
+    } catch (...) {
+        std::vector<musly_track*> tracks(removed_data.size());
+        std::transform(removed_data.begin(), removed_data.end(), tracks.begin(), [](std::vector<musly_track>& track) { return track.data(); });
+        for (std::size_t shard = 0; shard < m_shards.size(); ++shard) {
+            if (removed[shard]) {
+                try {
+                    m_shards[shard]->insert_tracks(tracks, removed_ids, false,
+                        [this, shard](musly_trackid track_id) { return shard_of(track_id) == shard; });
+                } catch (...) {
+                    // report the original failure, there is nothing left to undo
+                }
+            }
+        }
+        throw;
+    }
+}
+
+std::vector<MuslyJukebox::neighbor_t> ShardedJukebox::nearest(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids)
+{
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    std::vector<musly_track> seed;
+    if (!m_shards[shard_of(seed_id)]->copy_track(seed_id, seed)) {
+        throw musly_error("no track data registered for seed track " + std::to_string(seed_id));
+    }
+    if (k <= 0) {
+        return {};
+    }
+
+    std::vector<std::vector<musly_trackid>> shard_candidates;
+    if (candidate_ids) {
+        shard_candidates.resize(m_shards.size());
+        for (musly_trackid track_id : *candidate_ids) {
+            shard_candidates[shard_of(track_id)].push_back(track_id);
+        }
+    }
+
+    // every shard scans the tracks it owns, results are ordered like in MuslyJukebox::nearest
+    std::vector<std::vector<MuslyJukebox::neighbor_t>> results(m_shards.size());
+    m_pool.parallel_for(m_shards.size(), [&](unsigned int, std::size_t shard) {
+        if (!candidate_ids || !shard_candidates[shard].empty()) {
+            results[shard] = m_shards[shard]->find_nearest(seed_id, seed.data(), k, candidate_ids ? &shard_candidates[shard] : nullptr);
+        }
+    });
+
+    // merge the sorted per-shard results with a heap holding the best remaining entry of each shard
+    typedef std::tuple<float, musly_trackid, std::size_t, std::size_t> entry_t;
+    std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> heap;
+    for (std::size_t shard = 0; shard < results.size(); ++shard) {
+        if (!results[shard].empty()) {
+            heap.emplace(results[shard][0].second, results[shard][0].first, shard, 0);
+        }
+    }
+
+    std::vector<MuslyJukebox::neighbor_t> neighbors;
+    neighbors.reserve(k);
+    while (!heap.empty() && neighbors.size() < static_cast<std::size_t>(k)) {
+        const entry_t entry = heap.top();
+        heap.pop();
+
+        const std::size_t shard = std::get<2>(entry);
+        const std::size_t next = std::get<3>(entry) + 1;
+        neighbors.emplace_back(std::get<1>(entry), std::get<0>(entry));
+        if (next < results[shard].size()) {
+            heap.emplace(results[shard][next].second, results[shard][next].first, shard, next);
+        }
+    }
+
+    return neighbors;
+}
+
+std::pair<py::array_t<musly_trackid>, py::array_t<float>> ShardedJukebox::nearest_array(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids)
+{
+    const std::vector<MuslyJukebox::neighbor_t> neighbors = nearest(seed_id, k, candidate_ids);
+
+    std::vector<musly_trackid> track_ids(neighbors.size());
+    std::vector<float> similarities(neighbors.size());
+    for (std::size_t i = 0; i < neighbors.size(); ++i) {
+        track_ids[i] = neighbors[i].first;
+        similarities[i] = neighbors[i].second;
+    }
+
+    return std::make_pair(to_ndarray(std::move(track_ids)), to_ndarray(std::move(similarities)));
+}
+
+void ShardedJukebox::save_mapped(const std::vector<std::string>& paths)
+{
+    if (paths.size() != m_shards.size()) {
+        throw musly_error("expected one path per shard");
+    }
+
+    std::shared_lock<std::shared_mutex> lock(m_mutex, std::defer_lock);
+    lock_without_gil(lock);
+
+    for (std::size_t shard = 0; shard < m_shards.size(); ++shard) {
+        m_shards[shard]->save_mapped(paths[shard]);
+    }
+}
+
+void ShardedJukebox::register_class(py::module_& module)
+{
+    py::class_<ShardedJukebox>(module, "ShardedJukebox", R"pbdoc(
+            A jukebox split into several MuslyJukebox shards that share one music style.
+
+            Tracks are assigned to shards by their id. Every shard registers all tracks with musly, so it can
+            normalize similarities to any seed, but keeps the track data only of the tracks assigned to it.
+            Neighbor queries run on all shards in parallel and their results are merged natively.
+        )pbdoc")
+        .def(py::init<unsigned int, const char*, const char*, unsigned int>(), py::arg("shards"), py::arg("method") = nullptr,
+            py::arg("decoder") = nullptr, py::arg("threads") = 0, R"pbdoc(
+            __init__(shards: int, method: str = None, decoder: str = None, threads: int = 0) -> None
+
+
+            Create a sharded jukebox with `shards` new jukeboxes using the given analysis method and audio decoder.
+
+            :param shards:
+                the number of shards, must be at least `1`.
+            :param method:
+                the method to use for audio data analysis, see :class:`MuslyJukebox`.
+            :param decoder:
+                the decoder to use to analyze audio data loaded from files, see :class:`MuslyJukebox`.
+            :param threads:
+                the number of native threads used to query the shards; `0` uses one per shard, but at most
+                one per CPU core.
+            :raises MuslyError:
+                if `shards` is `0` or the jukeboxes cannot be created.
+        )pbdoc")
+
+        .def_static("open_mapped", &ShardedJukebox::open_mapped, py::arg("paths"), py::arg("ignore_decoder") = true,
+            py::arg("threads") = 0, py::return_value_policy::take_ownership, R"pbdoc(
+            open_mapped(paths: list[str], ignore_decoder: bool = True, threads: int = 0) -> ShardedJukebox
+
+
+            Open shards previously written with :func:`save_mapped`, in the same order.
+
+            :param paths:
+                the paths to the shard files.
+            :param ignore_decoder:
+                when `True`, the shards will use the default decoder, in case the original decoder is not available.
+            :param threads:
+                the number of native threads used to query the shards.
+            :return: the sharded jukebox
+            :raises MuslyError: if a shard cannot be opened or the shards use different methods
+        )pbdoc")
+
+        .def_property_readonly("shard_count", &ShardedJukebox::shard_count, R"pbdoc(
+            The number of shards.
+        )pbdoc")
+
+        .def_property_readonly("track_count", &ShardedJukebox::track_count, R"pbdoc(
+            The number of tracks in the jukebox.
+        )pbdoc")
+
+        .def_property_readonly("track_ids", &ShardedJukebox::track_ids, R"pbdoc(
+            A list of all track ids in the jukebox.
+        )pbdoc")
+
+        .def("shard", &ShardedJukebox::shard, py::arg("index"), py::return_value_policy::reference_internal, R"pbdoc(
+            shard(index: int) -> MuslyJukebox
+
+
+            Return the jukebox of a shard, e.g. to serialize it on its own.
+
+            Each shard is a complete jukebox that can be loaded on its own. Modifying a shard directly
+            makes it inconsistent with the other shards.
+
+            :param index:
+                the index of the shard.
+            :raises IndexError:
+                if there is no shard with the given index.
+        )pbdoc")
+
+        .def("shard_of", &ShardedJukebox::shard_of, py::arg("track_id"), R"pbdoc(
+            shard_of(track_id: int) -> int
+
+
+            Return the index of the shard keeping the data of the given track.
+        )pbdoc")
+
+        .def("set_style", &ShardedJukebox::set_style, py::arg("tracks"), R"pbdoc(
+            set_style(tracks: list[MuslyTrack]) -> None
+
+
+            Set the music style of all shards, see :func:`MuslyJukebox.set_style`.
+
+            :raises MuslyError:
+                if the the given tracks cannot be used to set the style.
+        )pbdoc")
+
+        .def("add_tracks", py::overload_cast<const std::vector<MuslyTrack*>&>(&ShardedJukebox::add_tracks), py::arg("tracks"), R"pbdoc(
+            add_tracks(tracks: list[tuple[int,MuslyTrack]]) -> list[int]
+            add_tracks(tracks: list[MuslyTrack]) -> list[int]
+
+            Register tracks with all shards and store their data in the shards they are assigned to.
+
+            See :func:`MuslyJukebox.add_tracks`.
+
+            Every shard registers all tracks with musly, so adding tracks takes about as much musly work per
+            shard as adding them to a single jukebox. If any shard fails, the tracks are removed from all shards
+            again.
+
+            :return:
+                a list containing the ids of the tracks that were added.
+            :raises MuslyError:
+                if the given tracks cannot be added, i.e. :func:`set_style` has not been called yet.
+        )pbdoc")
+
+        .def("add_tracks", py::overload_cast<const std::vector<MuslyJukebox::track_tuple_t>&>(&ShardedJukebox::add_tracks), py::arg("tracks"))
+
+        .def("remove_tracks", &ShardedJukebox::remove_tracks, py::arg("track_ids"), R"pbdoc(
+            remove_tracks(track_ids: list[int]) -> None
+
+
+            Remove tracks from all shards.
+
+            The data of the removed tracks is copied first, so if any shard fails, the tracks are added back to
+            the shards that already removed them.
+
+            :raises MuslyError:
+                if the tracks cannot be removed from a shard.
+        )pbdoc")
+
+        .def("nearest", &ShardedJukebox::nearest, py::arg("seed_id"), py::arg("k"), py::arg("candidate_ids") = py::none(), R"pbdoc(
+            nearest(seed_id: int, k: int, candidate_ids: list[int] = None) -> list[tuple[int,float]]
+
+
+            Find the `k` tracks most similar to the seed track across all shards.
+
+            Every shard computes its own top `k` tracks on a separate thread; the results are merged into the
+            overall top `k`, ordered like the result of :func:`MuslyJukebox.nearest`.
+
+            :param seed_id:
+                the id of the seed track.
+            :param k:
+                the maximum number of neighbors to return.
+            :param candidate_ids:
+                restrict the search to these track ids. All tracks are considered when `None`.
+            :return:
+                a list of `(track_id, similarity)` tuples, most similar first.
+            :raises MuslyError:
+                if no track data is registered for the seed track.
+        )pbdoc")
+
+        .def("nearest_array", &ShardedJukebox::nearest_array, py::arg("seed_id"), py::arg("k"), py::arg("candidate_ids") = py::none(), R"pbdoc(
+            nearest_array(seed_id: int, k: int, candidate_ids: list[int] = None) -> tuple[numpy.ndarray, numpy.ndarray]
+
+
+            Like :func:`nearest`, but return the neighbor ids and similarities as two `numpy.ndarray`.
+        )pbdoc")
+
+        .def("save_mapped", &ShardedJukebox::save_mapped, py::arg("paths"), R"pbdoc(
+            save_mapped(paths: list[str]) -> None
+
+
+            Write every shard into its own file, see :func:`MuslyJukebox.save_mapped`.
+
+            Each file can be opened on its own with :func:`MuslyJukebox.open_mapped`, e.g. in a separate process,
+            or together with the others with :func:`open_mapped`.
+
+            :param paths:
+                one path per shard.
+            :raises MuslyError:
+                if the number of paths does not match the number of shards or a shard cannot be written.
+        )pbdoc");
+}
+
+} // namespace pymusly
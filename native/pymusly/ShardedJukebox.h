@@ -0,0 +1,77 @@
+#ifndef PYMUSLY_SHARDED_JUKEBOX_H_
+#define PYMUSLY_SHARDED_JUKEBOX_H_
+
+#include "MuslyJukebox.h"
+#include "MuslyTrack.h"
+#include "ThreadPool.h"
+#include "common.h"
+
+#include <cstddef>
+#include <memory>
+#include <musly/musly_types.h>
+#include <optional>
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * A set of MuslyJukebox shards sharing one music style, partitioned by track id.
+ *
+ * Every track is registered with musly in all shards, which repeats musly's work for added tracks
+ * in every shard. musly normalizes the similarities to a seed with data it keeps for the seed's
+ * track id, and a query scans every shard with the same seed, so each shard needs that data for
+ * all tracks. The track data itself is only kept by the shard owning the track, so neighbor
+ * queries scan each track exactly once.
+ */
+class PYMUSLY_EXPORT ShardedJukebox {
+public:
+    static ShardedJukebox* open_mapped(const std::vector<std::string>& paths, bool ignore_decoder = true, unsigned int threads = 0);
+
+    static void register_class(pybind11::module_& module);
+
+public:
+    ShardedJukebox(unsigned int shards, const char* method = nullptr, const char* decoder = nullptr, unsigned int threads = 0);
+
+    std::size_t shard_count() const;
+
+    MuslyJukebox& shard(std::size_t index);
+
+    std::size_t shard_of(musly_trackid track_id) const;
+
+    int track_count() const;
+
+    std::vector<musly_trackid> track_ids() const;
+
+    void set_style(const std::vector<MuslyTrack*>& tracks);
+
+    std::vector<musly_trackid> add_tracks(const std::vector<MuslyTrack*>& tracks);
+
+    std::vector<musly_trackid> add_tracks(const std::vector<MuslyJukebox::track_tuple_t>& track_tuples);
+
+    void remove_tracks(const std::vector<musly_trackid>& track_ids);
+
+    std::vector<MuslyJukebox::neighbor_t> nearest(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids = std::nullopt);
+
+    std::pair<pybind11::array_t<musly_trackid>, pybind11::array_t<float>> nearest_array(musly_trackid seed_id, int k, const std::optional<std::vector<musly_trackid>>& candidate_ids = std::nullopt);
+
+    void save_mapped(const std::vector<std::string>& paths);
+
+private:
+    ShardedJukebox(std::vector<std::unique_ptr<MuslyJukebox>> shards, unsigned int threads);
+
+    std::vector<musly_trackid> insert_tracks(const std::vector<musly_track*>& tracks, std::vector<musly_trackid> track_ids, bool generate_ids);
+
+    std::vector<std::unique_ptr<MuslyJukebox>> m_shards;
+    ThreadPool m_pool;
+
+    // keeps the shards consistent with each other, modifications are applied to all of them
+    mutable std::shared_mutex m_mutex;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_SHARDED_JUKEBOX_H_
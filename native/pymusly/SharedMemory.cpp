@@ -0,0 +1,189 @@
+#include "SharedMemory.h"
+#include "musly_error.h"
+
+#if defined(__linux__)
+#include <filesystem>
+#include <system_error>
+#endif
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// POSIX only guarantees portable behavior for names with a single leading slash
+std::string object_name(const std::string& name)
+{
+    if (name.empty() || name.find('/', 1) != std::string::npos || name == "/") {
+        throw pymusly::musly_error("invalid shared memory name: '" + name + "'");
+    }
+
+    return name[0] == '/' ? name : "/" + name;
+}
+
+} // namespace
+
+namespace pymusly {
+
+#if defined(_WIN32)
+
+std::unique_ptr<SharedMemory> SharedMemory::create(const std::string& name, std::size_t size)
+{
+    throw musly_error("shared memory jukeboxes are not supported on Windows");
+}
+
+std::shared_ptr<SharedMemory> SharedMemory::open(const std::string& name)
+{
+    throw musly_error("shared memory jukeboxes are not supported on Windows");
+}
+
+bool SharedMemory::remove(const std::string& name)
+{
+    throw musly_error("shared memory jukeboxes are not supported on Windows");
+}
+
+bool SharedMemory::renamable()
+{
+    return false;
+}
+
+void SharedMemory::rename(const std::string& from, const std::string& to)
+{
+    throw musly_error("shared memory jukeboxes are not supported on Windows");
+}
+
+SharedMemory::~SharedMemory()
+{
+    // empty
+}
+
+#else
+
+std::unique_ptr<SharedMemory> SharedMemory::create(const std::string& name, std::size_t size)
+{
+    const std::string object = object_name(name);
+
+    // processes that mapped the old object keep it until they unmap it
+    shm_unlink(object.c_str());
+    const int fd = shm_open(object.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw musly_error("could not create shared memory: " + name);
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        shm_unlink(object.c_str());
+        throw musly_error("could not allocate " + std::to_string(size) + " bytes of shared memory: " + name);
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(object.c_str());
+        throw musly_error("could not map shared memory: " + name);
+    }
+
+    return std::unique_ptr<SharedMemory>(new SharedMemory(static_cast<unsigned char*>(data), size, true));
+}
+
+std::shared_ptr<SharedMemory> SharedMemory::open(const std::string& name)
+{
+    const std::string object = object_name(name);
+    const int fd = shm_open(object.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw musly_error("could not open shared memory: " + name);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        throw musly_error("could not get size of shared memory: " + name);
+    }
+    const std::size_t size = static_cast<std::size_t>(info.st_size);
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw musly_error("could not map shared memory: " + name);
+    }
+
+    return std::shared_ptr<SharedMemory>(new SharedMemory(static_cast<unsigned char*>(data), size, false));
+}
+
+bool SharedMemory::remove(const std::string& name)
+{
+    return shm_unlink(object_name(name).c_str()) == 0;
+}
+
+#if defined(__linux__)
+
+// glibc implements shm_open() with files in /dev/shm, POSIX has no way to rename an object
+const char _SHM_DIRECTORY[] = "/dev/shm";
+
+bool SharedMemory::renamable()
+{
+    std::error_code error;
+    return std::filesystem::is_directory(_SHM_DIRECTORY, error);
+}
+
+void SharedMemory::rename(const std::string& from, const std::string& to)
+{
+    std::error_code error;
+    std::filesystem::rename(_SHM_DIRECTORY + object_name(from), _SHM_DIRECTORY + object_name(to), error);
+    if (error) {
+        throw musly_error("could not rename shared memory " + from + " to " + to + ": " + error.message());
+    }
+}
+
+#else
+
+bool SharedMemory::renamable()
+{
+    return false;
+}
+
+void SharedMemory::rename(const std::string& from, const std::string& to)
+{
+    throw musly_error("shared memory cannot be renamed on this platform: " + from);
+}
+
+#endif
+
+SharedMemory::~SharedMemory()
+{
+    munmap(m_data, m_size);
+}
+
+#endif
+
+SharedMemory::SharedMemory(unsigned char* data, std::size_t size, bool writable)
+    : m_data(data)
+    , m_size(size)
+    , m_writable(writable)
+{
+    // empty
+}
+
+const unsigned char* SharedMemory::data() const
+{
+    return m_data;
+}
+
+unsigned char* SharedMemory::writable_data()
+{
+    if (!m_writable) {
+        throw musly_error("shared memory is mapped read-only");
+    }
+
+    return m_data;
+}
+
+std::size_t SharedMemory::size() const
+{
+    return m_size;
+}
+
+} // namespace pymusly
@@ -0,0 +1,70 @@
+#ifndef PYMUSLY_SHARED_MEMORY_H_
+#define PYMUSLY_SHARED_MEMORY_H_
+
+#include "common.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace pymusly {
+
+/**
+ * A mapping of a named POSIX shared memory object.
+ *
+ * Objects live in memory until they are removed, independent of the process that created them,
+ * and every process mapping the same object shares its pages. Removing an object only removes its
+ * name, existing mappings stay valid. Not available on Windows.
+ */
+class PYMUSLY_EXPORT SharedMemory {
+public:
+    /**
+     * Create an object of `size` bytes mapped for writing, replacing any object of the same name.
+     */
+    static std::unique_ptr<SharedMemory> create(const std::string& name, std::size_t size);
+
+    /**
+     * Map an existing object read-only.
+     */
+    static std::shared_ptr<SharedMemory> open(const std::string& name);
+
+    /**
+     * Remove the name of an object, returns false if there is no object with that name.
+     */
+    static bool remove(const std::string& name);
+
+    /**
+     * Whether objects can be renamed, which is the case where they are files in `/dev/shm`.
+     */
+    static bool renamable();
+
+    /**
+     * Atomically give object `from` the name `to`, replacing any object of that name.
+     * Requires renamable().
+     */
+    static void rename(const std::string& from, const std::string& to);
+
+public:
+    ~SharedMemory();
+
+    const unsigned char* data() const;
+
+    unsigned char* writable_data();
+
+    std::size_t size() const;
+
+private:
+    SharedMemory(unsigned char* data, std::size_t size, bool writable);
+
+    SharedMemory(const SharedMemory&) = delete;
+
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    unsigned char* m_data;
+    std::size_t m_size;
+    bool m_writable;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_SHARED_MEMORY_H_
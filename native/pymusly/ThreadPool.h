@@ -0,0 +1,153 @@
+#ifndef PYMUSLY_THREAD_POOL_H_
+#define PYMUSLY_THREAD_POOL_H_
+
+#include "common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * A fixed size pool of native worker threads.
+ *
+ * Tasks run without holding the GIL, so they must not touch any Python object.
+ */
+class PYMUSLY_EXPORT ThreadPool {
+public:
+    static unsigned int hardware_threads()
+    {
+        const unsigned int threads = std::thread::hardware_concurrency();
+        return threads > 0 ? threads : 1;
+    }
+
+public:
+    explicit ThreadPool(unsigned int threads = 0)
+    {
+        if (threads == 0) {
+            threads = hardware_threads();
+        }
+
+        m_workers.reserve(threads);
+        for (unsigned int i = 0; i < threads; ++i) {
+            m_workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(m_workers.size());
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push(std::move(task));
+        }
+        m_condition.notify_one();
+    }
+
+    /**
+     * Call `fn(slot, index)` for every index in [0, count) and block until all calls returned.
+     *
+     * `slot` identifies the calling worker in the range [0, min(size(), count)), which allows
+     * callers to keep per-worker state without locking. The first exception thrown by `fn`
+     * is rethrown once all workers are done. Must not be called from a task of the same pool.
+     */
+    template <typename Fn>
+    void parallel_for(std::size_t count, Fn&& fn)
+    {
+        const unsigned int slots = static_cast<unsigned int>(std::min<std::size_t>(size(), count));
+        if (slots == 0) {
+            return;
+        }
+
+        std::atomic<std::size_t> next_index(0);
+        std::exception_ptr error;
+        std::mutex done_mutex;
+        std::condition_variable done_condition;
+        unsigned int running = slots;
+
+        for (unsigned int slot = 0; slot < slots; ++slot) {
+            submit([&, slot] {
+                try {
+                    for (std::size_t i = next_index++; i < count; i = next_index++) {
+                        fn(slot, i);
+                    }
+                } catch (...) {
+                    next_index = count;
+                    std::lock_guard<std::mutex> lock(done_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(done_mutex);
+                if (--running == 0) {
+                    done_condition.notify_all();
+                }
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_condition.wait(lock, [&] { return running == 0; });
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void run()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+                if (m_tasks.empty()) {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_THREAD_POOL_H_
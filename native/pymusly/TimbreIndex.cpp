@@ -0,0 +1,129 @@
+#include "TimbreIndex.h"
+
+#include <cstring>
+
+// compile the kernel for several instruction sets and pick the best one when the module is
+// loaded. Other platforms get the baseline build, which is NEON on aarch64.
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define PYMUSLY_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define PYMUSLY_TARGET_CLONES
+#endif
+
+namespace {
+
+// tracks are scanned in blocks, so the mean differences of a block stay in the L1 cache
+const std::size_t _BLOCK_SIZE = 256;
+
+std::size_t packed_elements(int dimension)
+{
+    return static_cast<std::size_t>(dimension) * (dimension + 1) / 2;
+}
+
+/**
+ * Add the weighted element `e` = (i, k) of the symmetric KL divergence for `count` tracks.
+ *
+ * tr(S^-1 C) + tr(C^-1 S) + d^T (S^-1 + C^-1) d for seed S and candidate C, with the diagonal
+ * of the packed matrices counting once and all other elements twice.
+ */
+PYMUSLY_TARGET_CLONES
+void accumulate(std::size_t count, float weight, float seed_covar, float seed_inverse,
+    const float* __restrict covar, const float* __restrict inverse,
+    const float* __restrict delta_i, const float* __restrict delta_k, float* __restrict out)
+{
+    const float a = weight * seed_inverse;
+    const float b = weight * seed_covar;
+    for (std::size_t j = 0; j < count; ++j) {
+        out[j] += a * covar[j] + b * inverse[j] + weight * delta_i[j] * delta_k[j] * (seed_inverse + inverse[j]);
+    }
+}
+
+PYMUSLY_TARGET_CLONES
+void difference(std::size_t count, float seed_mu, const float* __restrict mu, float* __restrict out)
+{
+    for (std::size_t j = 0; j < count; ++j) {
+        out[j] = mu[j] - seed_mu;
+    }
+}
+
+} // namespace
+
+namespace pymusly {
+
+int TimbreIndex::dimension_for(const char* method, std::size_t track_size)
+{
+    if (method == nullptr || std::strcmp(method, "timbre") != 0) {
+        return 0;
+    }
+
+    // a track holds d + 2 * d * (d + 1) / 2 floats
+    const std::size_t floats = track_size / sizeof(float);
+    for (int dimension = 1; packed_elements(dimension) <= floats; ++dimension) {
+        if (dimension + 2 * packed_elements(dimension) == floats && floats * sizeof(float) == track_size) {
+            return dimension;
+        }
+    }
+
+    return 0;
+}
+
+TimbreIndex::TimbreIndex(int dimension, const TrackStore& track_store)
+    : m_dimension(dimension)
+    , m_elements(packed_elements(dimension))
+    , m_track_ids(track_store.track_ids())
+{
+    const std::size_t features = m_dimension + 2 * m_elements;
+
+    // pad columns to whole blocks, so the kernel never needs a remainder loop across columns
+    m_stride = (m_track_ids.size() + _BLOCK_SIZE - 1) / _BLOCK_SIZE * _BLOCK_SIZE;
+    m_columns.assign(features * m_stride, 0.0F);
+
+    std::vector<musly_track> buffer(track_store.track_floats());
+    for (std::size_t j = 0; j < m_track_ids.size(); ++j) {
+        const float* track = reinterpret_cast<const float*>(track_store.get(m_track_ids[j], buffer.data()));
+        for (std::size_t f = 0; f < features; ++f) {
+            m_columns[f * m_stride + j] = track[f];
+        }
+    }
+}
+
+std::size_t TimbreIndex::size() const
+{
+    return m_track_ids.size();
+}
+
+void TimbreIndex::divergence(const musly_track* seed, float* out) const
+{
+    const float* seed_mu = reinterpret_cast<const float*>(seed);
+    const float* seed_covar = seed_mu + m_dimension;
+    const float* seed_inverse = seed_covar + m_elements;
+
+    const float* mu = m_columns.data();
+    const float* covar = mu + m_dimension * m_stride;
+    const float* inverse = covar + m_elements * m_stride;
+
+    std::vector<float> delta(m_dimension * _BLOCK_SIZE);
+    std::vector<float> sums(_BLOCK_SIZE);
+    for (std::size_t begin = 0; begin < m_track_ids.size(); begin += _BLOCK_SIZE) {
+        for (int i = 0; i < m_dimension; ++i) {
+            difference(_BLOCK_SIZE, seed_mu[i], mu + i * m_stride + begin, delta.data() + i * _BLOCK_SIZE);
+        }
+
+        std::fill(sums.begin(), sums.end(), 0.0F);
+        std::size_t e = 0;
+        for (int i = 0; i < m_dimension; ++i) {
+            for (int k = i; k < m_dimension; ++k, ++e) {
+                accumulate(_BLOCK_SIZE, i == k ? 1.0F : 2.0F, seed_covar[e], seed_inverse[e],
+                    covar + e * m_stride + begin, inverse + e * m_stride + begin,
+                    delta.data() + i * _BLOCK_SIZE, delta.data() + k * _BLOCK_SIZE, sums.data());
+            }
+        }
+
+        const std::size_t count = std::min(_BLOCK_SIZE, m_track_ids.size() - begin);
+        for (std::size_t j = 0; j < count; ++j) {
+            out[begin + j] = 0.25F * sums[j] - 0.5F * m_dimension;
+        }
+    }
+}
+
+} // namespace pymusly
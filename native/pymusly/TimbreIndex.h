@@ -0,0 +1,83 @@
+#ifndef PYMUSLY_TIMBRE_INDEX_H_
+#define PYMUSLY_TIMBRE_INDEX_H_
+
+#include "TrackStore.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <musly/musly_types.h>
+#include <utility>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * Gaussian timbre models of stored tracks in a structure-of-arrays layout for fast scans.
+ *
+ * A track of musly's `timbre` method holds the mean of a single Gaussian followed by its covariance
+ * and inverse covariance matrices, each packed as upper triangle. Every element is kept in a column
+ * of its own, so the divergence between a seed and all tracks is computed with contiguous vector
+ * loads instead of chasing one track pointer after the other.
+ *
+ * The index computes the symmetric Kullback-Leibler divergence of the raw models. musly normalizes
+ * that distance with the statistics of each track (mutual proximity), which it keeps internally,
+ * so the index only ranks candidates for an exact computation by musly.
+ */
+class PYMUSLY_EXPORT TimbreIndex {
+public:
+    typedef std::pair<float, musly_trackid> candidate_t;
+
+    /**
+     * The dimension of the Gaussians in tracks of `track_size` bytes, or 0 if such tracks do not
+     * have the layout of the timbre method.
+     */
+    static int dimension_for(const char* method, std::size_t track_size);
+
+public:
+    TimbreIndex(int dimension, const TrackStore& track_store);
+
+    std::size_t size() const;
+
+    /**
+     * The `count` tracks with the lowest divergence to `seed`, ordered by divergence and id.
+     *
+     * Only tracks accepted by `accept(track_id)` are considered.
+     */
+    template <typename Accept>
+    std::vector<candidate_t> closest(const musly_track* seed, std::size_t count, Accept accept) const
+    {
+        std::vector<float> divergences(m_track_ids.size());
+        divergence(seed, divergences.data());
+
+        std::vector<candidate_t> candidates;
+        candidates.reserve(m_track_ids.size());
+        for (std::size_t i = 0; i < m_track_ids.size(); ++i) {
+            if (accept(m_track_ids[i])) {
+                candidates.emplace_back(divergences[i], m_track_ids[i]);
+            }
+        }
+
+        count = std::min(count, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+        candidates.resize(count);
+
+        return candidates;
+    }
+
+    /**
+     * Write the divergence between `seed` and every indexed track to `out`, in index order.
+     */
+    void divergence(const musly_track* seed, float* out) const;
+
+private:
+    const int m_dimension;
+    const std::size_t m_elements;
+    std::size_t m_stride;
+    std::vector<musly_trackid> m_track_ids;
+    std::vector<float> m_columns;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_TIMBRE_INDEX_H_
@@ -0,0 +1,194 @@
+#include "TrackAnalyzer.h"
+#include "musly_error.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+namespace pymusly {
+
+TrackAnalyzer::TrackAnalyzer(MuslyJukebox& jukebox, float window, float hop)
+    : m_jukebox(jukebox)
+    , m_start(0)
+    , m_size(0)
+    , m_hop(0)
+    , m_until_analysis(0)
+{
+    if (!(window > 0.0F) || hop < 0.0F) {
+        throw musly_error("window must be positive and hop must not be negative");
+    }
+
+    m_buffer.resize(static_cast<std::size_t>(std::lround(window * SAMPLE_RATE)));
+    m_hop = static_cast<std::size_t>(std::lround(hop * SAMPLE_RATE));
+    m_until_analysis = m_buffer.size();
+}
+
+std::size_t TrackAnalyzer::window_samples() const
+{
+    return m_buffer.size();
+}
+
+std::size_t TrackAnalyzer::buffered_samples() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_size;
+}
+
+std::vector<MuslyTrack*> TrackAnalyzer::feed(MuslyJukebox::pcm_array_t pcm_chunk)
+{
+    const float* samples = pcm_chunk.data();
+    std::size_t count = pcm_chunk.size();
+    std::vector<std::unique_ptr<MuslyTrack>> tracks;
+
+    {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // without a hop, samples are only collected until finish() is called
+        while (count > 0) {
+            const std::size_t pushed = m_hop > 0 ? std::min(count, m_until_analysis) : count;
+            push(samples, pushed);
+            samples += pushed;
+            count -= pushed;
+
+            if (m_hop > 0 && (m_until_analysis -= pushed) == 0) {
+                tracks.emplace_back(new MuslyTrack(analyze()));
+                m_until_analysis = m_hop;
+            }
+        }
+    }
+
+    std::vector<MuslyTrack*> result(tracks.size());
+    std::transform(tracks.begin(), tracks.end(), result.begin(), [](std::unique_ptr<MuslyTrack>& track) { return track.release(); });
+
+    return result;
+}
+
+MuslyTrack* TrackAnalyzer::finish()
+{
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_size == 0) {
+        throw musly_error("no pcm data to analyze");
+    }
+
+    MuslyTrack* track = new MuslyTrack(analyze());
+    m_start = m_size = 0;
+    m_until_analysis = m_buffer.size();
+
+    return track;
+}
+
+void TrackAnalyzer::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_start = m_size = 0;
+    m_until_analysis = m_buffer.size();
+}
+
+void TrackAnalyzer::push(const float* samples, std::size_t count)
+{
+    const std::size_t capacity = m_buffer.size();
+
+    // only the newest samples fit into the window
+    if (count >= capacity) {
+        std::copy(samples + count - capacity, samples + count, m_buffer.begin());
+        m_start = 0;
+        m_size = capacity;
+        return;
+    }
+
+    const std::size_t end = (m_start + m_size) % capacity;
+    const std::size_t head = std::min(count, capacity - end);
+    std::copy(samples, samples + head, m_buffer.begin() + end);
+    std::copy(samples + head, samples + count, m_buffer.begin());
+
+    if (m_size + count > capacity) {
+        m_start = (m_start + m_size + count - capacity) % capacity;
+        m_size = capacity;
+    } else {
+        m_size += count;
+    }
+}
+
+musly_track* TrackAnalyzer::analyze()
+{
+    // rotate the ring buffer in place so the window is contiguous
+    if (m_start != 0) {
+        std::rotate(m_buffer.begin(), m_buffer.begin() + m_start, m_buffer.end());
+        m_start = 0;
+    }
+
+    return m_jukebox.analyze_pcm(m_buffer.data(), m_size);
+}
+
+void TrackAnalyzer::register_class(py::module_& module)
+{
+    py::class_<TrackAnalyzer>(module, "TrackAnalyzer", "Incremental analysis of PCM streams")
+        .def(py::init<MuslyJukebox&, float, float>(), py::arg("jukebox"), py::arg("window") = 30.0F, py::arg("hop") = 0.0F,
+            py::keep_alive<1, 2>(), R"pbdoc(
+            __init__(jukebox: MuslyJukebox, window: float = 30.0, hop: float = 0.0) -> None
+
+
+            Create an analyzer that turns a stream of PCM chunks into MuslyTracks using the given jukebox.
+
+            At most `window` seconds of samples are kept natively. Older samples are discarded as new chunks arrive.
+
+            :param jukebox:
+                the jukebox used for the analysis.
+            :param window:
+                the length of the analyzed excerpt in seconds.
+            :param hop:
+                when greater than `0`, :func:`feed` analyzes the current window every `hop` seconds of fed samples,
+                once the first window is complete. When `0`, tracks are only created by :func:`finish`.
+            :raises MuslyError:
+                if `window` is not positive or `hop` is negative.
+        )pbdoc")
+
+        .def_property_readonly("window_samples", &TrackAnalyzer::window_samples, R"pbdoc(
+            The maximum number of samples analyzed at once.
+        )pbdoc")
+
+        .def_property_readonly("buffered_samples", &TrackAnalyzer::buffered_samples, R"pbdoc(
+            The number of samples currently kept for the next analysis.
+        )pbdoc")
+
+        .def("feed", &TrackAnalyzer::feed, py::arg("pcm_chunk"), py::return_value_policy::take_ownership, R"pbdoc(
+            feed(pcm_chunk: numpy.ndarray | list[float]) -> list[MuslyTrack]
+
+
+            Append samples of a mono 22050Hz signal to the stream.
+
+            :param pcm_chunk:
+                the next samples of the stream, preferably as contiguous float32 buffer.
+            :return:
+                the tracks of all sliding windows completed by this chunk; always empty when `hop` is `0`.
+            :raises MuslyError:
+                if a window cannot be analyzed.
+        )pbdoc")
+
+        .def("finish", &TrackAnalyzer::finish, py::return_value_policy::take_ownership, R"pbdoc(
+            finish() -> MuslyTrack
+
+
+            Analyze the currently buffered samples and reset the analyzer.
+
+            :raises MuslyError:
+                if no samples are buffered or they cannot be analyzed.
+        )pbdoc")
+
+        .def("reset", &TrackAnalyzer::reset, R"pbdoc(
+            reset() -> None
+
+
+            Discard all buffered samples.
+        )pbdoc");
+}
+
+} // namespace pymusly
@@ -0,0 +1,55 @@
+#ifndef PYMUSLY_TRACK_ANALYZER_H_
+#define PYMUSLY_TRACK_ANALYZER_H_
+
+#include "MuslyJukebox.h"
+#include "MuslyTrack.h"
+#include "common.h"
+
+#include <cstddef>
+#include <mutex>
+#include <pybind11/pybind11.h>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * Incremental analysis of a PCM stream.
+ *
+ * Samples are collected in a ring buffer holding at most one analysis window.
+ */
+class PYMUSLY_EXPORT TrackAnalyzer {
+public:
+    static const int SAMPLE_RATE = 22050;
+
+    static void register_class(pybind11::module_& module);
+
+public:
+    TrackAnalyzer(MuslyJukebox& jukebox, float window = 30.0F, float hop = 0.0F);
+
+    std::size_t window_samples() const;
+
+    std::size_t buffered_samples() const;
+
+    std::vector<MuslyTrack*> feed(MuslyJukebox::pcm_array_t pcm_chunk);
+
+    MuslyTrack* finish();
+
+    void reset();
+
+private:
+    void push(const float* samples, std::size_t count);
+
+    musly_track* analyze();
+
+    MuslyJukebox& m_jukebox;
+    std::vector<float> m_buffer;
+    std::size_t m_start;
+    std::size_t m_size;
+    std::size_t m_hop;
+    std::size_t m_until_analysis;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_TRACK_ANALYZER_H_
@@ -0,0 +1,219 @@
+#include "TrackCodec.h"
+#include "musly_error.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const float _INT8_LEVELS = 255.0F;
+
+std::uint32_t float_bits(float value)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float bits_float(std::uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// IEEE 754 binary32 to binary16 with round to nearest even, like F16C's vcvtps2ph
+std::uint16_t float_to_half(float value)
+{
+    const std::uint32_t bits = float_bits(value);
+    const std::uint16_t sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000);
+    const std::uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {
+        // infinity stays infinity, nan stays a quiet nan
+        return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00);
+    }
+    if (magnitude >= 0x477ff000) {
+        // rounds to a value beyond the largest half
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000) {
+        // subnormal half, shift the mantissa including its implicit bit into place
+        if (magnitude < 0x33000000) {
+            return sign;
+        }
+        const std::uint32_t exponent = magnitude >> 23;
+        const std::uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        const std::uint32_t shift = 126 - exponent;
+        std::uint32_t half = mantissa >> shift;
+        const std::uint32_t remainder = mantissa & ((1U << shift) - 1);
+        const std::uint32_t halfway = 1U << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1))) {
+            ++half;
+        }
+        return sign | static_cast<std::uint16_t>(half);
+    }
+
+    std::uint32_t half = (magnitude - 0x38000000) >> 13;
+    const std::uint32_t remainder = magnitude & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        ++half;
+    }
+    return sign | static_cast<std::uint16_t>(half);
+}
+
+float half_to_float(std::uint16_t half)
+{
+    const std::uint32_t sign = static_cast<std::uint32_t>(half & 0x8000) << 16;
+    const std::uint32_t exponent = (half >> 10) & 0x1f;
+    const std::uint32_t mantissa = half & 0x3ff;
+
+    if (exponent == 0x1f) {
+        return bits_float(sign | 0x7f800000 | (mantissa << 13));
+    }
+    if (exponent == 0) {
+        // zero or subnormal, mantissa * 2^-24
+        const float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+} // namespace
+
+namespace pymusly {
+
+TrackCodec::encoding_t TrackCodec::parse_encoding(const std::string& name)
+{
+    if (name == "float32") {
+        return FLOAT32;
+    }
+    if (name == "float16") {
+        return FLOAT16;
+    }
+    if (name == "int8") {
+        return INT8;
+    }
+    throw musly_error("unknown track storage '" + name + "', expected 'float32', 'float16' or 'int8'");
+}
+
+const char* TrackCodec::encoding_name(encoding_t encoding)
+{
+    switch (encoding) {
+    case FLOAT16:
+        return "float16";
+    case INT8:
+        return "int8";
+    default:
+        return "float32";
+    }
+}
+
+TrackCodec TrackCodec::create(encoding_t encoding, std::size_t floats, const std::vector<float>& minimum, const std::vector<float>& maximum)
+{
+    if (encoding != INT8) {
+        return TrackCodec(encoding, floats, {});
+    }
+    if (minimum.size() != floats || maximum.size() != floats) {
+        throw musly_error("invalid value ranges for int8 track encoding");
+    }
+
+    // offset and scale of every value position
+    std::vector<float> parameters(2 * floats);
+    for (std::size_t f = 0; f < floats; ++f) {
+        const bool valid = minimum[f] < maximum[f];
+        parameters[2 * f] = minimum[f] <= maximum[f] ? minimum[f] : 0.0F;
+        parameters[2 * f + 1] = valid ? (maximum[f] - minimum[f]) / _INT8_LEVELS : 1.0F;
+    }
+
+    return TrackCodec(encoding, floats, std::move(parameters));
+}
+
+TrackCodec TrackCodec::restore(encoding_t encoding, std::size_t floats, const std::vector<float>& parameters)
+{
+    if (encoding != FLOAT32 && encoding != FLOAT16 && encoding != INT8) {
+        throw musly_error("unknown track encoding");
+    }
+    if (parameters.size() != (encoding == INT8 ? 2 * floats : 0)) {
+        throw musly_error("invalid track encoding parameters");
+    }
+
+    return TrackCodec(encoding, floats, parameters);
+}
+
+TrackCodec::TrackCodec(encoding_t encoding, std::size_t floats, std::vector<float> parameters)
+    : m_encoding(encoding)
+    , m_floats(floats)
+    , m_parameters(std::move(parameters))
+{
+}
+
+TrackCodec::encoding_t TrackCodec::encoding() const
+{
+    return m_encoding;
+}
+
+std::size_t TrackCodec::floats() const
+{
+    return m_floats;
+}
+
+std::size_t TrackCodec::encoded_size() const
+{
+    switch (m_encoding) {
+    case FLOAT16:
+        return m_floats * sizeof(std::uint16_t);
+    case INT8:
+        return m_floats;
+    default:
+        return m_floats * sizeof(float);
+    }
+}
+
+void TrackCodec::encode(const float* track, unsigned char* out) const
+{
+    switch (m_encoding) {
+    case FLOAT16:
+        for (std::size_t f = 0; f < m_floats; ++f) {
+            const std::uint16_t half = float_to_half(track[f]);
+            std::memcpy(out + f * sizeof(half), &half, sizeof(half));
+        }
+        break;
+    case INT8:
+        for (std::size_t f = 0; f < m_floats; ++f) {
+            const float level = std::round((track[f] - m_parameters[2 * f]) / m_parameters[2 * f + 1]);
+            out[f] = static_cast<unsigned char>(std::isnan(level) ? 0.0F : std::min(std::max(level, 0.0F), _INT8_LEVELS));
+        }
+        break;
+    default:
+        std::memcpy(out, track, m_floats * sizeof(float));
+    }
+}
+
+void TrackCodec::decode(const unsigned char* record, float* out) const
+{
+    switch (m_encoding) {
+    case FLOAT16:
+        for (std::size_t f = 0; f < m_floats; ++f) {
+            std::uint16_t half;
+            std::memcpy(&half, record + f * sizeof(half), sizeof(half));
+            out[f] = half_to_float(half);
+        }
+        break;
+    case INT8:
+        for (std::size_t f = 0; f < m_floats; ++f) {
+            out[f] = m_parameters[2 * f] + record[f] * m_parameters[2 * f + 1];
+        }
+        break;
+    default:
+        std::memcpy(out, record, m_floats * sizeof(float));
+    }
+}
+
+const std::vector<float>& TrackCodec::parameters() const
+{
+    return m_parameters;
+}
+
+} // namespace pymusly
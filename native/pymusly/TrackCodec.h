@@ -0,0 +1,72 @@
+#ifndef PYMUSLY_TRACK_CODEC_H_
+#define PYMUSLY_TRACK_CODEC_H_
+
+#include "common.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * Encoding of track data in a TrackStore.
+ *
+ * `FLOAT32` keeps the data as is. `FLOAT16` stores every value as IEEE half precision float,
+ * `INT8` as one byte scaled per value position to the range of that position over the tracks the
+ * codec was created for. Values outside of that range are clamped.
+ */
+class PYMUSLY_EXPORT TrackCodec {
+public:
+    enum encoding_t : std::uint32_t {
+        FLOAT32 = 0,
+        FLOAT16 = 1,
+        INT8 = 2
+    };
+
+    static encoding_t parse_encoding(const std::string& name);
+
+    static const char* encoding_name(encoding_t encoding);
+
+    /**
+     * A codec for tracks of `floats` values. `INT8` codecs spread the levels of every value position
+     * over the range from `minimum` to `maximum` of that position.
+     */
+    static TrackCodec create(encoding_t encoding, std::size_t floats, const std::vector<float>& minimum = {}, const std::vector<float>& maximum = {});
+
+    /**
+     * Restore a codec from the output of `parameters()`.
+     */
+    static TrackCodec restore(encoding_t encoding, std::size_t floats, const std::vector<float>& parameters);
+
+public:
+    encoding_t encoding() const;
+
+    std::size_t floats() const;
+
+    /**
+     * The size of an encoded track in bytes.
+     */
+    std::size_t encoded_size() const;
+
+    void encode(const float* track, unsigned char* out) const;
+
+    void decode(const unsigned char* record, float* out) const;
+
+    /**
+     * The values needed to restore the codec, i.e. the offset and scale of every position for `INT8`.
+     */
+    const std::vector<float>& parameters() const;
+
+private:
+    TrackCodec(encoding_t encoding, std::size_t floats, std::vector<float> parameters);
+
+    encoding_t m_encoding;
+    std::size_t m_floats;
+    std::vector<float> m_parameters;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_TRACK_CODEC_H_
@@ -0,0 +1,221 @@
+#include "TrackStore.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace pymusly {
+
+TrackStore::TrackStore(std::size_t track_size, std::shared_ptr<const TrackCodec> codec)
+    : m_track_size(track_size)
+    , m_codec(codec ? std::move(codec) : std::make_shared<const TrackCodec>(TrackCodec::create(TrackCodec::FLOAT32, (track_size + sizeof(musly_track) - 1) / sizeof(musly_track))))
+    , m_stride((m_codec->encoded_size() + sizeof(musly_track) - 1) / sizeof(musly_track))
+    , m_slot_end(0)
+    , m_mapped_index(nullptr)
+    , m_mapped_index_size(0)
+    , m_mapped_records(nullptr)
+    , m_mapped_record_stride(0)
+{
+    // empty
+}
+
+std::size_t TrackStore::track_size() const
+{
+    return m_track_size;
+}
+
+std::size_t TrackStore::track_floats() const
+{
+    return m_codec->floats();
+}
+
+const std::shared_ptr<const TrackCodec>& TrackStore::codec() const
+{
+    return m_codec;
+}
+
+bool TrackStore::compact() const
+{
+    return m_codec->encoding() != TrackCodec::FLOAT32;
+}
+
+std::size_t TrackStore::record_size() const
+{
+    return m_stride * sizeof(musly_track);
+}
+
+std::size_t TrackStore::size() const
+{
+    return m_slots.size() + m_mapped_index_size - m_mapped_hidden.size();
+}
+
+void TrackStore::put(musly_trackid track_id, const musly_track* track)
+{
+    auto it = m_slots.find(track_id);
+    const std::size_t slot = it != m_slots.end() ? it->second : allocate_slot();
+
+    m_codec->encode(track, reinterpret_cast<unsigned char*>(writable_slot_data(slot)));
+    m_slots[track_id] = slot;
+
+    // mapped records are read-only, so an owned copy shadows them
+    if (find_mapped(track_id) != nullptr) {
+        m_mapped_hidden.insert(track_id);
+    }
+}
+
+void TrackStore::remove(musly_trackid track_id)
+{
+    auto it = m_slots.find(track_id);
+    if (it != m_slots.end()) {
+        m_free_slots.push_back(it->second);
+        m_slots.erase(it);
+    }
+
+    if (find_mapped(track_id) != nullptr) {
+        m_mapped_hidden.insert(track_id);
+    }
+}
+
+bool TrackStore::contains(musly_trackid track_id) const
+{
+    return m_slots.count(track_id) > 0 || is_mapped_visible(track_id);
+}
+
+musly_track* TrackStore::get(musly_trackid track_id, musly_track* buffer) const
+{
+    const unsigned char* record = find_record(track_id);
+    if (record == nullptr) {
+        return nullptr;
+    }
+    if (compact()) {
+        m_codec->decode(record, buffer);
+        return buffer;
+    }
+
+    // musly never writes to tracks it compares, so handing out mapped records is safe
+    return const_cast<musly_track*>(reinterpret_cast<const musly_track*>(record));
+}
+
+bool TrackStore::read(musly_trackid track_id, musly_track* out) const
+{
+    const unsigned char* record = find_record(track_id);
+    if (record == nullptr) {
+        return false;
+    }
+
+    m_codec->decode(record, out);
+    return true;
+}
+
+std::vector<musly_trackid> TrackStore::track_ids() const
+{
+    std::vector<musly_trackid> track_ids;
+    track_ids.reserve(size());
+    for (const auto& entry : m_slots) {
+        track_ids.push_back(entry.first);
+    }
+    for (std::size_t i = 0; i < m_mapped_index_size; ++i) {
+        if (is_mapped_visible(m_mapped_index[i].track_id)) {
+            track_ids.push_back(m_mapped_index[i].track_id);
+        }
+    }
+
+    return track_ids;
+}
+
+void TrackStore::attach(std::shared_ptr<const void> owner, const index_entry_t* index, std::size_t index_size,
+    const unsigned char* records, std::size_t record_stride)
+{
+    m_mapped_owner = std::move(owner);
+    m_mapped_index = index;
+    m_mapped_index_size = index_size;
+    m_mapped_records = records;
+    m_mapped_record_stride = record_stride;
+    m_mapped_hidden.clear();
+}
+
+std::size_t TrackStore::record_count() const
+{
+    return m_slot_end + m_mapped_index_size - m_mapped_hidden.size();
+}
+
+std::vector<TrackStore::index_entry_t> TrackStore::record_index() const
+{
+    std::vector<index_entry_t> index;
+    index.reserve(size());
+    for (const auto& entry : m_slots) {
+        index.push_back({ entry.first, static_cast<std::uint32_t>(entry.second) });
+    }
+
+    std::uint32_t record = static_cast<std::uint32_t>(m_slot_end);
+    for (std::size_t i = 0; i < m_mapped_index_size; ++i) {
+        if (is_mapped_visible(m_mapped_index[i].track_id)) {
+            index.push_back({ m_mapped_index[i].track_id, record++ });
+        }
+    }
+
+    std::sort(index.begin(), index.end(), [](const index_entry_t& a, const index_entry_t& b) { return a.track_id < b.track_id; });
+
+    return index;
+}
+
+musly_track* TrackStore::slot_data(std::size_t slot) const
+{
+    return m_pages[slot / PAGE_SLOTS].get() + (slot % PAGE_SLOTS) * m_stride;
+}
+
+musly_track* TrackStore::writable_slot_data(std::size_t slot)
+{
+    // copy pages shared with another store before writing into them
+    std::shared_ptr<musly_track[]>& page = m_pages[slot / PAGE_SLOTS];
+    if (page.use_count() > 1) {
+        std::shared_ptr<musly_track[]> copy(new musly_track[PAGE_SLOTS * m_stride]);
+        std::memcpy(copy.get(), page.get(), PAGE_SLOTS * m_stride * sizeof(musly_track));
+        page = std::move(copy);
+    }
+
+    return slot_data(slot);
+}
+
+std::size_t TrackStore::allocate_slot()
+{
+    if (!m_free_slots.empty()) {
+        const std::size_t slot = m_free_slots.back();
+        m_free_slots.pop_back();
+        return slot;
+    }
+
+    if (m_slot_end == m_pages.size() * PAGE_SLOTS) {
+        m_pages.emplace_back(new musly_track[PAGE_SLOTS * m_stride]());
+    }
+
+    return m_slot_end++;
+}
+
+const unsigned char* TrackStore::find_record(musly_trackid track_id) const
+{
+    auto it = m_slots.find(track_id);
+    if (it != m_slots.end()) {
+        return reinterpret_cast<const unsigned char*>(slot_data(it->second));
+    }
+
+    return is_mapped_visible(track_id) ? find_mapped(track_id) : nullptr;
+}
+
+const unsigned char* TrackStore::find_mapped(musly_trackid track_id) const
+{
+    const index_entry_t* end = m_mapped_index + m_mapped_index_size;
+    const index_entry_t* it = std::lower_bound(m_mapped_index, end, track_id,
+        [](const index_entry_t& entry, musly_trackid id) { return entry.track_id < id; });
+    if (it == end || it->track_id != track_id) {
+        return nullptr;
+    }
+
+    return m_mapped_records + it->record * m_mapped_record_stride;
+}
+
+bool TrackStore::is_mapped_visible(musly_trackid track_id) const
+{
+    return m_mapped_index_size > 0 && m_mapped_hidden.count(track_id) == 0 && find_mapped(track_id) != nullptr;
+}
+
+} // namespace pymusly
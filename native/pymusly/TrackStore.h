@@ -0,0 +1,156 @@
+#ifndef PYMUSLY_TRACK_STORE_H_
+#define PYMUSLY_TRACK_STORE_H_
+
+#include "TrackCodec.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <musly/musly_types.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * Native copies of the track data registered with a jukebox, keyed by track id.
+ *
+ * Tracks are stored in fixed-size slots of an arena made of pages of PAGE_SLOTS tracks each,
+ * so track pointers stay valid while the arena grows. Slots of removed tracks are reused.
+ *
+ * Copies of a store share their pages until one side writes into a shared page, which then
+ * gets copied first. Tracks added after a copy usually end up in pages of their own.
+ *
+ * Besides its own tracks, the store can reference read-only track records of a memory mapped
+ * jukebox file. Those are looked up through an index sorted by track id, so attaching them
+ * does not touch the records themselves.
+ *
+ * Tracks are kept in the encoding of the store's TrackCodec, mapped records included. Unless
+ * that is `FLOAT32`, readers get decoded copies of the tracks instead of pointers into the store.
+ */
+class PYMUSLY_EXPORT TrackStore {
+public:
+    static const std::size_t PAGE_SLOTS = 1024;
+
+    struct index_entry_t {
+        musly_trackid track_id;
+        std::uint32_t record;
+    };
+
+public:
+    explicit TrackStore(std::size_t track_size, std::shared_ptr<const TrackCodec> codec = nullptr);
+
+    std::size_t track_size() const;
+
+    /**
+     * The number of values of a decoded track, i.e. the size of buffers passed to get() and read().
+     */
+    std::size_t track_floats() const;
+
+    const std::shared_ptr<const TrackCodec>& codec() const;
+
+    /**
+     * Whether tracks are stored in another encoding than `FLOAT32`.
+     */
+    bool compact() const;
+
+    std::size_t record_size() const;
+
+    std::size_t size() const;
+
+    /**
+     * Store a copy of `track`. Invalidates pointers into the page of its slot, in case that page
+     * was shared with a copy of this store.
+     */
+    void put(musly_trackid track_id, const musly_track* track);
+
+    void remove(musly_trackid track_id);
+
+    bool contains(musly_trackid track_id) const;
+
+    /**
+     * The data of a track, or nullptr if the track is unknown. Compact tracks are decoded into
+     * `buffer`, other tracks are returned in place and may be passed to musly as they are.
+     */
+    musly_track* get(musly_trackid track_id, musly_track* buffer) const;
+
+    /**
+     * Copy the decoded data of a track into `out`. Returns false if the track is unknown.
+     */
+    bool read(musly_trackid track_id, musly_track* out) const;
+
+    std::vector<musly_trackid> track_ids() const;
+
+    void attach(std::shared_ptr<const void> owner, const index_entry_t* index, std::size_t index_size,
+        const unsigned char* records, std::size_t record_stride);
+
+    /**
+     * The number of records written by write_records().
+     */
+    std::size_t record_count() const;
+
+    /**
+     * The position of every stored track in the output of write_records(), sorted by track id.
+     */
+    std::vector<index_entry_t> record_index() const;
+
+    /**
+     * Pass all tracks as records of record_size() bytes to `write(data, size)`.
+     *
+     * Arena pages are written as a whole, including unused slots, followed by the records of
+     * tracks that only exist in an attached mapping.
+     */
+    template <typename Writer>
+    void write_records(Writer&& write) const
+    {
+        for (std::size_t page = 0; page * PAGE_SLOTS < m_slot_end; ++page) {
+            const std::size_t slots = std::min(PAGE_SLOTS, m_slot_end - page * PAGE_SLOTS);
+            write(reinterpret_cast<const char*>(m_pages[page].get()), slots * record_size());
+        }
+
+        std::vector<char> record(record_size(), 0);
+        for (std::size_t i = 0; i < m_mapped_index_size; ++i) {
+            const musly_trackid track_id = m_mapped_index[i].track_id;
+            if (is_mapped_visible(track_id)) {
+                std::memcpy(record.data(), find_mapped(track_id), m_codec->encoded_size());
+                write(record.data(), record.size());
+            }
+        }
+    }
+
+private:
+    musly_track* slot_data(std::size_t slot) const;
+
+    musly_track* writable_slot_data(std::size_t slot);
+
+    std::size_t allocate_slot();
+
+    const unsigned char* find_record(musly_trackid track_id) const;
+
+    const unsigned char* find_mapped(musly_trackid track_id) const;
+
+    bool is_mapped_visible(musly_trackid track_id) const;
+
+    std::size_t m_track_size;
+    std::shared_ptr<const TrackCodec> m_codec;
+    std::size_t m_stride;
+    std::vector<std::shared_ptr<musly_track[]>> m_pages;
+    std::size_t m_slot_end;
+    std::vector<std::size_t> m_free_slots;
+    std::unordered_map<musly_trackid, std::size_t> m_slots;
+
+    std::shared_ptr<const void> m_mapped_owner;
+    const index_entry_t* m_mapped_index;
+    std::size_t m_mapped_index_size;
+    const unsigned char* m_mapped_records;
+    std::size_t m_mapped_record_stride;
+    std::unordered_set<musly_trackid> m_mapped_hidden;
+};
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_TRACK_STORE_H_
@@ -0,0 +1,27 @@
+#ifndef PYMUSLY_GIL_H_
+#define PYMUSLY_GIL_H_
+
+#include <pybind11/pybind11.h>
+
+namespace pymusly {
+
+/**
+ * Acquire `lock` without holding the GIL.
+ *
+ * A thread blocking on a lock while holding the GIL could otherwise deadlock with a lock owner
+ * that needs the GIL, e.g. when serializing into a Python stream.
+ */
+template <typename Lock>
+void lock_without_gil(Lock& lock)
+{
+    if (PyGILState_Check()) {
+        pybind11::gil_scoped_release release;
+        lock.lock();
+    } else {
+        lock.lock();
+    }
+}
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_GIL_H_
@@ -1,5 +1,10 @@
+#include "AsyncCall.h"
+#include "IngestPipeline.h"
+#include "JukeboxSnapshot.h"
 #include "MuslyJukebox.h"
 #include "MuslyTrack.h"
+#include "ShardedJukebox.h"
+#include "TrackAnalyzer.h"
 #include "common.h"
 #include "musly_error.h"
 
@@ -12,7 +17,7 @@
 namespace py = pybind11;
 using namespace pymusly;
 
-PYBIND11_MODULE(_pymusly, module)
+PYBIND11_MODULE(_pymusly, module, py::mod_gil_not_used())
 {
     py::options options;
     options.disable_function_signatures();
@@ -52,8 +57,13 @@ PYBIND11_MODULE(_pymusly, module)
     )pbdoc");
 
     MuslyJukebox::register_class(module);
+    JukeboxSnapshot::register_class(module);
     MuslyTrack::register_class(module);
+    ShardedJukebox::register_class(module);
+    TrackAnalyzer::register_class(module);
+    IngestPipeline::register_class(module);
     musly_error::register_with_module(module);
+    AsyncCall::register_with_module(module);
 
 #ifdef VERSION_INFO
     module.attr("__version__") = MACRO_STRINGIFY(VERSION_INFO);
@@ -0,0 +1,33 @@
+#ifndef PYMUSLY_NDARRAY_H_
+#define PYMUSLY_NDARRAY_H_
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <vector>
+
+namespace pymusly {
+
+/**
+ * Wrap a vector into a numpy.ndarray of the given shape without copying its elements.
+ *
+ * The vector is moved onto the heap and released by a capsule once the array is garbage collected.
+ */
+template <typename T>
+pybind11::array_t<T> to_ndarray(std::vector<T>&& values, std::vector<pybind11::ssize_t> shape)
+{
+    std::vector<T>* data = new std::vector<T>(std::move(values));
+    pybind11::capsule owner(data, [](void* ptr) { delete reinterpret_cast<std::vector<T>*>(ptr); });
+
+    return pybind11::array_t<T>(std::move(shape), data->data(), owner);
+}
+
+template <typename T>
+pybind11::array_t<T> to_ndarray(std::vector<T>&& values)
+{
+    const pybind11::ssize_t size = values.size();
+    return to_ndarray(std::move(values), { size });
+}
+
+} // namespace pymusly
+
+#endif // !PYMUSLY_NDARRAY_H_
@@ -8,9 +8,13 @@ from ._pymusly import (
     set_musly_loglevel,
     musly_jukebox_listmethods as _musly_list_methods,
     musly_jukebox_listdecoders as _musly_list_decoders,
+    IngestPipeline,
+    JukeboxSnapshot,
     MuslyJukebox,
     MuslyTrack,
     MuslyError,
+    ShardedJukebox,
+    TrackAnalyzer,
 )
 
 __doc__ = """
@@ -39,7 +43,11 @@ __all__ = [
     "set_musly_loglevel",
     "get_musly_methods",
     "get_musly_decoders",
+    "IngestPipeline",
+    "JukeboxSnapshot",
     "MuslyJukebox",
     "MuslyTrack",
     "MuslyError",
+    "ShardedJukebox",
+    "TrackAnalyzer",
 ]
@@ -1,6 +1,8 @@
 import os.path
 import platform
 
+import pymusly as m
+
 _test_dir = os.path.dirname(__file__)
 
 FIXTURE_DIR = os.path.abspath(os.path.join(_test_dir, "fixtures"))
@@ -20,3 +22,28 @@ def is_macos_platform():
 
 def is_windows_platform():
     return platform.system() == "Windows"
+
+
+def analyze_samples(jukebox):
+    """Analyze the full length of each sample fixture with ``jukebox``."""
+    return [
+        jukebox.track_from_audiofile(
+            to_fixture_path(f"sample-{n}s.mp3"), length=n, start=0
+        )
+        for n in (15, 12, 9)
+    ]
+
+
+def sample_jukebox(track_ids=(1, 2, 3), method=None):
+    """
+    A jukebox styled with the sample tracks, which are added under ``track_ids``
+    in turn. Returns the jukebox and the sample tracks.
+    """
+    jukebox = m.MuslyJukebox(method=method)
+    tracks = analyze_samples(jukebox)
+    jukebox.set_style(tracks)
+    jukebox.add_tracks(
+        [(track_id, tracks[i % len(tracks)]) for i, track_id in enumerate(track_ids)]
+    )
+
+    return jukebox, tracks
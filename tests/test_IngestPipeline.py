@@ -0,0 +1,59 @@
+import os
+
+import pytest
+
+import pymusly as m
+
+from tests.helper import to_fixture_path
+
+
+def test_init_invalid():
+    jukebox = m.MuslyJukebox()
+
+    with pytest.raises(m.MuslyError):
+        m.IngestPipeline(jukebox, 10, 0, read_threads=0)
+    with pytest.raises(m.MuslyError):
+        m.IngestPipeline(jukebox, 10, 0, readahead=0)
+
+
+def test_run():
+    jukebox = m.MuslyJukebox()
+    pipeline = m.IngestPipeline(
+        jukebox, length=9, start=0, read_threads=2, analysis_threads=2, readahead=1
+    )
+    filenames = [
+        to_fixture_path("sample-15s.mp3"),
+        to_fixture_path("does-not-exist.mp3"),
+        to_fixture_path("sample-9s.mp3"),
+    ]
+
+    results = pipeline.run(filenames)
+
+    assert len(results) == 3
+    assert isinstance(results[0][0], m.MuslyTrack) and results[0][1] is None
+    assert results[1][0] is None and "does-not-exist.mp3" in results[1][1]
+    assert isinstance(results[2][0], m.MuslyTrack) and results[2][1] is None
+    assert jukebox.serialize_track(results[0][0]) == jukebox.serialize_track(
+        jukebox.track_from_audiofile(filenames[0], 9, 0)
+    )
+
+
+def test_run_empty():
+    pipeline = m.IngestPipeline(m.MuslyJukebox(), 10, 0)
+
+    assert pipeline.run([]) == []
+
+
+def test_stats():
+    pipeline = m.IngestPipeline(m.MuslyJukebox(), 10, 0)
+    filenames = [to_fixture_path("sample-12s.mp3"), to_fixture_path("sample-9s.mp3")]
+
+    pipeline.run(filenames)
+    stats = pipeline.stats()
+
+    assert stats["read"]["files"] == 2
+    assert stats["read"]["bytes"] == sum(os.path.getsize(f) for f in filenames)
+    assert stats["analysis"]["files"] == 2
+    assert stats["analysis"]["busy_seconds"] > 0
+    assert stats["queued"] == 0
+    assert stats["readahead"] == 16
@@ -0,0 +1,76 @@
+import pymusly as m
+
+from tests.helper import sample_jukebox
+
+
+def test_snapshot_queries():
+    jukebox, _ = sample_jukebox()
+    snapshot = jukebox.snapshot()
+
+    assert snapshot.method == jukebox.method
+    assert snapshot.track_count == 3
+    assert sorted(snapshot.track_ids) == [1, 2, 3]
+    assert snapshot.compute_similarity(1, [2, 3]) == jukebox.compute_similarity(
+        1, [2, 3]
+    )
+    assert snapshot.nearest(1, k=2) == jukebox.nearest(1, k=2)
+
+
+def test_snapshot_is_not_modified():
+    jukebox, tracks = sample_jukebox()
+    snapshot = jukebox.snapshot()
+    expected = snapshot.nearest(1, k=2)
+
+    jukebox.remove_tracks([2])
+    jukebox.add_tracks([(2, tracks[2]), (4, tracks[1])])
+
+    assert sorted(snapshot.track_ids) == [1, 2, 3]
+    assert snapshot.nearest(1, k=2) == expected
+    assert sorted(jukebox.snapshot().track_ids) == [1, 2, 3, 4]
+
+
+def test_snapshot_save_mapped(tmp_path):
+    jukebox, _ = sample_jukebox()
+    snapshot = jukebox.snapshot()
+    jukebox.remove_tracks([3])
+    path = str(tmp_path / "snapshot.jukebox")
+
+    snapshot.save_mapped(path)
+    jukebox2 = m.MuslyJukebox.open_mapped(path)
+
+    assert sorted(jukebox2.track_ids) == [1, 2, 3]
+    assert jukebox2.nearest(1, k=2) == snapshot.nearest(1, k=2)
+
+
+def test_snapshot_graph_index():
+    jukebox, tracks = sample_jukebox(range(300))
+    jukebox.build_graph_index(max_neighbors=8, ef_construction=50, threads=2)
+    jukebox.graph_search_ef = 8
+    snapshot = jukebox.snapshot()
+    expected = jukebox.nearest(0, k=5)
+
+    assert snapshot.nearest(0, k=5) == expected
+
+    jukebox.add_tracks([(1000, tracks[0])])
+    jukebox.drop_graph_index()
+
+    assert snapshot.nearest(0, k=5) == expected
+
+
+def test_snapshot_vectorized_prefilter():
+    jukebox, tracks = sample_jukebox(range(1200), method="timbre")
+    jukebox.vectorized_prefilter = True
+    expected = jukebox.nearest(0, k=5)
+    snapshot = jukebox.snapshot()
+
+    assert snapshot.vectorized_prefilter
+    assert snapshot.nearest(0, k=5) == expected
+    assert snapshot.nearest(0, k=2, candidate_ids=[1, 2, 3]) == jukebox.nearest(
+        0, k=2, candidate_ids=[1, 2, 3]
+    )
+
+    jukebox.vectorized_prefilter = False
+    jukebox.add_tracks([(5000, tracks[0])])
+
+    assert snapshot.vectorized_prefilter
+    assert snapshot.nearest(0, k=5) == expected
@@ -1,15 +1,23 @@
+import array
+import asyncio
 import io
 import platform
 import random
+import shutil
+import struct
+from concurrent.futures import ThreadPoolExecutor
 
+import numpy as np
 import pytest
 
 import pymusly as m
 
 from tests.helper import (
+    analyze_samples,
     is_linux_platform,
     is_macos_platform,
     is_windows_platform,
+    sample_jukebox,
     to_fixture_path,
 )
 
@@ -77,6 +85,23 @@ def test_track_from_audiodata():
     assert isinstance(track, m.MuslyTrack)
 
 
+def test_track_from_audiodata_buffers():
+    jukebox = m.MuslyJukebox()
+    noise = np.random.default_rng(42).random(22050 * 10, dtype=np.float32)
+
+    expected = jukebox.serialize_track(jukebox.track_from_audiodata(noise.tolist()))
+
+    assert jukebox.serialize_track(jukebox.track_from_audiodata(noise)) == expected
+    assert (
+        jukebox.serialize_track(jukebox.track_from_audiodata(memoryview(noise)))
+        == expected
+    )
+    assert (
+        jukebox.serialize_track(jukebox.track_from_audiodata(array.array("f", noise)))
+        == expected
+    )
+
+
 def test_track_from_audiodata_invalid():
     jukebox = m.MuslyJukebox()
 
@@ -84,6 +109,68 @@ def test_track_from_audiodata_invalid():
         jukebox.track_from_audiodata([])
 
 
+def test_analyze_files():
+    jukebox = m.MuslyJukebox()
+    filenames = [
+        to_fixture_path("sample-15s.mp3"),
+        to_fixture_path("does-not-exist.mp3"),
+        to_fixture_path("sample-9s.mp3"),
+    ]
+
+    results = jukebox.analyze_files(filenames, length=9, start=0, threads=2)
+
+    assert len(results) == 3
+    assert isinstance(results[0][0], m.MuslyTrack) and results[0][1] is None
+    assert results[1][0] is None and "does-not-exist.mp3" in results[1][1]
+    assert isinstance(results[2][0], m.MuslyTrack) and results[2][1] is None
+
+
+def test_analyze_files_matches_track_from_audiofile():
+    jukebox = m.MuslyJukebox()
+    filename = to_fixture_path("sample-12s.mp3")
+
+    [(track, _)] = jukebox.analyze_files([filename], length=12, start=0)
+    expected = jukebox.track_from_audiofile(filename, length=12, start=0)
+
+    assert jukebox.serialize_track(track) == jukebox.serialize_track(expected)
+
+
+def test_analysis_cache(tmp_path):
+    jukebox = m.MuslyJukebox()
+    filename = to_fixture_path("sample-15s.mp3")
+    expected = jukebox.serialize_track(jukebox.track_from_audiofile(filename, 10, 0))
+
+    assert jukebox.analysis_cache is None
+
+    jukebox.analysis_cache = str(tmp_path / "cache")
+    first = jukebox.track_from_audiofile(filename, 10, 0)
+    second = jukebox.track_from_audiofile(filename, 10, 0)
+    (batch, error), = jukebox.analyze_files([filename], 10, 0)
+
+    assert jukebox.analysis_cache == str(tmp_path / "cache")
+    assert len(list((tmp_path / "cache").glob("*.track"))) == 1
+    assert jukebox.serialize_track(first) == expected
+    assert jukebox.serialize_track(second) == expected
+    assert error is None and jukebox.serialize_track(batch) == expected
+
+    jukebox.track_from_audiofile(filename, 5, 0)
+
+    assert len(list((tmp_path / "cache").glob("*.track"))) == 2
+    assert len(list((tmp_path / "cache").glob("*.ref"))) == 2
+
+    copy = tmp_path / "copy.mp3"
+    shutil.copyfile(filename, copy)
+    copied = jukebox.track_from_audiofile(str(copy), 10, 0)
+
+    assert jukebox.serialize_track(copied) == expected
+    assert len(list((tmp_path / "cache").glob("*.track"))) == 2
+    assert len(list((tmp_path / "cache").glob("*.ref"))) == 3
+
+    jukebox.analysis_cache = None
+
+    assert jukebox.analysis_cache is None
+
+
 def test_serialize_to_stream():
     jukebox = m.MuslyJukebox()
     stream = io.BytesIO()
@@ -111,6 +198,139 @@ def test_create_from_stream():
     assert jukebox2.track_count == jukebox.track_count
 
 
+def test_create_from_stream_position(tmp_path):
+    jukebox = m.MuslyJukebox()
+    stream = io.BytesIO()
+    jukebox.serialize_to_stream(stream)
+    stream.write(b"tail")
+    path = tmp_path / "tail.jukebox"
+    path.write_bytes(stream.getvalue())
+
+    stream.seek(0)
+    m.MuslyJukebox.create_from_stream(stream, ignore_decoder=False)
+    with open(path, "rb") as fh:
+        m.MuslyJukebox.create_from_stream(fh, ignore_decoder=False)
+        file_tail = fh.read()
+
+    assert stream.read() == b"tail"
+    assert file_tail == b"tail"
+
+
+def test_create_from_unseekable_stream_position():
+    class Pipe(io.RawIOBase):
+        def __init__(self, data):
+            self._stream = io.BytesIO(data)
+
+        def readable(self):
+            return True
+
+        def readinto(self, buffer):
+            return self._stream.readinto(buffer)
+
+    jukebox, _ = sample_jukebox()
+    stream = io.BytesIO()
+    jukebox.serialize_to_stream(stream)
+    stream.write(b"tail")
+    pipe = io.BufferedReader(Pipe(stream.getvalue()))
+
+    jukebox2 = m.MuslyJukebox.create_from_stream(pipe)
+
+    assert not pipe.seekable()
+    assert pipe.read() == b"tail"
+    assert jukebox2.nearest(1, k=2) == jukebox.nearest(1, k=2)
+
+
+def test_create_from_read_only_stream():
+    class ReadOnlyStream:
+        def __init__(self, data):
+            self._stream = io.BytesIO(data)
+
+        def read(self, size):
+            return self._stream.read(size)
+
+    with open(to_fixture_path("wrong_decoder.jukebox"), "rb") as fh:
+        stream = ReadOnlyStream(fh.read())
+
+    jukebox = m.MuslyJukebox.create_from_stream(stream, ignore_decoder=True)
+
+    assert jukebox.track_ids == [1, 2, 3]
+
+
+def test_save_and_load(tmp_path):
+    jukebox = m.MuslyJukebox(method="mandelellis")
+    track = jukebox.track_from_audiofile(
+        to_fixture_path("sample-15s.mp3"), length=15, start=0
+    )
+    jukebox.set_style([track])
+    jukebox.add_tracks([(42, track)])
+    path = tmp_path / "saved.jukebox"
+    stream = io.BytesIO()
+
+    jukebox.save(str(path))
+    jukebox.serialize_to_stream(stream)
+    jukebox2 = m.MuslyJukebox.load(str(path), ignore_decoder=False)
+
+    assert path.read_bytes() == stream.getvalue()
+    assert jukebox2.method == jukebox.method
+    assert jukebox2.track_ids == jukebox.track_ids
+    assert jukebox2.compute_similarity(42, [42]) == jukebox.compute_similarity(42, [42])
+
+
+def test_save_append_and_compact(tmp_path):
+    jukebox, tracks = sample_jukebox([1, 2])
+    path = str(tmp_path / "appended.jukebox")
+    jukebox.save(path)
+    base_size = (tmp_path / "appended.jukebox").stat().st_size
+
+    jukebox.add_tracks([(3, tracks[2]), (4, tracks[0])])
+    jukebox.remove_tracks([2, 4])
+    jukebox.save(path, append=True)
+    jukebox2 = m.MuslyJukebox.load(path)
+
+    assert sorted(jukebox2.track_ids) == [1, 3]
+    assert jukebox2.nearest(1, k=1) == jukebox.nearest(1, k=1)
+    assert jukebox2.nearest(3, k=1) == jukebox.nearest(3, k=1)
+    assert (tmp_path / "appended.jukebox").stat().st_size > base_size
+
+    jukebox2.add_tracks([(2, tracks[1])])
+    jukebox2.save(path, append=True)
+    jukebox2.compact(path)
+
+    assert sorted(m.MuslyJukebox.load(path).track_ids) == [1, 2, 3]
+    with pytest.raises(m.MuslyError):
+        jukebox.save(path, append=True)
+    with pytest.raises(m.MuslyError):
+        jukebox.save(str(tmp_path / "other.jukebox"), append=True)
+
+
+@pytest.mark.parametrize("cut", [1, 8, 20])
+def test_load_truncated_segment(tmp_path, cut):
+    jukebox, tracks = sample_jukebox([1, 2])
+    path = tmp_path / "truncated.jukebox"
+    jukebox.save(str(path))
+    jukebox.remove_tracks([2])
+    jukebox.save(str(path), append=True)
+    base_size = path.stat().st_size
+
+    jukebox.add_tracks([(3, tracks[2])])
+    jukebox.save(str(path), append=True)
+    with open(path, "r+b") as fh:
+        fh.truncate(base_size + cut)
+    jukebox2 = m.MuslyJukebox.load(str(path))
+
+    assert jukebox2.track_ids == [1]
+    with pytest.raises(m.MuslyError):
+        jukebox2.save(str(path), append=True)
+    jukebox2.compact(str(path))
+    assert m.MuslyJukebox.load(str(path)).track_ids == [1]
+
+
+def test_load_fixture():
+    jukebox = m.MuslyJukebox.load(to_fixture_path("valid.jukebox"))
+
+    assert jukebox.track_ids == [1, 2, 3]
+
+
 def test_create_from_stream_invalid_version():
     with pytest.raises(m.MuslyError) as e:
         with open(to_fixture_path("wrong_version.jukebox"), "rb") as fh:
@@ -261,3 +481,585 @@ def test_track_deserialization():
     similarity_after = jukebox.compute_similarity((1, track_1), [(3, track_3b)])
 
     assert similarity_before == similarity_after
+
+
+def test_nearest():
+    jukebox = m.MuslyJukebox()
+    track_1 = jukebox.track_from_audiofile(
+        to_fixture_path("sample-15s.mp3"), start=0, length=15
+    )
+    track_2 = jukebox.track_from_audiofile(
+        to_fixture_path("sample-12s.mp3"), start=0, length=12
+    )
+    track_3 = jukebox.track_from_audiofile(
+        to_fixture_path("sample-9s.mp3"), start=0, length=9
+    )
+    jukebox.set_style([track_1, track_2, track_3])
+    jukebox.add_tracks([(1, track_1), (2, track_2), (3, track_3)])
+
+    neighbors = jukebox.nearest(1, k=2)
+    similarities = jukebox.compute_similarity((1, track_1), [(2, track_2), (3, track_3)])
+
+    assert [id for id, _ in neighbors] == sorted(
+        [2, 3], key=lambda id: similarities[id - 2]
+    )
+    assert sorted(value for _, value in neighbors) == sorted(similarities)
+    assert jukebox.nearest(1, k=5, candidate_ids=[3]) == [(3, similarities[1])]
+
+
+def test_compute_similarity_by_id():
+    jukebox, tracks = sample_jukebox()
+
+    assert jukebox.compute_similarity(1, [2, 3]) == jukebox.compute_similarity(
+        (1, tracks[0]), [(2, tracks[1]), (3, tracks[2])]
+    )
+    with pytest.raises(m.MuslyError):
+        jukebox.compute_similarity(1, [4])
+
+
+def test_removed_track_slots_are_reused(tmp_path):
+    jukebox, tracks = sample_jukebox()
+    expected = jukebox.compute_similarity(1, [3])
+
+    jukebox.remove_tracks([2])
+    jukebox.add_tracks([(4, tracks[1])])
+    path = str(tmp_path / "mapped.jukebox")
+    jukebox.save_mapped(path)
+    jukebox2 = m.MuslyJukebox.open_mapped(path)
+
+    assert jukebox.compute_similarity(1, [3]) == expected
+    assert sorted(jukebox2.track_ids) == [1, 3, 4]
+    assert jukebox2.compute_similarity(1, [3, 4]) == jukebox.compute_similarity(
+        1, [3, 4]
+    )
+    with pytest.raises(m.MuslyError):
+        jukebox.compute_similarity(2, [1])
+
+
+def test_concurrent_queries():
+    jukebox, tracks = sample_jukebox()
+    expected = [id for id, _ in jukebox.nearest(1, k=2)]
+
+    def query(n):
+        if n % 10 == 0:
+            jukebox.add_tracks([(4, tracks[2])])
+            jukebox.remove_tracks([4])
+        return [id for id, _ in jukebox.nearest(1, k=2, candidate_ids=[2, 3])]
+
+    with ThreadPoolExecutor(max_workers=8) as executor:
+        results = list(executor.map(query, range(100)))
+
+    assert all(result == expected for result in results)
+
+
+def test_queries_after_writes():
+    jukebox, tracks = sample_jukebox([1, 2])
+    fresh = m.MuslyJukebox()
+    fresh.set_style(tracks)
+    fresh.add_tracks([(1, tracks[0]), (3, tracks[2])])
+
+    jukebox.nearest(1, k=1)
+    jukebox.add_tracks([(3, tracks[2])])
+    jukebox.remove_tracks([2])
+
+    assert jukebox.nearest(1, k=2) == fresh.nearest(1, k=2)
+    assert jukebox.compute_similarity(3, [1, 3]) == fresh.compute_similarity(3, [1, 3])
+
+
+def test_analysis_concurrent_with_writes():
+    jukebox, tracks = sample_jukebox()
+    noise = np.random.default_rng(7).random(22050 * 10, dtype=np.float32)
+    expected = jukebox.serialize_track(jukebox.track_from_audiodata(noise))
+
+    def analyze_or_write(n):
+        if n % 2 == 0:
+            jukebox.add_tracks([(4 + n, tracks[n % 3])])
+            jukebox.remove_tracks([4 + n])
+            return expected
+        return jukebox.serialize_track(jukebox.track_from_audiodata(noise))
+
+    with ThreadPoolExecutor(max_workers=8) as executor:
+        results = list(executor.map(analyze_or_write, range(40)))
+
+    assert all(result == expected for result in results)
+    assert sorted(jukebox.track_ids) == [1, 2, 3]
+
+
+def test_nearest_unknown_seed():
+    jukebox = m.MuslyJukebox()
+
+    with pytest.raises(m.MuslyError) as e:
+        jukebox.nearest(7, k=1)
+
+    assert e.match("no track data registered for seed track 7")
+
+
+def test_array_results():
+    jukebox = m.MuslyJukebox()
+    track_1 = jukebox.track_from_audiofile(
+        to_fixture_path("sample-15s.mp3"), start=0, length=15
+    )
+    track_2 = jukebox.track_from_audiofile(
+        to_fixture_path("sample-12s.mp3"), start=0, length=12
+    )
+    jukebox.set_style([track_1, track_2])
+    jukebox.add_tracks([(1, track_1), (2, track_2)])
+
+    similarities = jukebox.compute_similarity_array((1, track_1), [(2, track_2)])
+    track_ids, scores = jukebox.nearest_array(1, k=1)
+
+    assert similarities.dtype == np.float32
+    assert similarities.tolist() == jukebox.compute_similarity(
+        (1, track_1), [(2, track_2)]
+    )
+    assert jukebox.track_ids_array.tolist() == jukebox.track_ids
+    assert track_ids.tolist() == [2]
+    assert scores.tolist() == similarities.tolist()
+
+
+def test_similarity_matrix():
+    jukebox, tracks = sample_jukebox()
+
+    matrix = jukebox.similarity_matrix(threads=2)
+    matrix_64 = jukebox.similarity_matrix(track_ids=[3, 1], dtype=np.float64)
+    neighbor_ids, neighbor_values = jukebox.similarity_matrix(top_k=1)
+
+    assert matrix.shape == (3, 3) and matrix.dtype == np.float32
+    assert matrix[0].tolist() == jukebox.compute_similarity(
+        (1, tracks[0]), list(zip([1, 2, 3], tracks))
+    )
+    assert matrix_64.dtype == np.float64
+    assert matrix_64[0, 1] == pytest.approx(matrix[2, 0])
+    assert neighbor_ids[0].tolist() == [jukebox.nearest(1, k=1)[0][0]]
+    assert neighbor_values.shape == (3, 1)
+
+
+def test_generate_playlist():
+    jukebox, _ = sample_jukebox(range(30))
+
+    playlist = jukebox.generate_playlist([0], length=10)
+
+    assert playlist[0] == 0
+    assert len(set(playlist)) == 10
+
+    playlist = jukebox.generate_playlist([0, 1], 10, exclude_ids=[3, 6], beam_width=3)
+
+    assert playlist[:2] == [0, 1] and len(playlist) == 10
+    assert not {3, 6} & set(playlist)
+
+    track_ids = np.arange(30)
+    playlist = jukebox.generate_playlist(
+        [0], 9, tag_track_ids=track_ids, tags=track_ids % 3, tag_windows=[2]
+    )
+
+    assert len(playlist) == 9
+    assert all(len({id % 3 for id in playlist[i : i + 3]}) == 3 for i in range(7))
+
+    tags = np.column_stack([np.zeros(30), track_ids % 3])
+    assert jukebox.generate_playlist(
+        [0], 5, tag_track_ids=track_ids, tags=tags, tag_windows=[1, 0]
+    ) == [0]
+    assert jukebox.generate_playlist([0, 1, 2], 2) == [0, 1]
+
+    with pytest.raises(m.MuslyError):
+        jukebox.generate_playlist([0], 5, tag_track_ids=track_ids, tags=tags)
+    with pytest.raises(m.MuslyError):
+        jukebox.generate_playlist(
+            [0], 5, tag_track_ids=track_ids, tags=tags, tag_windows=[1]
+        )
+    with pytest.raises(m.MuslyError):
+        jukebox.generate_playlist([0], 5, beam_width=0)
+    with pytest.raises(m.MuslyError):
+        jukebox.generate_playlist([100], 5)
+
+
+def test_save_and_open_mapped(tmp_path):
+    jukebox, _ = sample_jukebox([5, 3, 9])
+    path = str(tmp_path / "mapped.jukebox")
+
+    jukebox.save_mapped(path)
+    jukebox2 = m.MuslyJukebox.open_mapped(path, ignore_decoder=False)
+
+    assert jukebox2.method == jukebox.method
+    assert jukebox2.track_ids == jukebox.track_ids
+    assert jukebox2.nearest(5, k=2) == jukebox.nearest(5, k=2)
+
+    jukebox2.remove_tracks([3])
+
+    assert [id for id, _ in jukebox2.nearest(5, k=2)] == [9]
+
+    jukebox2.save_mapped(path)
+    jukebox3 = m.MuslyJukebox.open_mapped(path)
+
+    assert sorted(jukebox3.track_ids) == [5, 9]
+    assert jukebox3.nearest(5, k=2) == jukebox2.nearest(5, k=2)
+    assert [p.name for p in tmp_path.iterdir()] == ["mapped.jukebox"]
+
+
+def test_graph_index(tmp_path):
+    jukebox, tracks = sample_jukebox(range(300))
+    expected = jukebox.nearest(0, k=5)
+
+    assert not jukebox.has_graph_index
+    jukebox.build_graph_index(max_neighbors=8, ef_construction=50, threads=2)
+
+    assert jukebox.has_graph_index
+    assert jukebox.graph_search_ef == 64
+    assert [s for _, s in jukebox.nearest(0, k=5)] == pytest.approx(
+        [s for _, s in expected]
+    )
+    assert jukebox.nearest(0, k=5, candidate_ids=[1, 2, 3]) == jukebox.nearest(
+        0, k=5, candidate_ids=[3, 2, 1]
+    )
+
+    jukebox.add_tracks([(1000, tracks[0])])
+    jukebox.remove_tracks([3])
+    neighbor_ids = [id for id, _ in jukebox.nearest(0, k=5)]
+
+    assert 1000 in neighbor_ids
+    assert 3 not in neighbor_ids
+
+    path = str(tmp_path / "graph.jukebox")
+    jukebox.save(path)
+    loaded = m.MuslyJukebox.load(path)
+
+    assert loaded.has_graph_index
+    assert loaded.nearest(0, k=5) == jukebox.nearest(0, k=5)
+
+    stream = io.BytesIO()
+    jukebox.serialize_to_stream(stream)
+    stream.write(b"tail")
+    stream.seek(0)
+    loaded = m.MuslyJukebox.create_from_stream(stream, ignore_decoder=True)
+
+    assert loaded.has_graph_index
+    assert loaded.nearest(0, k=5) == jukebox.nearest(0, k=5)
+    assert stream.read() == b"tail"
+
+    jukebox.drop_graph_index()
+
+    assert not jukebox.has_graph_index
+    with pytest.raises(m.MuslyError):
+        jukebox.graph_search_ef = 0
+    with pytest.raises(m.MuslyError):
+        jukebox.build_graph_index(max_neighbors=1)
+
+
+@pytest.mark.parametrize("encoding", ["float16", "int8"])
+def test_track_storage(tmp_path, encoding):
+    jukebox, tracks = sample_jukebox([5, 3, 9])
+    expected = jukebox.nearest(5, k=2)
+
+    report = jukebox.evaluate_track_storage(encoding, k=2)
+
+    assert report["recall"] == 1.0
+    assert report["mean_absolute_error"] < 0.05
+    assert report["bytes_per_track"] < jukebox.track_size
+
+    assert jukebox.track_storage == "float32"
+    jukebox.track_storage = encoding
+
+    assert jukebox.track_storage == encoding
+    assert [id for id, _ in jukebox.nearest(5, k=2)] == [id for id, _ in expected]
+    with pytest.raises(m.MuslyError):
+        jukebox.evaluate_track_storage(encoding)
+
+    path = str(tmp_path / "mapped.jukebox")
+    jukebox.save_mapped(path)
+    jukebox2 = m.MuslyJukebox.open_mapped(path)
+
+    assert jukebox2.track_storage == encoding
+    assert jukebox2.nearest(5, k=2) == jukebox.nearest(5, k=2)
+
+    path = str(tmp_path / "compact.jukebox")
+    jukebox.save(path)
+    jukebox.add_tracks([(7, tracks[1])])
+    jukebox.save(path, append=True)
+    jukebox3 = m.MuslyJukebox.load(path)
+    stream = io.BytesIO()
+    jukebox.serialize_to_stream(stream)
+    stream.seek(0)
+    jukebox4 = m.MuslyJukebox.create_from_stream(stream, ignore_decoder=True)
+
+    assert jukebox3.track_storage == encoding
+    assert jukebox3.nearest(5, k=3) == jukebox.nearest(5, k=3)
+    assert jukebox4.track_storage == encoding
+    assert jukebox4.nearest(5, k=3) == jukebox.nearest(5, k=3)
+
+    jukebox3.track_storage = "float32"
+    float_stream = io.BytesIO()
+    jukebox3.serialize_to_stream(float_stream)
+    jukebox3.save(path)
+
+    assert len(stream.getvalue()) < len(float_stream.getvalue())
+    assert m.MuslyJukebox.load(path).track_storage == "float32"
+    with pytest.raises(m.MuslyError):
+        jukebox.track_storage = "float8"
+
+
+@pytest.mark.skipif(is_windows_platform(), reason="no POSIX shared memory")
+def test_save_and_attach_shared():
+    jukebox, _ = sample_jukebox([5, 3, 9])
+    name = f"pymusly-test-{random.getrandbits(32)}"
+
+    jukebox.save_shared(name)
+    try:
+        jukebox2 = m.MuslyJukebox.attach_shared(name)
+        jukebox3 = m.MuslyJukebox.attach_shared("/" + name)
+    finally:
+        assert m.MuslyJukebox.remove_shared(name)
+
+    assert not m.MuslyJukebox.remove_shared(name)
+    assert jukebox2.track_ids == jukebox.track_ids
+    assert jukebox2.nearest(5, k=2) == jukebox.nearest(5, k=2)
+    assert jukebox3.nearest(9, k=2) == jukebox.nearest(9, k=2)
+
+    with pytest.raises(m.MuslyError):
+        m.MuslyJukebox.attach_shared(name)
+    with pytest.raises(m.MuslyError):
+        m.MuslyJukebox.attach_shared("invalid/name")
+
+
+@pytest.mark.skipif(is_windows_platform(), reason="no POSIX shared memory")
+def test_save_shared_replaces_attached():
+    jukebox, _ = sample_jukebox([5, 3, 9])
+    jukebox2, _ = sample_jukebox([5, 3])
+    name = f"pymusly-test-{random.getrandbits(32)}"
+
+    jukebox.save_shared(name)
+    try:
+        attached = m.MuslyJukebox.attach_shared(name)
+        jukebox2.save_shared(name)
+        attached2 = m.MuslyJukebox.attach_shared(name)
+    finally:
+        assert m.MuslyJukebox.remove_shared(name)
+
+    assert not m.MuslyJukebox.remove_shared(name + ".tmp")
+    assert attached.track_ids == jukebox.track_ids
+    assert attached.nearest(5, k=2) == jukebox.nearest(5, k=2)
+    assert attached2.track_ids == jukebox2.track_ids
+
+
+# offsets of header fields in the mapped jukebox format
+_MAPPED_FORMAT_VERSION = 8
+_MAPPED_JUKEBOX_HEADER_OFFSET = 184
+_MAPPED_RECORD_COUNT = 232
+_MAPPED_INDEX_COUNT = 240
+_MAPPED_INDEX_OFFSET = 248
+
+
+def _swap_index_entries(data):
+    index_offset = struct.unpack_from("=Q", data, _MAPPED_INDEX_OFFSET)[0]
+    first, second = struct.unpack_from("=8s8s", data, index_offset)
+    struct.pack_into("=8s8s", data, index_offset, second, first)
+
+
+def _invalidate_index_record(data):
+    index_offset = struct.unpack_from("=Q", data, _MAPPED_INDEX_OFFSET)[0]
+    struct.pack_into("=I", data, index_offset + 4, 0xFFFFFFFF)
+
+
+@pytest.mark.parametrize(
+    "corrupt",
+    [
+        None,
+        lambda data: struct.pack_into("=I", data, _MAPPED_FORMAT_VERSION, 2),
+        lambda data: struct.pack_into(
+            "=Q", data, _MAPPED_JUKEBOX_HEADER_OFFSET, len(data) + 1
+        ),
+        lambda data: struct.pack_into("=Q", data, _MAPPED_INDEX_OFFSET, 2**64 - 8),
+        lambda data: struct.pack_into("=Q", data, _MAPPED_RECORD_COUNT, 2**62),
+        lambda data: struct.pack_into("=Q", data, _MAPPED_INDEX_COUNT, 2**61),
+        _invalidate_index_record,
+        _swap_index_entries,
+    ],
+    ids=[
+        "not_mapped",
+        "format_version",
+        "jukebox_header_offset",
+        "index_offset",
+        "record_count",
+        "index_count",
+        "index_record",
+        "index_order",
+    ],
+)
+def test_open_mapped_invalid(tmp_path, corrupt):
+    path = tmp_path / "invalid.jukebox"
+    if corrupt is None:
+        path.write_bytes(open(to_fixture_path("valid.jukebox"), "rb").read())
+    else:
+        jukebox, _ = sample_jukebox([5, 3, 9])
+        jukebox.save_mapped(str(path))
+        data = bytearray(path.read_bytes())
+        corrupt(data)
+        path.write_bytes(data)
+
+    with pytest.raises(m.MuslyError) as e:
+        m.MuslyJukebox.open_mapped(str(path))
+
+    assert e.match("failed loading jukebox: ")
+
+
+def test_batch_track_serialization():
+    jukebox = m.MuslyJukebox()
+    tracks = analyze_samples(jukebox)
+
+    data = jukebox.serialize_tracks(tracks)
+    restored = jukebox.deserialize_tracks(np.frombuffer(data, dtype=np.uint8))
+    first_two = jukebox.deserialize_tracks(data + b"\0", count=2)
+
+    assert len(data) == 3 * jukebox.track_size
+    assert data == b"".join(jukebox.serialize_track(track) for track in tracks)
+    assert jukebox.serialize_tracks(restored) == data
+    assert len(first_two) == 2
+    with pytest.raises(m.MuslyError):
+        jukebox.deserialize_tracks(data[:-1])
+
+
+def test_stats():
+    jukebox = m.MuslyJukebox()
+    if not jukebox.stats()["enabled"]:
+        assert jukebox.stats() == {"enabled": False}
+        return
+
+    tracks = analyze_samples(jukebox)
+    jukebox.set_style(tracks)
+    jukebox.add_tracks(list(zip([1, 2, 3], tracks)))
+    jukebox.compute_similarity(1, [1, 2, 3])
+    stream = io.BytesIO()
+    jukebox.serialize_to_stream(stream)
+
+    stats = jukebox.stats()
+    operations = stats["operations"]
+
+    assert stats["tracks_analyzed"] == 3
+    assert operations["track_from_audiofile"]["calls"] == 3
+    assert operations["musly_analysis"]["calls"] == 3
+    assert operations["compute_similarity"]["calls"] == 1
+    assert sum(operations["compute_similarity"]["histogram"]) == 1
+    assert operations["musly_similarity_batch"]["calls"] == 1
+    assert (
+        operations["musly_similarity_batch"]["total_seconds"]
+        <= operations["compute_similarity"]["total_seconds"]
+    )
+    assert stats["streams"]["write"]["bytes"] == len(stream.getvalue())
+    assert stats["peak_buffer_bytes"] > 0
+
+    jukebox.reset_stats()
+    jukebox.similarity_matrix(threads=1)
+    operations = jukebox.stats()["operations"]
+
+    # one batch per row, as all columns fit into a single batch
+    assert operations["similarity_matrix"]["calls"] == 1
+    assert operations["musly_similarity_batch"]["calls"] == 3
+
+    jukebox.reset_stats()
+
+    assert jukebox.stats()["operations"]["compute_similarity"]["calls"] == 0
+    assert jukebox.stats()["streams"]["write"]["bytes"] == 0
+
+
+def test_async_api(tmp_path):
+    jukebox = m.MuslyJukebox()
+    filenames = [to_fixture_path(f"sample-{n}s.mp3") for n in (15, 12, 9)]
+
+    async def analyze():
+        return await asyncio.gather(
+            *[jukebox.analyze_file_async(filename, 9, 0) for filename in filenames]
+        )
+
+    tracks = asyncio.run(analyze())
+    assert [jukebox.serialize_track(track) for track in tracks] == [
+        jukebox.serialize_track(jukebox.track_from_audiofile(filename, 9, 0))
+        for filename in filenames
+    ]
+
+    jukebox.set_style(tracks)
+    jukebox.add_tracks(list(zip([1, 2, 3], tracks)))
+    path = str(tmp_path / "async.jukebox")
+    jukebox.save(path)
+
+    async def query(target):
+        return await asyncio.gather(*[target.nearest_async(1, k=2) for _ in range(50)])
+
+    async def load_and_query():
+        loaded = await m.MuslyJukebox.load_async(path)
+        return loaded.track_ids, await query(loaded)
+
+    expected = jukebox.nearest(1, k=2)
+    loaded_track_ids, loaded_results = asyncio.run(load_and_query())
+
+    assert len(expected) == 2
+    assert asyncio.run(query(jukebox)) == [expected] * 50
+    assert loaded_track_ids == jukebox.track_ids
+    assert loaded_results == [expected] * 50
+
+
+def test_async_api_errors():
+    jukebox = m.MuslyJukebox()
+
+    async def analyze():
+        await jukebox.analyze_file_async(to_fixture_path("does-not-exist.mp3"), 9, 0)
+
+    async def query():
+        await jukebox.nearest_async(1, k=2)
+
+    with pytest.raises(m.MuslyError):
+        asyncio.run(analyze())
+    with pytest.raises(m.MuslyError):
+        asyncio.run(query())
+    with pytest.raises(RuntimeError):
+        jukebox.nearest_async(1, k=2)
+
+
+def test_vectorized_prefilter():
+    jukebox, _ = sample_jukebox(range(1200), method="timbre")
+
+    similarities = jukebox.compute_similarity(0, list(range(1, 1200)))
+    expected = sorted(zip(range(1, 1200), similarities), key=lambda n: (n[1], n[0]))
+
+    assert not jukebox.vectorized_prefilter
+    jukebox.vectorized_prefilter = True
+
+    candidate_ids = [i for i in range(1, 1200) if i % 7]
+    assert jukebox.nearest(0, k=5) == expected[:5]
+    assert jukebox.nearest(0, k=2, candidate_ids=candidate_ids) == [
+        n for n in expected if n[0] % 7
+    ][:2]
+
+    with pytest.raises(m.MuslyError):
+        m.MuslyJukebox("mandelellis").vectorized_prefilter = True
+
+
+def test_vectorized_prefilter_prunes_candidates():
+    jukebox = m.MuslyJukebox("timbre")
+    rng = np.random.default_rng(7)
+    t = np.arange(2 * 22050, dtype=np.float32) / 22050
+
+    # twice as many distinct tracks as the prefilter keeps, so it has to rank them correctly
+    tracks = []
+    for _ in range(2000):
+        low, high = rng.uniform(40, 8000, size=2)
+        pcm = (
+            rng.uniform(0.1, 1) * np.sin(2 * np.pi * low * t)
+            + rng.uniform(0.1, 1) * np.sin(2 * np.pi * high * t)
+            + rng.uniform(0.01, 1) * rng.standard_normal(t.size)
+        )
+        pcm = 0.9 * pcm / np.abs(pcm).max()
+        tracks.append(jukebox.track_from_audiodata(pcm.astype(np.float32)))
+    jukebox.set_style(tracks[:200])
+    jukebox.add_tracks(list(enumerate(tracks)))
+
+    seeds = range(0, 2000, 200)
+    expected = {}
+    for seed in seeds:
+        track_ids = [i for i in range(2000) if i != seed]
+        similarities = jukebox.compute_similarity(seed, track_ids)
+        expected[seed] = sorted(
+            zip(track_ids, similarities), key=lambda n: (n[1], n[0])
+        )[:5]
+
+    jukebox.vectorized_prefilter = True
+
+    assert {seed: jukebox.nearest(seed, k=5) for seed in seeds} == expected
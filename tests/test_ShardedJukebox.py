@@ -0,0 +1,80 @@
+import pytest
+
+import pymusly as m
+
+from tests.helper import analyze_samples
+
+
+def test_init_invalid():
+    with pytest.raises(m.MuslyError):
+        m.ShardedJukebox(0)
+
+
+def test_nearest_matches_single_jukebox():
+    jukebox = m.MuslyJukebox()
+    sharded = m.ShardedJukebox(2)
+    tracks = analyze_samples(jukebox)
+    jukebox.set_style(tracks)
+    sharded.set_style(tracks)
+    tuples = list(zip([1, 2, 3, 4, 5], tracks + tracks[:2]))
+
+    jukebox.add_tracks(tuples)
+    sharded.add_tracks(tuples)
+
+    assert sharded.shard_count == 2
+    assert sorted(sharded.track_ids) == [1, 2, 3, 4, 5]
+    assert sharded.shard_of(3) == 1
+    assert sharded.shard(0).track_count == 5
+    assert sharded.nearest(1, k=3) == jukebox.nearest(1, k=3)
+    assert sharded.nearest(2, k=4, candidate_ids=[1, 3, 4]) == jukebox.nearest(
+        2, k=4, candidate_ids=[1, 3, 4]
+    )
+
+    sharded.remove_tracks([4])
+
+    assert 4 not in [id for id, _ in sharded.nearest(1, k=4)]
+    with pytest.raises(m.MuslyError):
+        sharded.nearest(4, k=1)
+
+
+def test_generated_ids():
+    sharded = m.ShardedJukebox(3)
+    tracks = analyze_samples(sharded.shard(0))
+    sharded.set_style(tracks)
+
+    ids = sharded.add_tracks(tracks)
+
+    assert sorted(sharded.track_ids) == sorted(ids)
+    assert [id for id, _ in sharded.nearest(ids[0], k=2)] != []
+
+
+def test_failed_add_tracks_is_undone():
+    sharded = m.ShardedJukebox(3)
+    tracks = analyze_samples(sharded.shard(0))
+
+    # the last shard has no style and rejects all tracks, the others must drop them again
+    sharded.shard(0).set_style(tracks)
+    sharded.shard(1).set_style(tracks)
+    with pytest.raises(m.MuslyError):
+        sharded.add_tracks(list(zip([1, 2, 3], tracks)))
+
+    assert [sharded.shard(i).track_ids for i in range(3)] == [[], [], []]
+
+
+def test_save_and_open_mapped(tmp_path):
+    sharded = m.ShardedJukebox(2)
+    tracks = analyze_samples(sharded.shard(0))
+    sharded.set_style(tracks)
+    sharded.add_tracks(list(zip([1, 2, 3], tracks)))
+    paths = [str(tmp_path / f"shard-{i}.jukebox") for i in range(2)]
+
+    sharded.save_mapped(paths)
+    sharded2 = m.ShardedJukebox.open_mapped(paths)
+    shard = m.MuslyJukebox.open_mapped(paths[1])
+
+    assert sharded2.nearest(2, k=2) == sharded.nearest(2, k=2)
+    assert [id for id, _ in shard.nearest(3, k=2)] == [1]
+    with pytest.raises(m.MuslyError):
+        shard.nearest(2, k=2)
+    with pytest.raises(m.MuslyError):
+        sharded.save_mapped(paths[:1])
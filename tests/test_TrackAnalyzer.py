@@ -0,0 +1,58 @@
+import numpy as np
+import pytest
+
+import pymusly as m
+
+
+def _noise(seconds: float):
+    return np.random.default_rng(23).random(int(22050 * seconds), dtype=np.float32)
+
+
+def test_finish():
+    jukebox = m.MuslyJukebox()
+    analyzer = m.TrackAnalyzer(jukebox, window=10)
+    noise = _noise(10)
+
+    for chunk in np.split(noise, 10):
+        assert analyzer.feed(chunk) == []
+    track = analyzer.finish()
+
+    assert analyzer.buffered_samples == 0
+    assert jukebox.serialize_track(track) == jukebox.serialize_track(
+        jukebox.track_from_audiodata(noise)
+    )
+
+
+def test_finish_keeps_last_window():
+    jukebox = m.MuslyJukebox()
+    analyzer = m.TrackAnalyzer(jukebox, window=5)
+    noise = _noise(12)
+
+    for chunk in np.array_split(noise, 7):
+        analyzer.feed(chunk)
+
+    assert analyzer.buffered_samples == analyzer.window_samples
+    assert jukebox.serialize_track(analyzer.finish()) == jukebox.serialize_track(
+        jukebox.track_from_audiodata(noise[-analyzer.window_samples :])
+    )
+
+
+def test_sliding_window():
+    jukebox = m.MuslyJukebox()
+    analyzer = m.TrackAnalyzer(jukebox, window=5, hop=2)
+    noise = _noise(10)
+
+    tracks = analyzer.feed(noise)
+
+    assert len(tracks) == 3
+    assert all(isinstance(track, m.MuslyTrack) for track in tracks)
+    assert jukebox.serialize_track(tracks[-1]) == jukebox.serialize_track(
+        jukebox.track_from_audiodata(noise[22050 * 4 : 22050 * 9])
+    )
+
+
+def test_finish_without_data():
+    analyzer = m.TrackAnalyzer(m.MuslyJukebox())
+
+    with pytest.raises(m.MuslyError):
+        analyzer.finish()